@@ -0,0 +1,406 @@
+#include "rgb_to_yuv.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "base/thread_pool.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#define RGB_TO_YUV_X86 1
+#endif
+
+namespace av {
+
+namespace {
+
+// Luma is computed in Q14. Chroma sums four pixels, so it is computed in Q16
+// with the same coefficients.
+constexpr int kLumaShift = 14;
+constexpr int kChromaShift = 16;
+
+// Frames with at least this many pixels are split across the pool.
+constexpr int64_t kParallelPixels = 1920 * 1080;
+
+// Pixels in each band of rows handed to the pool.
+constexpr int kBandPixels = 256 * 1024;
+
+struct Coefficients {
+  // Weights of R, G and B.
+  int16_t y[3];
+  int16_t u[3];
+  int16_t v[3];
+  // Offset and rounding, in the fixed point of the result.
+  int32_t y_bias;
+  int32_t c_bias;
+};
+
+// Two source rows and where their luma and shared chroma go. For the last row
+// of an odd height both rows are the same.
+struct RowPair {
+  const uint8_t* rgb[2];
+  uint8_t* y[2];
+  uint8_t* u;
+  uint8_t* v;
+  int width;
+};
+
+Coefficients MakeCoefficients(YuvMatrix matrix, YuvRange range) {
+  double kr = matrix == YuvMatrix::kBt709 ? 0.2126 : 0.299;
+  double kb = matrix == YuvMatrix::kBt709 ? 0.0722 : 0.114;
+  bool full = range == YuvRange::kFull;
+  double y_scale = full ? 1.0 : 219.0 / 255.0;
+  double c_scale = full ? 1.0 : 224.0 / 255.0;
+  auto fixed = [](double v) {
+    return static_cast<int16_t>(std::lround(v * (1 << kLumaShift)));
+  };
+
+  Coefficients c;
+  // The middle weight takes the rounding error, so that the weights add up
+  // exactly and greys stay grey.
+  c.y[0] = fixed(kr * y_scale);
+  c.y[2] = fixed(kb * y_scale);
+  c.y[1] = fixed(y_scale) - c.y[0] - c.y[2];
+  c.u[0] = fixed(-kr / (2 * (1 - kb)) * c_scale);
+  c.u[2] = fixed(0.5 * c_scale);
+  c.u[1] = -c.u[0] - c.u[2];
+  c.v[0] = fixed(0.5 * c_scale);
+  c.v[2] = fixed(-kb / (2 * (1 - kr)) * c_scale);
+  c.v[1] = -c.v[0] - c.v[2];
+  c.y_bias = ((full ? 0 : 16) << kLumaShift) + (1 << (kLumaShift - 1));
+  c.c_bias = (128 << kChromaShift) + (1 << (kChromaShift - 1));
+  return c;
+}
+
+uint8_t Clamp(int32_t v) {
+  return static_cast<uint8_t>(std::clamp(v, 0, 255));
+}
+
+// Converts the pixels of |row| from column |begin|, which must be even.
+void ConvertPixels(const RowPair& row, const Coefficients& c, int begin) {
+  for (int x = begin; x < row.width; x += 2) {
+    int columns[2] = {x, std::min(x + 1, row.width - 1)};
+    int32_t sum[3] = {0, 0, 0};
+    for (int r = 0; r < 2; r++) {
+      for (int column : columns) {
+        const uint8_t* p = row.rgb[r] + column * 3;
+        row.y[r][column] = Clamp(
+            (c.y[0] * p[0] + c.y[1] * p[1] + c.y[2] * p[2] + c.y_bias) >>
+            kLumaShift);
+        for (int i = 0; i < 3; i++) {
+          sum[i] += p[i];
+        }
+      }
+    }
+    row.u[x / 2] = Clamp(
+        (c.u[0] * sum[0] + c.u[1] * sum[1] + c.u[2] * sum[2] + c.c_bias) >>
+        kChromaShift);
+    row.v[x / 2] = Clamp(
+        (c.v[0] * sum[0] + c.v[1] * sum[1] + c.v[2] * sum[2] + c.c_bias) >>
+        kChromaShift);
+  }
+}
+
+void ConvertRowPairScalar(const RowPair& row, const Coefficients& c) {
+  ConvertPixels(row, c, 0);
+}
+
+#if defined(RGB_TO_YUV_X86)
+
+#if defined(__GNUC__)
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#endif
+
+// Shuffles picking R, G and B of 8 pixels out of 24 bytes, as 16 bit lanes.
+// The first 16 bytes go through |lo| and the last 8 through |hi|.
+TARGET_SSSE3 void ChannelShuffles(__m128i lo[3], __m128i hi[3]) {
+  lo[0] = _mm_setr_epi8(0, -1, 3, -1, 6, -1, 9, -1, 12, -1, 15, -1, -1, -1,
+                        -1, -1);
+  hi[0] = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, -1,
+                        5, -1);
+  lo[1] = _mm_setr_epi8(1, -1, 4, -1, 7, -1, 10, -1, 13, -1, -1, -1, -1, -1,
+                        -1, -1);
+  hi[1] = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, -1, 3, -1,
+                        6, -1);
+  lo[2] = _mm_setr_epi8(2, -1, 5, -1, 8, -1, 11, -1, 14, -1, -1, -1, -1, -1,
+                        -1, -1);
+  hi[2] = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, -1, 4, -1,
+                        7, -1);
+}
+
+// Weights for _mm_madd_epi16 over interleaved (a, b) and (c, 0) lanes.
+int32_t Pair(int16_t a, int16_t b) {
+  return static_cast<int32_t>(static_cast<uint16_t>(a) |
+                              (static_cast<uint32_t>(static_cast<uint16_t>(b))
+                               << 16));
+}
+
+// a * w[0] + b * w[1] + c * w[2] + bias, shifted down, for 8 lanes of 16 bit
+// values.
+template <int kShift>
+TARGET_SSSE3 __m128i Dot3Ssse3(__m128i a,
+                               __m128i b,
+                               __m128i c,
+                               __m128i ab_weights,
+                               __m128i c_weights,
+                               __m128i bias) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i lo = _mm_add_epi32(
+      _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), ab_weights),
+                    _mm_madd_epi16(_mm_unpacklo_epi16(c, zero), c_weights)),
+      bias);
+  __m128i hi = _mm_add_epi32(
+      _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), ab_weights),
+                    _mm_madd_epi16(_mm_unpackhi_epi16(c, zero), c_weights)),
+      bias);
+  return _mm_packs_epi32(_mm_srai_epi32(lo, kShift),
+                         _mm_srai_epi32(hi, kShift));
+}
+
+// 16 pixels of each row at a time.
+TARGET_SSSE3 void ConvertRowPairSsse3(const RowPair& row,
+                                      const Coefficients& c) {
+  __m128i shuffle_lo[3];
+  __m128i shuffle_hi[3];
+  ChannelShuffles(shuffle_lo, shuffle_hi);
+  __m128i y_rg = _mm_set1_epi32(Pair(c.y[0], c.y[1]));
+  __m128i y_b = _mm_set1_epi32(Pair(c.y[2], 0));
+  __m128i u_rg = _mm_set1_epi32(Pair(c.u[0], c.u[1]));
+  __m128i u_b = _mm_set1_epi32(Pair(c.u[2], 0));
+  __m128i v_rg = _mm_set1_epi32(Pair(c.v[0], c.v[1]));
+  __m128i v_b = _mm_set1_epi32(Pair(c.v[2], 0));
+  __m128i y_bias = _mm_set1_epi32(c.y_bias);
+  __m128i c_bias = _mm_set1_epi32(c.c_bias);
+
+  int x = 0;
+  for (; x + 16 <= row.width; x += 16) {
+    __m128i sum[3] = {_mm_setzero_si128(), _mm_setzero_si128(),
+                      _mm_setzero_si128()};
+    for (int r = 0; r < 2; r++) {
+      __m128i luma[2];
+      __m128i channels[2][3];
+      for (int g = 0; g < 2; g++) {
+        const uint8_t* p = row.rgb[r] + (x + g * 8) * 3;
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i hi = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + 16));
+        for (int i = 0; i < 3; i++) {
+          channels[g][i] = _mm_or_si128(_mm_shuffle_epi8(lo, shuffle_lo[i]),
+                                        _mm_shuffle_epi8(hi, shuffle_hi[i]));
+        }
+        luma[g] = Dot3Ssse3<kLumaShift>(channels[g][0], channels[g][1],
+                                        channels[g][2], y_rg, y_b, y_bias);
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(row.y[r] + x),
+                       _mm_packus_epi16(luma[0], luma[1]));
+      for (int i = 0; i < 3; i++) {
+        sum[i] = _mm_add_epi16(
+            sum[i], _mm_hadd_epi16(channels[0][i], channels[1][i]));
+      }
+    }
+    __m128i u = Dot3Ssse3<kChromaShift>(sum[0], sum[1], sum[2], u_rg, u_b,
+                                        c_bias);
+    __m128i v = Dot3Ssse3<kChromaShift>(sum[0], sum[1], sum[2], v_rg, v_b,
+                                        c_bias);
+    __m128i uv = _mm_packus_epi16(u, v);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(row.u + x / 2), uv);
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(row.v + x / 2),
+                     _mm_srli_si128(uv, 8));
+  }
+  ConvertPixels(row, c, x);
+}
+
+template <int kShift>
+TARGET_AVX2 __m256i Dot3Avx2(__m256i a,
+                             __m256i b,
+                             __m256i c,
+                             __m256i ab_weights,
+                             __m256i c_weights,
+                             __m256i bias) {
+  __m256i zero = _mm256_setzero_si256();
+  __m256i lo = _mm256_add_epi32(
+      _mm256_add_epi32(
+          _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), ab_weights),
+          _mm256_madd_epi16(_mm256_unpacklo_epi16(c, zero), c_weights)),
+      bias);
+  __m256i hi = _mm256_add_epi32(
+      _mm256_add_epi32(
+          _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), ab_weights),
+          _mm256_madd_epi16(_mm256_unpackhi_epi16(c, zero), c_weights)),
+      bias);
+  return _mm256_packs_epi32(_mm256_srai_epi32(lo, kShift),
+                            _mm256_srai_epi32(hi, kShift));
+}
+
+// 32 pixels of each row at a time. Shuffles don't cross the 128 bit lanes, so
+// each group of 16 pixels is loaded with pixels 0-7 in the low lane and 8-15
+// in the high lane, and the results are put back in order when stored.
+TARGET_AVX2 void ConvertRowPairAvx2(const RowPair& row, const Coefficients& c) {
+  __m128i shuffle_lo128[3];
+  __m128i shuffle_hi128[3];
+  ChannelShuffles(shuffle_lo128, shuffle_hi128);
+  __m256i shuffle_lo[3];
+  __m256i shuffle_hi[3];
+  for (int i = 0; i < 3; i++) {
+    shuffle_lo[i] = _mm256_broadcastsi128_si256(shuffle_lo128[i]);
+    shuffle_hi[i] = _mm256_broadcastsi128_si256(shuffle_hi128[i]);
+  }
+  __m256i y_rg = _mm256_set1_epi32(Pair(c.y[0], c.y[1]));
+  __m256i y_b = _mm256_set1_epi32(Pair(c.y[2], 0));
+  __m256i u_rg = _mm256_set1_epi32(Pair(c.u[0], c.u[1]));
+  __m256i u_b = _mm256_set1_epi32(Pair(c.u[2], 0));
+  __m256i v_rg = _mm256_set1_epi32(Pair(c.v[0], c.v[1]));
+  __m256i v_b = _mm256_set1_epi32(Pair(c.v[2], 0));
+  __m256i y_bias = _mm256_set1_epi32(c.y_bias);
+  __m256i c_bias = _mm256_set1_epi32(c.c_bias);
+  // Chroma comes out as 4 byte groups of samples 0-3, 8-11, 16-19, 24-27 for
+  // U then V in the low lane and 4-7, 12-15, ... in the high lane.
+  __m256i chroma_order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+  int x = 0;
+  for (; x + 32 <= row.width; x += 32) {
+    __m256i sum[3] = {_mm256_setzero_si256(), _mm256_setzero_si256(),
+                      _mm256_setzero_si256()};
+    for (int r = 0; r < 2; r++) {
+      __m256i luma[2];
+      __m256i channels[2][3];
+      for (int g = 0; g < 2; g++) {
+        const uint8_t* p = row.rgb[r] + (x + g * 16) * 3;
+        __m256i lo = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(p))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 24)), 1);
+        __m256i hi = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(
+                _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + 16))),
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + 40)), 1);
+        for (int i = 0; i < 3; i++) {
+          channels[g][i] =
+              _mm256_or_si256(_mm256_shuffle_epi8(lo, shuffle_lo[i]),
+                              _mm256_shuffle_epi8(hi, shuffle_hi[i]));
+        }
+        luma[g] = Dot3Avx2<kLumaShift>(channels[g][0], channels[g][1],
+                                       channels[g][2], y_rg, y_b, y_bias);
+      }
+      _mm256_storeu_si256(
+          reinterpret_cast<__m256i*>(row.y[r] + x),
+          _mm256_permute4x64_epi64(_mm256_packus_epi16(luma[0], luma[1]),
+                                   0xD8));
+      for (int i = 0; i < 3; i++) {
+        sum[i] = _mm256_add_epi16(
+            sum[i], _mm256_hadd_epi16(channels[0][i], channels[1][i]));
+      }
+    }
+    __m256i u = Dot3Avx2<kChromaShift>(sum[0], sum[1], sum[2], u_rg, u_b,
+                                       c_bias);
+    __m256i v = Dot3Avx2<kChromaShift>(sum[0], sum[1], sum[2], v_rg, v_b,
+                                       c_bias);
+    __m256i uv = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(u, v),
+                                             chroma_order);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(row.u + x / 2),
+                     _mm256_castsi256_si128(uv));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(row.v + x / 2),
+                     _mm256_extracti128_si256(uv, 1));
+  }
+  ConvertPixels(row, c, x);
+}
+
+bool DetectSsse3() {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] & (1 << 9)) != 0;
+#else
+  return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+bool DetectAvx2() {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return false;
+  }
+  __cpuid(info, 1);
+  // The OS has to save the AVX registers too.
+  bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+  __cpuidex(info, 7, 0);
+  return os_saves_ymm && (info[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+using RowPairFunction = void (*)(const RowPair&, const Coefficients&);
+
+RowPairFunction GetConvertRowPair() {
+  static const RowPairFunction convert = [] {
+#if defined(RGB_TO_YUV_X86)
+    if (DetectAvx2()) {
+      return ConvertRowPairAvx2;
+    }
+    if (DetectSsse3()) {
+      return ConvertRowPairSsse3;
+    }
+#endif
+    return ConvertRowPairScalar;
+  }();
+  return convert;
+}
+
+}  // namespace
+
+void RgbToYuv420p(const uint8_t* rgb,
+                  int rgb_stride,
+                  int width,
+                  int height,
+                  uint8_t* const yuv[3],
+                  const int yuv_stride[3],
+                  YuvMatrix matrix,
+                  YuvRange range,
+                  base::ThreadPool* pool) {
+  if (width <= 0 || height <= 0) {
+    return;
+  }
+  Coefficients c = MakeCoefficients(matrix, range);
+  RowPairFunction convert = GetConvertRowPair();
+  auto convert_rows = [&](size_t begin, size_t end) {
+    for (size_t pair = begin; pair < end; pair++) {
+      int top = static_cast<int>(pair * 2);
+      int bottom = std::min(top + 1, height - 1);
+      RowPair row;
+      row.rgb[0] = rgb + static_cast<ptrdiff_t>(top) * rgb_stride;
+      row.rgb[1] = rgb + static_cast<ptrdiff_t>(bottom) * rgb_stride;
+      row.y[0] = yuv[0] + static_cast<ptrdiff_t>(top) * yuv_stride[0];
+      row.y[1] = yuv[0] + static_cast<ptrdiff_t>(bottom) * yuv_stride[0];
+      row.u = yuv[1] + static_cast<ptrdiff_t>(pair) * yuv_stride[1];
+      row.v = yuv[2] + static_cast<ptrdiff_t>(pair) * yuv_stride[2];
+      row.width = width;
+      convert(row, c);
+    }
+  };
+
+  size_t pairs = static_cast<size_t>((height + 1) / 2);
+  if (!pool || pool->NumThreads() < 2 ||
+      static_cast<int64_t>(width) * height < kParallelPixels) {
+    convert_rows(0, pairs);
+    return;
+  }
+  size_t band_pairs = std::max<size_t>(1, kBandPixels / (2 * width));
+  pool->ParallelFor(0, pairs, band_pairs, convert_rows);
+}
+
+bool RgbToYuvIsAccelerated() {
+  return GetConvertRowPair() != ConvertRowPairScalar;
+}
+
+}  // namespace av
\ No newline at end of file
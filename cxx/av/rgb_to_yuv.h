@@ -0,0 +1,47 @@
+#ifndef CXX_AV_RGB_TO_YUV_H
+#define CXX_AV_RGB_TO_YUV_H
+
+#include <cstdint>
+
+namespace base {
+class ThreadPool;
+}  // namespace base
+
+namespace av {
+
+enum class YuvMatrix {
+  // SD video, and what swscale and most decoders assume when a stream
+  // doesn't say.
+  kBt601,
+  // HD video.
+  kBt709,
+};
+
+enum class YuvRange {
+  // Y in [16, 235] and chroma in [16, 240].
+  kLimited,
+  // Y and chroma use all of [0, 255], as in JPEG.
+  kFull,
+};
+
+// Converts packed RGB24 to planar YUV 4:2:0 without scaling. Each chroma
+// sample is taken from the average of its 2x2 block of pixels, odd widths and
+// heights repeat the last column or row. Uses AVX2 or SSSE3 when the CPU has
+// them. Frames of 1080p and up are split into bands of rows across |pool| when
+// one is given.
+void RgbToYuv420p(const uint8_t* rgb,
+                  int rgb_stride,
+                  int width,
+                  int height,
+                  uint8_t* const yuv[3],
+                  const int yuv_stride[3],
+                  YuvMatrix matrix,
+                  YuvRange range,
+                  base::ThreadPool* pool = nullptr);
+
+// True if RgbToYuv420p runs on vector instructions.
+bool RgbToYuvIsAccelerated();
+
+}  // namespace av
+
+#endif  // CXX_AV_RGB_TO_YUV_H
\ No newline at end of file
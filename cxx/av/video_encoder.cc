@@ -10,16 +10,71 @@
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
 #include <libswscale/swscale.h>
 }
 
 #define RNDTO2(X) ( ( (X) & 0xFFFFFFFE )
 #define RNDTO32(X) (((X) % 32) ? (((X) + 32) & 0xFFFFFFE0) : (X))
 
+// Row alignment of pooled frames, enough for the widest SIMD loads in swscale
+// and the encoders.
+static const int kFrameAlign = 64;
+
+#if LIBAVUTIL_VERSION_MAJOR >= 57
+using PoolBufferSize = size_t;
+#else
+using PoolBufferSize = int;
+#endif
+
+static AVBufferRef* AllocFrameBuffer(void* opaque, PoolBufferSize size) {
+  int64_t* allocations = reinterpret_cast<int64_t*>(opaque);
+  (*allocations)++;
+  return av_buffer_alloc(size);
+}
+
+// Prefers the named encoder and falls back to any for the codec id.
+static AVCodec* FindEncoder(av::VideoCodec codec) {
+  const char* name = nullptr;
+  AVCodecID id = AV_CODEC_ID_H264;
+  switch (codec) {
+    case av::VideoCodec::kH264:
+      name = "libx264";
+      id = AV_CODEC_ID_H264;
+      break;
+    case av::VideoCodec::kH265:
+      name = "libx265";
+      id = AV_CODEC_ID_HEVC;
+      break;
+    case av::VideoCodec::kFfv1:
+      name = "ffv1";
+      id = AV_CODEC_ID_FFV1;
+      break;
+    case av::VideoCodec::kMpeg4:
+      name = "mpeg4";
+      id = AV_CODEC_ID_MPEG4;
+      break;
+  }
+  AVCodec* encoder = avcodec_find_encoder_by_name(name);
+  return encoder ? encoder : avcodec_find_encoder(id);
+}
+
+static bool SupportsPixelFormat(const AVCodec* codec, AVPixelFormat format) {
+  if (!codec->pix_fmts) {
+    return false;
+  }
+  for (const AVPixelFormat* f = codec->pix_fmts; *f != AV_PIX_FMT_NONE; f++) {
+    if (*f == format) {
+      return true;
+    }
+  }
+  return false;
+}
+
 static int WriteCallback(void* opaque, uint8_t* buf, int buf_size) {
   base::storage::Writer* writer =
       reinterpret_cast<base::storage::Writer*>(opaque);
-  writer->Write((uint8_t*)buf, buf_size);
+  writer->Write(buf, buf_size);
   return buf_size;
 }
 
@@ -38,17 +93,26 @@ VideoEncoder::VideoEncoder(std::unique_ptr<base::storage::Writer> writer,
                            int fps,
                            int width,
                            int height,
-                           int bitrate)
+                           int bitrate,
+                           const VideoEncoderOptions& options)
     : writer_(std::move(writer)),
       fps_(fps),
       width_(width),
       height_(height),
       bitrate_(bitrate),
+      options_(options),
       pts_(0),
       initialized_(false),
       stopped_(false) {}
 
 VideoEncoder::~VideoEncoder() {
+  if (frame_) {
+    av_frame_free(&frame_);
+  }
+  if (frame_pool_) {
+    // Buffers still referenced by the codec context are freed along with it.
+    av_buffer_pool_uninit(&frame_pool_);
+  }
   if (pkt_to_write_) {
     av_packet_free(&pkt_to_write_);
   }
@@ -65,7 +129,7 @@ VideoEncoder::~VideoEncoder() {
 
 bool VideoEncoder::Init() {
   // Initialize codec
-  codec_ = avcodec_find_encoder(AVCodecID::AV_CODEC_ID_H264);
+  codec_ = FindEncoder(options_.codec);
   if (!codec_) {
     LOG(ERROR) << "VideoEncoder::" << __FUNCTION__ << "\t"
                << "avcodec_find_encoder failed to allocate codec";
@@ -78,22 +142,74 @@ bool VideoEncoder::Init() {
     return false;
   }
 
-  av_ctx_->bit_rate = bitrate_;
+  // Only libx264 and libx265 know crf, and they only use it without a
+  // bitrate. Other codecs keep to the bitrate.
+  bool constant_quality =
+      options_.crf >= 0 && (options_.codec == VideoCodec::kH264 ||
+                            options_.codec == VideoCodec::kH265);
+  av_ctx_->bit_rate = constant_quality ? 0 : bitrate_;
   av_ctx_->width = width_;
   av_ctx_->height = height_;
   av_ctx_->time_base = {1, fps_};
   av_ctx_->framerate = {fps_, 1};
-  av_ctx_->gop_size = 10;
-  av_ctx_->max_b_frames = 1;
-  av_ctx_->pix_fmt = AV_PIX_FMT_YUV420P;
+  av_ctx_->gop_size = options_.gop_size;
+  av_ctx_->max_b_frames = options_.max_b_frames;
+  av_ctx_->thread_count = options_.thread_count;
+  if (options_.threading == CodecThreading::kFrame) {
+    av_ctx_->thread_type = FF_THREAD_FRAME;
+  } else if (options_.threading == CodecThreading::kSlice) {
+    av_ctx_->thread_type = FF_THREAD_SLICE;
+  }
+  if (codec_->id == AV_CODEC_ID_FFV1) {
+    // Version 3 codes slices independently, so that they can be threaded.
+    av_ctx_->level = 3;
+  }
+  if (options_.input_format == InputFormat::kGray16) {
+    av_ctx_->pix_fmt = AV_PIX_FMT_GRAY16;
+    if (!SupportsPixelFormat(codec_, av_ctx_->pix_fmt)) {
+      LOG(ERROR) << "VideoEncoder::" << __FUNCTION__ << "\t" << codec_->name
+                 << " can't encode 16 bit greyscale";
+      return false;
+    }
+  } else {
+    av_ctx_->pix_fmt = AV_PIX_FMT_YUV420P;
+    av_ctx_->colorspace = options_.yuv_matrix == YuvMatrix::kBt709
+                              ? AVCOL_SPC_BT709
+                              : AVCOL_SPC_SMPTE170M;
+    av_ctx_->color_range = options_.yuv_range == YuvRange::kFull
+                               ? AVCOL_RANGE_JPEG
+                               : AVCOL_RANGE_MPEG;
+  }
 
-  int ret = avcodec_open2(av_ctx_, codec_, NULL);
+  AVDictionary* codec_options = NULL;
+  if (!options_.preset.empty()) {
+    av_dict_set(&codec_options, "preset", options_.preset.c_str(), 0);
+  }
+  if (!options_.tune.empty()) {
+    av_dict_set(&codec_options, "tune", options_.tune.c_str(), 0);
+  }
+  if (options_.crf >= 0) {
+    av_dict_set_int(&codec_options, "crf", options_.crf, 0);
+  }
+  int ret = avcodec_open2(av_ctx_, codec_, &codec_options);
+  // The codec takes out the options it used.
+  AVDictionaryEntry* unused = NULL;
+  while ((unused = av_dict_get(codec_options, "", unused,
+                               AV_DICT_IGNORE_SUFFIX))) {
+    LOG(WARNING) << "VideoEncoder::" << __FUNCTION__ << "\t" << codec_->name
+                 << " ignored option " << unused->key;
+  }
+  av_dict_free(&codec_options);
   if (ret < 0) {
     LOG(ERROR) << "VideoEncoder::" << __FUNCTION__ << "\t"
                << "avcodec_open2 returned " << ret;
     return false;
   }
 
+  if (!InitFramePool()) {
+    return false;
+  }
+
   // Initialize output context
   const size_t buffer_size = 500 * 1024;
   uint8_t* ctx_buffer = (uint8_t*)(av_malloc(buffer_size));
@@ -146,14 +262,23 @@ bool VideoEncoder::Init() {
     return false;
   }
 
-  // Create the frame transform context to create YUV frames from RGB
-  rgb_to_yuv_ctx_ = sws_getContext(
-      width_, height_, AV_PIX_FMT_RGB24, width_, height_, AV_PIX_FMT_YUV420P,
-      SWS_LANCZOS | SWS_ACCURATE_RND, NULL, NULL, NULL);
-  if (!rgb_to_yuv_ctx_) {
-    LOG(ERROR) << "VideoEncoder::" << __FUNCTION__ << "\t"
-               << "sws_getContext failed to create conversion context.";
-    return false;
+  if (options_.input_format == InputFormat::kRgb24 &&
+      options_.color_converter == ColorConverter::kSwscale) {
+    // Create the frame transform context to create YUV frames from RGB
+    rgb_to_yuv_ctx_ = sws_getContext(
+        width_, height_, AV_PIX_FMT_RGB24, width_, height_, AV_PIX_FMT_YUV420P,
+        SWS_LANCZOS | SWS_ACCURATE_RND, NULL, NULL, NULL);
+    if (!rgb_to_yuv_ctx_) {
+      LOG(ERROR) << "VideoEncoder::" << __FUNCTION__ << "\t"
+                 << "sws_getContext failed to create conversion context.";
+      return false;
+    }
+    const int* table = sws_getCoefficients(
+        options_.yuv_matrix == YuvMatrix::kBt709 ? SWS_CS_ITU709
+                                                 : SWS_CS_ITU601);
+    sws_setColorspaceDetails(rgb_to_yuv_ctx_, table, 1, table,
+                             options_.yuv_range == YuvRange::kFull ? 1 : 0, 0,
+                             1 << 16, 1 << 16);
   }
 
   pkt_to_write_ = av_packet_alloc();
@@ -181,6 +306,8 @@ bool VideoEncoder::AddFrame(const std::vector<uint8_t>& frame_data) {
     return false;
   }
 
+  // Drops this encoder's reference to the previous frame's buffer. It goes
+  // back to the pool once the codec has finished with it too.
   av_frame_unref(frame_);
 
   int ret = 0;
@@ -190,27 +317,47 @@ bool VideoEncoder::AddFrame(const std::vector<uint8_t>& frame_data) {
   frame_->pts = pts_;
   pts_ += av_rescale_q(1, av_ctx_->time_base, out_stream_->time_base);
 
-  ret = av_frame_get_buffer(frame_, 0);
-  if (ret < 0) {
+  // A pooled buffer is only ever referenced by one frame at a time, so it is
+  // writable without a copy.
+  frame_->buf[0] = av_buffer_pool_get(frame_pool_);
+  if (!frame_->buf[0]) {
     LOG(ERROR) << "VideoEncoder::" << __FUNCTION__ << "\t"
-               << "av_frame_get_buffer returned " << ret;
+               << "av_buffer_pool_get failed to get a frame buffer";
     return false;
   }
-  ret = av_frame_make_writable(frame_);
+  ret = av_image_fill_arrays(frame_->data, frame_->linesize,
+                             frame_->buf[0]->data, av_ctx_->pix_fmt, width_,
+                             height_, kFrameAlign);
   if (ret < 0) {
     LOG(ERROR) << "VideoEncoder::" << __FUNCTION__ << "\t"
-               << "av_frame_make_writable returned " << ret;
+               << "av_image_fill_arrays returned " << ret;
     return false;
   }
-  int src_stride[] = {width_ * 3};
-  const uint8_t* src_planes[] = {frame_data.data()};
-  ret = sws_scale(rgb_to_yuv_ctx_, (const uint8_t* const*)src_planes,
-                  src_stride, 0, height_, frame_->data, frame_->linesize);
-  if (ret < 0) {
+  bool gray16 = options_.input_format == InputFormat::kGray16;
+  int row_size = width_ * (gray16 ? 2 : 3);
+  if (frame_data.size() < static_cast<size_t>(row_size) * height_) {
     LOG(ERROR) << "VideoEncoder::" << __FUNCTION__ << "\t"
-               << "sws_scale returned " << ret;
+               << "Frame of " << frame_data.size() << " bytes is too small";
     return false;
   }
+  if (gray16) {
+    av_image_copy_plane(frame_->data[0], frame_->linesize[0],
+                        frame_data.data(), row_size, row_size, height_);
+  } else if (rgb_to_yuv_ctx_) {
+    int src_stride[] = {row_size};
+    const uint8_t* src_planes[] = {frame_data.data()};
+    ret = sws_scale(rgb_to_yuv_ctx_, (const uint8_t* const*)src_planes,
+                    src_stride, 0, height_, frame_->data, frame_->linesize);
+    if (ret < 0) {
+      LOG(ERROR) << "VideoEncoder::" << __FUNCTION__ << "\t"
+                 << "sws_scale returned " << ret;
+      return false;
+    }
+  } else {
+    RgbToYuv420p(frame_data.data(), row_size, width_, height_, frame_->data,
+                 frame_->linesize, options_.yuv_matrix, options_.yuv_range,
+                 options_.conversion_pool);
+  }
   ret = avcodec_send_frame(av_ctx_, frame_);
   if (ret == AVERROR(EAGAIN)) {
     if (!DrainPackets()) {
@@ -230,11 +377,61 @@ bool VideoEncoder::AddFrame(const std::vector<uint8_t>& frame_data) {
 
 void VideoEncoder::Stop() {
   stopped_ = true;
-  avcodec_send_frame(av_ctx_, NULL);
-  DrainPackets();
+  if (initialized_) {
+    avcodec_send_frame(av_ctx_, NULL);
+    DrainPackets();
+    // Writes out the muxer's last partly filled packet and the AVIO buffer,
+    // without which the last frames never reach the writer.
+    int ret = av_write_trailer(output_ctx_);
+    if (ret < 0) {
+      LOG(ERROR) << "VideoEncoder::" << __FUNCTION__ << "\t"
+                 << "av_write_trailer returned " << ret;
+    }
+  }
   writer_->Close();
 }
 
+bool VideoEncoder::InitFramePool() {
+  int buffer_size = av_image_get_buffer_size(av_ctx_->pix_fmt, width_, height_,
+                                             kFrameAlign);
+  if (buffer_size < 0) {
+    LOG(ERROR) << "VideoEncoder::" << __FUNCTION__ << "\t"
+               << "av_image_get_buffer_size returned " << buffer_size;
+    return false;
+  }
+  frame_pool_ = av_buffer_pool_init2(buffer_size + AV_INPUT_BUFFER_PADDING_SIZE,
+                                     &frame_buffer_allocations_,
+                                     &AllocFrameBuffer, NULL);
+  if (!frame_pool_) {
+    LOG(ERROR) << "VideoEncoder::" << __FUNCTION__ << "\t"
+               << "av_buffer_pool_init2 failed to allocate pool";
+    return false;
+  }
+
+  // Fill the pool up front with one buffer for the frame being converted, one
+  // queued inside libavcodec, and one for each frame the encoder holds back
+  // for reordering or lookahead. The pool still grows if the encoder keeps
+  // more than that.
+  int frame_count = 2 + av_ctx_->max_b_frames + av_ctx_->delay;
+  std::vector<AVBufferRef*> buffers;
+  for (int i = 0; i < frame_count; i++) {
+    AVBufferRef* buffer = av_buffer_pool_get(frame_pool_);
+    if (!buffer) {
+      break;
+    }
+    buffers.push_back(buffer);
+  }
+  for (AVBufferRef*& buffer : buffers) {
+    av_buffer_unref(&buffer);
+  }
+  if (buffers.size() < static_cast<size_t>(frame_count)) {
+    LOG(ERROR) << "VideoEncoder::" << __FUNCTION__ << "\t"
+               << "av_buffer_pool_get failed to allocate frame buffers";
+    return false;
+  }
+  return true;
+}
+
 bool VideoEncoder::DrainPackets() {
   if (!initialized_) {
     return true;
@@ -252,6 +449,14 @@ bool VideoEncoder::DrainPackets() {
                  << "avcodec_receive_packet returned " << ret;
       return false;
     }
+    if (pkt_to_write_->flags & AV_PKT_FLAG_KEY) {
+      // Push out everything before the keyframe, from the muxer's own
+      // packet buffer and then the I/O buffer, so that the sync point lands
+      // right before the keyframe's packet.
+      av_write_frame(output_ctx_, nullptr);
+      avio_flush(output_ctx_->pb);
+      writer_->MarkSyncPoint();
+    }
     ret = av_interleaved_write_frame(output_ctx_, pkt_to_write_);
     if (ret < 0) {
       LOG(ERROR) << "VideoEncoder::" << __FUNCTION__ << "\t"
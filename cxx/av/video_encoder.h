@@ -1,11 +1,15 @@
 #ifndef CXX_AV_VIDEO_ENCODER_H
 #define CXX_AV_VIDEO_ENCODER_H
 
+#include <cstdint>
 #include <memory>
+#include <string>
 #include <vector>
 
+#include "av/rgb_to_yuv.h"
 #include "base/storage/writer.h"
 
+struct AVBufferPool;
 struct AVCodec;
 struct AVCodecContext;
 struct AVFormatContext;
@@ -19,24 +23,102 @@ namespace av {
 
 void enable_av_logging();
 
+enum class VideoCodec {
+  // libx264 where FFmpeg was built with it.
+  kH264,
+  // libx265 where FFmpeg was built with it.
+  kH265,
+  // Lossless and intra only, so large but exact.
+  kFfv1,
+  // MPEG-4 part 2, cheap to encode and always built in.
+  kMpeg4,
+};
+
+enum class CodecThreading {
+  // Whatever the codec prefers.
+  kDefault,
+  // Each thread encodes a different frame. Best throughput, but every thread
+  // adds a frame of latency.
+  kFrame,
+  // Threads share the slices of each frame. No added latency, slightly
+  // larger output.
+  kSlice,
+};
+
+enum class InputFormat {
+  // Packed 8 bit RGB, converted to YUV 4:2:0 for the codec.
+  kRgb24,
+  // 16 bit greyscale in native byte order, such as depth in millimetres.
+  // Passed to the codec as is, so with FFV1 every value survives exactly.
+  // Fails to initialize with codecs that can't take it, which includes
+  // libx264 and libx265 since neither goes beyond 12 bits.
+  kGray16,
+};
+
+enum class ColorConverter {
+  // RgbToYuv420p.
+  kBuiltIn,
+  // swscale with a Lanczos filter, slower but useful as a reference.
+  kSwscale,
+};
+
+struct VideoEncoderOptions {
+  VideoCodec codec = VideoCodec::kH264;
+  // Speed against quality for libx264 and libx265, e.g. "ultrafast" for live
+  // streams or "slow" for offline ones, and an optional tuning such as
+  // "zerolatency". Empty leaves the codec's default.
+  std::string preset;
+  std::string tune;
+  // Constant quality for libx264 and libx265, 0 to 51 with lower being
+  // better. Negative, or any other codec, encodes to the bitrate instead.
+  int crf = -1;
+  // Frames from one keyframe to the next. Keyframes are where the writer is
+  // given sync points.
+  int gop_size = 10;
+  int max_b_frames = 1;
+  // Encoder threads, 0 lets the codec choose.
+  int thread_count = 0;
+  CodecThreading threading = CodecThreading::kDefault;
+  // What AddFrame is given.
+  InputFormat input_format = InputFormat::kRgb24;
+  // How RGB frames are converted to the encoder's YUV 4:2:0. The matrix and
+  // range are also written to the stream so that players decode to the same
+  // colours.
+  ColorConverter color_converter = ColorConverter::kBuiltIn;
+  YuvMatrix yuv_matrix = YuvMatrix::kBt601;
+  YuvRange yuv_range = YuvRange::kLimited;
+  // Pool the built in converter splits frames of 1080p and up across. Null
+  // converts on the calling thread.
+  base::ThreadPool* conversion_pool = nullptr;
+};
+
 class VideoEncoder {
  public:
   VideoEncoder(std::unique_ptr<base::storage::Writer> writer,
                int fps,
                int width,
                int height,
-               int bitrate);
+               int bitrate,
+               const VideoEncoderOptions& options = {});
   ~VideoEncoder();
   VideoEncoder(const VideoEncoder&) = delete;
   VideoEncoder& operator=(const VideoEncoder&) = delete;
 
   bool Init();
 
+  // Adds one frame in the input format, rows packed without padding.
   bool AddFrame(const std::vector<uint8_t>& frame_data);
 
   void Stop();
 
+  // Number of frame buffers allocated so far. Frames are recycled through a
+  // pool, so this stops growing once the pool covers every frame the encoder
+  // holds on to.
+  int64_t FrameBufferAllocations() const { return frame_buffer_allocations_; }
+
  private:
+  bool InitFramePool();
+
   bool DrainPackets();
 
   std::unique_ptr<base::storage::Writer> writer_;
@@ -44,18 +126,21 @@ class VideoEncoder {
   int width_;
   int height_;
   int bitrate_;
+  VideoEncoderOptions options_;
   int64_t pts_;
   bool initialized_;
   bool stopped_;
 
-  AVIOContext* avio_output_ctx_;
-  AVFormatContext* output_ctx_;
-  AVCodec* codec_;
-  AVCodecContext* av_ctx_;
-  AVStream* out_stream_;
-  SwsContext* rgb_to_yuv_ctx_;
-  AVPacket* pkt_to_write_;
-  AVFrame* frame_;
+  AVIOContext* avio_output_ctx_ = nullptr;
+  AVFormatContext* output_ctx_ = nullptr;
+  AVCodec* codec_ = nullptr;
+  AVCodecContext* av_ctx_ = nullptr;
+  AVStream* out_stream_ = nullptr;
+  SwsContext* rgb_to_yuv_ctx_ = nullptr;
+  AVPacket* pkt_to_write_ = nullptr;
+  AVFrame* frame_ = nullptr;
+  AVBufferPool* frame_pool_ = nullptr;
+  int64_t frame_buffer_allocations_ = 0;
 };
 
 }  // namespace av
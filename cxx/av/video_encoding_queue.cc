@@ -8,12 +8,14 @@ VideoEncodingQueue::VideoEncodingQueue(
     int fps,
     int width,
     int height,
-    int bitrate)
+    int bitrate,
+    const VideoEncoderOptions& options)
     : encoder_(std::make_unique<VideoEncoder>(std::move(writer),
                                               fps,
                                               width,
                                               height,
-                                              bitrate)) {}
+                                              bitrate,
+                                              options)) {}
 
 VideoEncodingQueue::~VideoEncodingQueue() {}
 
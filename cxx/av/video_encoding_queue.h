@@ -3,13 +3,12 @@
 
 #include <memory>
 
+#include "av/video_encoder.h"
 #include "base/async_processing_queue.h"
 #include "base/storage/writer.h"
 
 namespace av {
 
-class VideoEncoder;
-
 class VideoEncodingQueue
     : public base::AsyncProcessingQueueBase<std::vector<uint8_t>> {
  public:
@@ -17,7 +16,8 @@ class VideoEncodingQueue
                      int fps,
                      int width,
                      int height,
-                     int bitrate);
+                     int bitrate,
+                     const VideoEncoderOptions& options = {});
   ~VideoEncodingQueue() override;
   VideoEncodingQueue(const VideoEncodingQueue&) = delete;
   VideoEncodingQueue& operator=(const VideoEncodingQueue&) = delete;
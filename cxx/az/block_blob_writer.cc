@@ -0,0 +1,201 @@
+#include "block_blob_writer.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <azure/core.hpp>
+#include <azure/storage/blobs.hpp>
+#include <string>
+
+using namespace Azure::Storage::Blobs;
+using namespace Azure::Core::IO;
+
+namespace az {
+
+namespace {
+
+// Every block id in a blob must have the same length, so the index is
+// encoded at a fixed width.
+std::string BlockId(size_t index) {
+  uint64_t value = index;
+  std::vector<uint8_t> bytes(8);
+  for (size_t i = 0; i < bytes.size(); i++) {
+    bytes[i] = static_cast<uint8_t>(value >> (56 - 8 * i));
+  }
+  return Azure::Core::Convert::Base64Encode(bytes);
+}
+
+}  // namespace
+
+BlockBlobWriter::BlockBlobWriter(const std::string& connection_string,
+                                 const std::string& container,
+                                 const std::string& blob_name,
+                                 const BlockBlobWriterOptions& options)
+    : client_(std::make_unique<BlockBlobClient>(
+          BlockBlobClient::CreateFromConnectionString(connection_string,
+                                                      container, blob_name))),
+      blob_name_(blob_name),
+      options_(options),
+      retry_options_(
+          {options.max_attempts, options.initial_backoff, options.max_backoff}),
+      last_commit_(std::chrono::steady_clock::now()),
+      pool_(std::max<size_t>(options.max_blocks_in_flight, 1),
+            options.upload_thread_options),
+      tasks_(&pool_) {
+  options_.block_size = std::max<size_t>(options_.block_size, 1);
+  // One more than can be in flight, so that the next block can fill while
+  // the others upload.
+  for (size_t i = 0; i <= pool_.NumThreads(); i++) {
+    free_buffers_.push_back(std::make_unique<std::vector<uint8_t>>());
+    free_buffers_.back()->reserve(options_.block_size);
+  }
+}
+
+BlockBlobWriter::~BlockBlobWriter() {
+  Close();
+}
+
+void BlockBlobWriter::Write(const uint8_t* data, size_t size) {
+  if (closed_) {
+    return;
+  }
+  while (size > 0) {
+    if (!active_) {
+      std::unique_lock<std::mutex> lock(m_);
+      cv_.wait(lock, [this] { return !free_buffers_.empty(); });
+      active_ = std::move(free_buffers_.back());
+      free_buffers_.pop_back();
+    }
+    size_t n = std::min(size, options_.block_size - active_->size());
+    active_->insert(active_->end(), data, data + n);
+    data += n;
+    size -= n;
+    if (active_->size() == options_.block_size) {
+      SubmitActive();
+    }
+  }
+}
+
+void BlockBlobWriter::Flush() {
+  if (active_ && !active_->empty()) {
+    SubmitActive();
+  }
+}
+
+void BlockBlobWriter::Close() {
+  if (closed_) {
+    return;
+  }
+  Flush();
+  closed_ = true;
+  tasks_.Wait();
+  std::unique_lock<std::mutex> lock(m_);
+  Commit(lock);
+}
+
+std::optional<uint64_t> BlockBlobWriter::CommittedBytes() const {
+  std::unique_lock<std::mutex> lock(m_);
+  return committed_bytes_;
+}
+
+bool BlockBlobWriter::Failed() const {
+  std::unique_lock<std::mutex> lock(m_);
+  return failed_;
+}
+
+void BlockBlobWriter::SubmitActive() {
+  size_t index;
+  {
+    std::unique_lock<std::mutex> lock(m_);
+    cv_.wait(lock, [this] { return !commit_due_ && !committing_; });
+    index = blocks_.size();
+    blocks_.push_back({BlockId(index), active_->size()});
+    in_flight_++;
+  }
+  // std::function needs a copyable callable, so the buffer travels as a raw
+  // pointer and is owned again inside the task.
+  std::vector<uint8_t>* buffer = active_.release();
+  tasks_.Run([this, index, buffer] {
+    StageBlock(index, std::unique_ptr<std::vector<uint8_t>>(buffer));
+  });
+}
+
+void BlockBlobWriter::StageBlock(size_t index,
+                                 std::unique_ptr<std::vector<uint8_t>> buffer) {
+  std::string id;
+  {
+    std::unique_lock<std::mutex> lock(m_);
+    id = blocks_[index].id;
+  }
+  bool staged = WithRetries(
+      retry_options_,
+      "stage block " + std::to_string(index) + " of " + blob_name_, [&] {
+        MaybeInjectFault(options_.fault_rate / 2);
+        MemoryBodyStream body(buffer->data(), buffer->size());
+        client_->StageBlock(id, body);
+        MaybeInjectFault(options_.fault_rate / 2);
+        return true;
+      });
+  buffer->clear();
+  std::unique_lock<std::mutex> lock(m_);
+  blocks_[index].staged = staged;
+  failed_ = failed_ || !staged;
+  free_buffers_.push_back(std::move(buffer));
+  in_flight_--;
+  while (staged_prefix_ < blocks_.size() && blocks_[staged_prefix_].staged) {
+    staged_prefix_++;
+  }
+  if (options_.commit_interval.count() > 0 &&
+      std::chrono::steady_clock::now() - last_commit_ >=
+          options_.commit_interval) {
+    commit_due_ = true;
+  }
+  // The last block in flight commits, since no other could be left out.
+  if (commit_due_ && in_flight_ == 0) {
+    Commit(lock);
+    commit_due_ = false;
+  }
+  cv_.notify_all();
+}
+
+void BlockBlobWriter::Commit(std::unique_lock<std::mutex>& lock) {
+  if (committing_ || staged_prefix_ == committed_) {
+    return;
+  }
+  committing_ = true;
+  // The list names every block in the blob, including the ones committed
+  // before, which are matched by id.
+  std::vector<std::string> ids;
+  ids.reserve(staged_prefix_);
+  for (size_t i = 0; i < staged_prefix_; i++) {
+    ids.push_back(blocks_[i].id);
+  }
+  lock.unlock();
+  bool committed = WithRetries(
+      retry_options_,
+      "commit " + std::to_string(ids.size()) + " blocks of " + blob_name_,
+      [&] {
+        MaybeInjectFault(options_.fault_rate / 2);
+        auto commitResponse = client_->CommitBlockList(ids);
+        if (commitResponse.RawResponse) {
+          LOG(INFO) << "BlockBlobWriter::" << __FUNCTION__ << "\t"
+                    << "Response to committing " << ids.size()
+                    << " blocks of " << blob_name_ << " : "
+                    << static_cast<int>(
+                           commitResponse.RawResponse.get()->GetStatusCode());
+        }
+        MaybeInjectFault(options_.fault_rate / 2);
+        return true;
+      });
+  lock.lock();
+  committing_ = false;
+  last_commit_ = std::chrono::steady_clock::now();
+  if (committed) {
+    for (; committed_ < ids.size(); committed_++) {
+      committed_bytes_ += blocks_[committed_].size;
+    }
+  } else {
+    failed_ = true;
+  }
+}
+
+}  // namespace az
@@ -0,0 +1,121 @@
+#ifndef CXX_AZ_BLOCK_BLOB_WRITER_H_
+#define CXX_AZ_BLOCK_BLOB_WRITER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include "base/storage/writer.h"
+#include "base/thread_options.h"
+#include "base/thread_pool.h"
+#include "retry.h"
+
+namespace Azure::Storage::Blobs {
+class BlockBlobClient;
+}  // namespace Azure::Storage::Blobs
+
+namespace az {
+
+struct BlockBlobWriterOptions {
+  // Bytes per staged block.
+  size_t block_size = 4 * 1024 * 1024;
+  // Blocks uploading at once. Write waits when this many are in flight and
+  // the next block is full.
+  size_t max_blocks_in_flight = 4;
+  // How often the blocks staged so far are committed, so that a crash loses
+  // at most this much of the blob. Zero commits only on Close.
+  std::chrono::seconds commit_interval = std::chrono::seconds(10);
+  base::ThreadOptions upload_thread_options = {"blob_stage"};
+  // Attempts at each request, as for BufferedBlobWriterOptions. Staging a
+  // block again under the same id replaces it, and committing the same list
+  // again changes nothing, so both are safe to retry.
+  int max_attempts = 0;
+  std::chrono::milliseconds initial_backoff = std::chrono::milliseconds(250);
+  std::chrono::milliseconds max_backoff = std::chrono::seconds(30);
+  // Fraction of stage and commit requests made to fail, for testing
+  // recovery. Half fail before the request is sent and half after it
+  // succeeds.
+  double fault_rate = 0;
+};
+
+// Uploads everything written to it as a block blob. Unlike the append blob
+// used by BufferedBlobWriter, blocks are staged concurrently, so throughput
+// isn't limited to one chunk per round trip on high latency links. Staged
+// blocks only become part of the blob when the block list is committed,
+// which happens periodically and on Close. Committing discards any staged
+// block the list leaves out, so a periodic commit waits for the blocks in
+// flight and holds back new ones until it is done.
+class BlockBlobWriter : public base::storage::Writer {
+ public:
+  BlockBlobWriter(const std::string& connection_string,
+                  const std::string& container,
+                  const std::string& blob_name,
+                  const BlockBlobWriterOptions& options = {});
+  ~BlockBlobWriter();
+  BlockBlobWriter(const BlockBlobWriter&) = delete;
+  BlockBlobWriter& operator=(const BlockBlobWriter&) = delete;
+
+  void Write(const uint8_t* data, size_t size) override;
+
+  // Starts staging the partly filled block without waiting for it.
+  void Flush() override;
+
+  // Waits for every block to be staged and commits them.
+  void Close() override;
+
+  // Bytes in blocks that have been committed.
+  std::optional<uint64_t> CommittedBytes() const override;
+
+  // True if staging a block or committing the list failed. Only the blocks
+  // before the first failure are committed.
+  bool Failed() const;
+
+ private:
+  struct Block {
+    std::string id;
+    size_t size = 0;
+    bool staged = false;
+  };
+
+  void SubmitActive();
+
+  // Runs on the pool, then returns the buffer to free_buffers_.
+  void StageBlock(size_t index, std::unique_ptr<std::vector<uint8_t>> buffer);
+
+  // Commits every block up to the first one not staged, if anything new has
+  // been staged. Called with m_ held and nothing in flight, and releases m_
+  // for the request.
+  void Commit(std::unique_lock<std::mutex>& lock);
+
+  std::unique_ptr<Azure::Storage::Blobs::BlockBlobClient> client_;
+  std::string blob_name_;
+  BlockBlobWriterOptions options_;
+  RetryOptions retry_options_;
+  std::vector<std::unique_ptr<std::vector<uint8_t>>> free_buffers_;
+  std::unique_ptr<std::vector<uint8_t>> active_;
+  // Every block submitted, in blob order.
+  std::vector<Block> blocks_;
+  size_t staged_prefix_ = 0;
+  size_t committed_ = 0;
+  uint64_t committed_bytes_ = 0;
+  // Blocks handed to the pool and not yet staged or failed.
+  size_t in_flight_ = 0;
+  // Set once commit_interval has passed, until the commit it calls for is
+  // done.
+  bool commit_due_ = false;
+  bool committing_ = false;
+  std::chrono::steady_clock::time_point last_commit_;
+  bool failed_ = false;
+  bool closed_ = false;
+  mutable std::mutex m_;
+  std::condition_variable cv_;
+  base::ThreadPool pool_;
+  base::TaskGroup tasks_;
+};
+
+}  // namespace az
+
+#endif  // CXX_AZ_BLOCK_BLOB_WRITER_H_
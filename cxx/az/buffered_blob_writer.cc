@@ -1,10 +1,13 @@
 #include "buffered_blob_writer.h"
 
 #include <glog/logging.h>
+#include <algorithm>
 #include <azure/core.hpp>
 #include <azure/storage/blobs.hpp>
+#include <cstring>
+#include <exception>
 #include <iostream>
-#include <iterator>
+#include <stdexcept>
 #include <string>
 
 using namespace Azure::Storage;
@@ -13,55 +16,282 @@ using namespace Azure::Core::IO;
 
 namespace az {
 
+namespace {
+
+// Exponentially weighted, so that one slow request doesn't swing the chunk
+// size on its own.
+double Smooth(double average, double sample) {
+  return average == 0 ? sample : average + 0.25 * (sample - average);
+}
+
+}  // namespace
+
 BufferedBlobWriter::BufferedBlobWriter(const std::string& connection_string,
                                        const std::string& container,
                                        const std::string& blob_name,
-                                       int max_chunk_size_bytes)
+                                       const BufferedBlobWriterOptions& options)
     : connection_string_(connection_string),
       container_(container),
       blob_name_(blob_name),
-      max_chunk_size_bytes_(max_chunk_size_bytes) {}
+      options_(options),
+      retry_options_({options.max_attempts, options.initial_backoff,
+                      options.max_backoff}) {
+  options_.max_chunk_size_bytes =
+      std::max<size_t>(options_.max_chunk_size_bytes, 1);
+  options_.min_chunk_size_bytes =
+      std::clamp<size_t>(options_.min_chunk_size_bytes, 1,
+                         options_.max_chunk_size_bytes);
+  // Adaptive sizing starts small and grows once uploads have been timed.
+  chunk_size_ = options_.adaptive_chunk_size ? options_.min_chunk_size_bytes
+                                             : options_.max_chunk_size_bytes;
+  metrics_.chunk_size_bytes = chunk_size_;
+  ring_.resize(std::max<size_t>(options_.buffer_count, 2));
+  for (auto& chunk : ring_) {
+    chunk.data = std::make_unique_for_overwrite<uint8_t[]>(
+        options_.max_chunk_size_bytes);
+  }
+  upload_thread_ = std::thread([this] {
+    base::ApplyThreadOptions(options_.upload_thread_options);
+    UploadThread();
+  });
+}
 
-BufferedBlobWriter::~BufferedBlobWriter() {}
+BufferedBlobWriter::~BufferedBlobWriter() {
+  Close();
+}
 
-void BufferedBlobWriter::Write(uint8_t* data, size_t size) {
-  std::copy_n(data, size, std::back_inserter(pending_bytes_));
-  if (pending_bytes_.size() > max_chunk_size_bytes_) {
-    SendBytes();
+void BufferedBlobWriter::Write(const uint8_t* data, size_t size) {
+  if (closed_) {
+    return;
+  }
+  while (size > 0) {
+    if (!active_) {
+      std::unique_lock<std::mutex> lock(m_);
+      free_cv_.wait(lock, [this] { return queued_ < ring_.size(); });
+      active_ = &ring_[(upload_index_ + queued_) % ring_.size()];
+      fill_start_ = std::chrono::steady_clock::now();
+    }
+    // The active chunk belongs to this thread until it is submitted, so it
+    // is filled without holding the lock.
+    size_t n = std::min(size, chunk_size_ - active_->size);
+    memcpy(active_->data.get() + active_->size, data, n);
+    active_->size += n;
+    data += n;
+    size -= n;
+    if (active_->size == chunk_size_) {
+      SubmitActive();
+    }
+  }
+}
+
+void BufferedBlobWriter::Flush() {
+  if (active_ && active_->size > 0) {
+    SubmitActive();
   }
 }
 
 void BufferedBlobWriter::Close() {
-  SendBytes();
+  if (closed_) {
+    return;
+  }
+  Flush();
+  {
+    std::unique_lock<std::mutex> lock(m_);
+    closed_ = true;
+  }
+  full_cv_.notify_all();
+  if (upload_thread_.joinable()) {
+    upload_thread_.join();
+  }
+}
+
+std::optional<uint64_t> BufferedBlobWriter::CommittedBytes() const {
+  std::unique_lock<std::mutex> lock(m_);
+  return committed_bytes_;
 }
 
-void BufferedBlobWriter::SendBytes() {
-  if (pending_bytes_.size() > 0) {
-    auto blob_client_ = AppendBlobClient::CreateFromConnectionString(
-        connection_string_, container_, blob_name_);
-    auto blobCreateResponse = blob_client_.CreateIfNotExists();
-    if (blobCreateResponse.RawResponse) {
-      LOG(INFO) << "BufferedBlobWriter::" << __FUNCTION__ << "\t"
-                << "Response to creation check on " << blob_name_ << " : "
-                << static_cast<int>(
-                       blobCreateResponse.RawResponse.get()->GetStatusCode());
-    } else {
-      LOG(INFO) << "BufferedBlobWriter::" << __FUNCTION__ << "\t"
-                << "Missing response from AppendBlobClient::CreateIfNotExists";
+bool BufferedBlobWriter::Failed() const {
+  std::unique_lock<std::mutex> lock(m_);
+  return failed_;
+}
+
+BlobUploadMetrics BufferedBlobWriter::GetMetrics() const {
+  std::unique_lock<std::mutex> lock(m_);
+  return metrics_;
+}
+
+void BufferedBlobWriter::SubmitActive() {
+  std::unique_lock<std::mutex> lock(m_);
+  queued_++;
+  metrics_.backlog_bytes += active_->size;
+  if (options_.adaptive_chunk_size) {
+    AdaptChunkSize();
+  }
+  active_ = nullptr;
+  full_cv_.notify_one();
+}
+
+void BufferedBlobWriter::AdaptChunkSize() {
+  std::chrono::duration<double> fill_time =
+      std::chrono::steady_clock::now() - fill_start_;
+  if (fill_time.count() > 0) {
+    metrics_.input_bytes_per_second = Smooth(
+        metrics_.input_bytes_per_second, active_->size / fill_time.count());
+  }
+  if (metrics_.upload_bytes_per_second == 0) {
+    return;
+  }
+  // Whichever is slower decides. When uploads are the bottleneck this sizes
+  // appends to take the target time, and when input is, it keeps data from
+  // sitting in a chunk for longer than that.
+  double rate = std::min(metrics_.upload_bytes_per_second,
+                         metrics_.input_bytes_per_second);
+  double target = rate * std::chrono::duration<double>(
+                             options_.target_chunk_latency)
+                             .count();
+  // At most doubling or halving at a time, so that the estimate the next
+  // step is based on stays close to the chunk size in use.
+  target = std::clamp(target, chunk_size_ / 2.0, chunk_size_ * 2.0);
+  chunk_size_ = std::clamp(static_cast<size_t>(target),
+                           options_.min_chunk_size_bytes,
+                           options_.max_chunk_size_bytes);
+  metrics_.chunk_size_bytes = chunk_size_;
+}
+
+void BufferedBlobWriter::UploadThread() {
+  while (true) {
+    std::unique_lock<std::mutex> lock(m_);
+    full_cv_.wait(lock, [this] { return queued_ > 0 || closed_; });
+    if (queued_ == 0) {
+      return;
+    }
+    Chunk& chunk = ring_[upload_index_];
+    // Once a chunk is missing, anything after it would leave a gap.
+    bool dropping = failed_;
+    lock.unlock();
+    auto start = std::chrono::steady_clock::now();
+    bool sent = dropping || SendBytes(chunk.data.get(), chunk.size);
+    std::chrono::duration<double> latency =
+        std::chrono::steady_clock::now() - start;
+    lock.lock();
+    failed_ = failed_ || !sent;
+    metrics_.backlog_bytes -= chunk.size;
+    if (sent && !dropping) {
+      committed_bytes_ += chunk.size;
+      metrics_.uploaded_bytes += chunk.size;
+      metrics_.last_append_latency = latency;
+      if (latency.count() > 0) {
+        metrics_.upload_bytes_per_second = Smooth(
+            metrics_.upload_bytes_per_second, chunk.size / latency.count());
+      }
+    }
+    chunk.size = 0;
+    upload_index_ = (upload_index_ + 1) % ring_.size();
+    queued_--;
+    free_cv_.notify_one();
+  }
+}
+
+AppendBlobClient& BufferedBlobWriter::Client() {
+  if (!client_) {
+    client_ = std::make_unique<AppendBlobClient>(
+        AppendBlobClient::CreateFromConnectionString(connection_string_,
+                                                     container_, blob_name_));
+  }
+  return *client_;
+}
+
+bool BufferedBlobWriter::EnsureBlobExists() {
+  auto blobCreateResponse = Client().CreateIfNotExists();
+  if (blobCreateResponse.RawResponse) {
+    LOG(INFO) << "BufferedBlobWriter::" << __FUNCTION__ << "\t"
+              << "Response to creation check on " << blob_name_ << " : "
+              << static_cast<int>(
+                     blobCreateResponse.RawResponse.get()->GetStatusCode());
+  } else {
+    LOG(INFO) << "BufferedBlobWriter::" << __FUNCTION__ << "\t"
+              << "Missing response from AppendBlobClient::CreateIfNotExists";
+  }
+  // Writes go after whatever the blob already holds.
+  if (!blobCreateResponse.Value.Created) {
+    blob_offset_ =
+        static_cast<uint64_t>(Client().GetProperties().Value.BlobSize);
+  }
+  if (options_.resume_offset) {
+    if (blob_offset_ < *options_.resume_offset) {
+      LOG(ERROR) << "BufferedBlobWriter::" << __FUNCTION__ << "\t"
+                 << blob_name_ << " is " << blob_offset_
+                 << " bytes long, too short to resume at "
+                 << *options_.resume_offset;
+      return false;
     }
-    auto appendResponse =
-        blob_client_.AppendBlock(MemoryBodyStream(pending_bytes_));
-    if (appendResponse.RawResponse) {
-      LOG(INFO) << "BufferedBlobWriter::" << __FUNCTION__ << "\t"
-                << "Response to append block on " << blob_name_ << " : "
-                << static_cast<int>(
-                       appendResponse.RawResponse.get()->GetStatusCode());
-    } else {
-      LOG(INFO) << "BufferedBlobWriter::" << __FUNCTION__ << "\t"
-                << "Missing response from AppendBlobClient::AppendBlock";
+    // Appends that landed after the last committed offset was saved.
+    skip_bytes_ = blob_offset_ - *options_.resume_offset;
+  }
+  // Nothing else deletes the blob, so once is enough.
+  blob_exists_ = true;
+  return true;
+}
+
+bool BufferedBlobWriter::SendBytes(const uint8_t* data, size_t size) {
+  if (!blob_exists_ &&
+      !WithRetries(retry_options_, "create " + blob_name_,
+                   [this] { return EnsureBlobExists(); })) {
+    return false;
+  }
+  if (skip_bytes_ > 0) {
+    size_t skipped = static_cast<size_t>(std::min<uint64_t>(skip_bytes_, size));
+    skip_bytes_ -= skipped;
+    data += skipped;
+    size -= skipped;
+    if (size == 0) {
+      return true;
+    }
+  }
+  uint64_t offset = blob_offset_;
+  bool sent = WithRetries(retry_options_, "append to " + blob_name_, [&] {
+    AppendBlockOptions appendOptions;
+    appendOptions.AccessConditions.IfAppendPositionEqual =
+        static_cast<int64_t>(offset);
+    try {
+      MaybeInjectFault(options_.fault_rate / 2);
+      // Sent from the chunk in place, which stays put until the append
+      // returns.
+      MemoryBodyStream body(data, size);
+      auto appendResponse = Client().AppendBlock(body, appendOptions);
+      if (appendResponse.RawResponse) {
+        LOG(INFO) << "BufferedBlobWriter::" << __FUNCTION__ << "\t"
+                  << "Response to append block on " << blob_name_ << " : "
+                  << static_cast<int>(
+                         appendResponse.RawResponse.get()->GetStatusCode());
+      } else {
+        LOG(INFO) << "BufferedBlobWriter::" << __FUNCTION__ << "\t"
+                  << "Missing response from AppendBlobClient::AppendBlock";
+      }
+      MaybeInjectFault(options_.fault_rate / 2);
+      return true;
+    } catch (const Azure::Core::RequestFailedException& e) {
+      if (e.ErrorCode != "AppendPositionConditionNotMet") {
+        throw;
+      }
+      // An earlier attempt may have landed even though its response didn't
+      // make it back.
+      uint64_t blob_size =
+          static_cast<uint64_t>(Client().GetProperties().Value.BlobSize);
+      if (blob_size == offset + size) {
+        return true;
+      }
+      LOG(ERROR) << "BufferedBlobWriter::" << __FUNCTION__ << "\t"
+                 << blob_name_ << " is " << blob_size
+                 << " bytes long, expected " << offset
+                 << ", something else is appending to it";
+      return false;
     }
-    pending_bytes_.clear();
+  });
+  if (sent) {
+    blob_offset_ = offset + size;
   }
+  return sent;
 }
 
 }  // namespace az
\ No newline at end of file
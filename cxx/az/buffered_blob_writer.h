@@ -1,34 +1,164 @@
 #ifndef CXX_AZ_BUFFERED_BLOB_WRITER_H_
 #define CXX_AZ_BUFFERED_BLOB_WRITER_H_
 
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <thread>
 #include <vector>
 #include "base/storage/writer.h"
+#include "base/thread_options.h"
+#include "retry.h"
+
+namespace Azure::Storage::Blobs {
+class AppendBlobClient;
+}  // namespace Azure::Storage::Blobs
 
 namespace az {
 
+struct BufferedBlobWriterOptions {
+  // Bytes gathered before they are appended to the blob. With an adaptive
+  // chunk size, the most it grows to.
+  size_t max_chunk_size_bytes = 1024 * 1024;
+  // Size chunks from the measured upload and input rates, between
+  // min_chunk_size_bytes and max_chunk_size_bytes, so that each takes about
+  // target_chunk_latency to upload and no longer to fill. Fast links get
+  // big chunks that spend little time on per-request overhead, and slow
+  // links or slow input get small ones, which bounds how long data waits
+  // before it is durable.
+  bool adaptive_chunk_size = false;
+  size_t min_chunk_size_bytes = 256 * 1024;
+  std::chrono::milliseconds target_chunk_latency =
+      std::chrono::milliseconds(500);
+  // Chunks in the ring, at least 2. Write only waits on the network when all
+  // of them are waiting to be uploaded.
+  size_t buffer_count = 2;
+  base::ThreadOptions upload_thread_options = {"blob_upload"};
+  // Attempts at each request before the upload gives up, waiting with
+  // exponential backoff and jitter in between. Zero keeps retrying for as
+  // long as the errors are ones that retrying can fix, at most max_backoff
+  // apart, so that an outage of any length only delays the upload.
+  int max_attempts = 0;
+  std::chrono::milliseconds initial_backoff = std::chrono::milliseconds(250);
+  std::chrono::milliseconds max_backoff = std::chrono::seconds(30);
+  // Where in the blob the first byte written goes, when carrying on with an
+  // upload from a known point. Anything the blob already holds past it is
+  // taken to be the same data and skipped, and a blob shorter than it fails
+  // the upload rather than leaving a gap. Unset appends after whatever the
+  // blob holds.
+  std::optional<uint64_t> resume_offset;
+  // Fraction of appends made to fail, for testing recovery. Half fail before
+  // the request is sent and half after it succeeds, as if the response was
+  // lost on the way back.
+  double fault_rate = 0;
+};
+
+struct BlobUploadMetrics {
+  // Size chunks are currently cut at.
+  size_t chunk_size_bytes = 0;
+  // Smoothed rates of appending, retries included, and of data being
+  // written. Zero until measured.
+  double upload_bytes_per_second = 0;
+  double input_bytes_per_second = 0;
+  // In chunks waiting to be appended, not counting the one being filled.
+  uint64_t backlog_bytes = 0;
+  uint64_t uploaded_bytes = 0;
+  std::chrono::duration<double> last_append_latency{0};
+};
+
+// Appends everything written to it to an append blob, a chunk at a time.
+// Writes are copied straight into a ring of preallocated chunks, which the
+// upload thread sends in order from where they are, so that Write only
+// copies once and nothing is allocated while streaming. Failed requests are
+// retried, and appends are conditional on the blob's length so that a retry
+// can't add a chunk twice. If a chunk can't be appended, the rest of the
+// stream is dropped rather than leaving a gap in the blob, and
+// CommittedBytes stops at the end of what made it. An interrupted upload is
+// resumed by putting a SpillingWriter in front, which keeps everything
+// until it is committed, and handing it the same journal and blob again
+// with resume_offset set to where the journal resumes.
 class BufferedBlobWriter : public base::storage::Writer {
  public:
   BufferedBlobWriter(const std::string& connection_string,
                      const std::string& container,
                      const std::string& blob_name,
-                     int max_chunk_size_bytes = 1024 * 1024);
+                     const BufferedBlobWriterOptions& options = {});
   ~BufferedBlobWriter();
   BufferedBlobWriter(const BufferedBlobWriter&) = delete;
   BufferedBlobWriter& operator=(const BufferedBlobWriter&) = delete;
 
-  void Write(uint8_t* data, size_t size) override;
+  void Write(const uint8_t* data, size_t size) override;
+
+  // Starts uploading the partly filled chunk without waiting for it.
+  void Flush() override;
 
+  // Waits for every chunk to be uploaded.
   void Close() override;
 
+  // Bytes written that are in the blob, counting any that were skipped
+  // because the blob already held them.
+  std::optional<uint64_t> CommittedBytes() const override;
+
+  // True if an upload failed for good.
+  bool Failed() const;
+
+  BlobUploadMetrics GetMetrics() const;
+
  private:
-  void SendBytes();
+  struct Chunk {
+    std::unique_ptr<uint8_t[]> data;
+    size_t size = 0;
+  };
+
+  // Hands the active chunk to the upload thread.
+  void SubmitActive();
+
+  // Picks the size of the next chunk. Called with m_ held.
+  void AdaptChunkSize();
+
+  void UploadThread();
+
+  // Returns false if the bytes couldn't be appended.
+  bool SendBytes(const uint8_t* data, size_t size);
+
+  // Created on the first upload and kept, so that its HTTP connection is
+  // reused from one chunk to the next.
+  Azure::Storage::Blobs::AppendBlobClient& Client();
+
+  // Creates the blob, or finds where an existing one ends.
+  bool EnsureBlobExists();
 
   std::string connection_string_;
   std::string container_;
   std::string blob_name_;
-  int max_chunk_size_bytes_;
-  std::vector<uint8_t> pending_bytes_;
+  BufferedBlobWriterOptions options_;
+  RetryOptions retry_options_;
+  // Chunks from upload_index_ on, queued_ of them, are waiting for or in
+  // upload. The one after them is the active chunk being filled.
+  std::vector<Chunk> ring_;
+  size_t upload_index_ = 0;
+  size_t queued_ = 0;
+  Chunk* active_ = nullptr;
+  // Used only by the writing thread.
+  size_t chunk_size_ = 0;
+  std::chrono::steady_clock::time_point fill_start_;
+  BlobUploadMetrics metrics_;
+  uint64_t committed_bytes_ = 0;
+  bool failed_ = false;
+  bool closed_ = false;
+  mutable std::mutex m_;
+  std::condition_variable free_cv_;
+  std::condition_variable full_cv_;
+  std::thread upload_thread_;
+  // Used only by the upload thread.
+  std::unique_ptr<Azure::Storage::Blobs::AppendBlobClient> client_;
+  bool blob_exists_ = false;
+  uint64_t blob_offset_ = 0;
+  // Bytes still to skip because the blob already holds them.
+  uint64_t skip_bytes_ = 0;
 };
 
 }  // namespace az
@@ -0,0 +1,71 @@
+#include "retry.h"
+
+#include <glog/logging.h>
+#include <algorithm>
+#include <azure/core.hpp>
+#include <exception>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+namespace az {
+
+namespace {
+
+// Timeouts, throttling, server errors and failures below HTTP, which come
+// with no status.
+bool IsRetryable(Azure::Core::Http::HttpStatusCode status) {
+  int code = static_cast<int>(status);
+  return code == 0 || code == 408 || code == 429 || code >= 500;
+}
+
+// Per thread, so that writers staging from several threads don't share one.
+std::mt19937& Rng() {
+  thread_local std::mt19937 rng(std::random_device{}());
+  return rng;
+}
+
+}  // namespace
+
+bool WithRetries(const RetryOptions& options,
+                 const std::string& operation,
+                 const std::function<bool()>& attempt) {
+  auto backoff =
+      std::chrono::duration<double, std::milli>(options.initial_backoff);
+  for (int i = 1;; i++) {
+    try {
+      return attempt();
+    } catch (const Azure::Core::RequestFailedException& e) {
+      if (!IsRetryable(e.StatusCode)) {
+        LOG(ERROR) << __FUNCTION__ << "\t"
+                   << "Failed to " << operation << " : " << e.what();
+        return false;
+      }
+      LOG(WARNING) << __FUNCTION__ << "\t"
+                   << "Attempt " << i << " to " << operation
+                   << " failed : " << e.what();
+    } catch (const std::exception& e) {
+      LOG(WARNING) << __FUNCTION__ << "\t"
+                   << "Attempt " << i << " to " << operation
+                   << " failed : " << e.what();
+    }
+    if (options.max_attempts > 0 && i >= options.max_attempts) {
+      LOG(ERROR) << __FUNCTION__ << "\t"
+                 << "Giving up after " << i << " attempts to " << operation;
+      return false;
+    }
+    // Jitter keeps writers that failed together from retrying together.
+    std::uniform_real_distribution<double> jitter(0.5, 1.0);
+    std::this_thread::sleep_for(backoff * jitter(Rng()));
+    backoff = std::min<std::chrono::duration<double, std::milli>>(
+        backoff * 2, options.max_backoff);
+  }
+}
+
+void MaybeInjectFault(double rate) {
+  if (rate > 0 && std::uniform_real_distribution<double>(0, 1)(Rng()) < rate) {
+    throw std::runtime_error("Injected fault");
+  }
+}
+
+}  // namespace az
\ No newline at end of file
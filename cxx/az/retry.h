@@ -0,0 +1,31 @@
+#ifndef CXX_AZ_RETRY_H_
+#define CXX_AZ_RETRY_H_
+
+#include <chrono>
+#include <functional>
+#include <string>
+
+namespace az {
+
+struct RetryOptions {
+  // Attempts before giving up, or zero to keep retrying for as long as the
+  // errors are ones that retrying can fix.
+  int max_attempts = 0;
+  std::chrono::milliseconds initial_backoff = std::chrono::milliseconds(250);
+  std::chrono::milliseconds max_backoff = std::chrono::seconds(30);
+};
+
+// Calls |attempt| until it returns or throws an error that retrying won't
+// fix, waiting with exponential backoff and jitter in between. Returns what
+// the last attempt returned, or false if none of them got that far.
+// |operation| describes the request in the log.
+bool WithRetries(const RetryOptions& options,
+                 const std::string& operation,
+                 const std::function<bool()>& attempt);
+
+// Throws with probability |rate|, for testing recovery from failed requests.
+void MaybeInjectFault(double rate);
+
+}  // namespace az
+
+#endif  // CXX_AZ_RETRY_H_
\ No newline at end of file
@@ -3,11 +3,14 @@
 
 #include <condition_variable>
 #include <functional>
+#include <future>
 #include <list>
 #include <mutex>
 #include <thread>
 #include <vector>
 
+#include "base/thread_options.h"
+
 namespace base {
 
 template <typename T>
@@ -18,12 +21,32 @@ class AsyncProcessingQueueBase {
   AsyncProcessingQueueBase(const AsyncProcessingQueueBase&) = delete;
   AsyncProcessingQueueBase& operator=(const AsyncProcessingQueueBase&) = delete;
 
+  // Takes effect on the next Start.
+  void SetThreadOptions(const ThreadOptions& options) {
+    thread_options_ = options;
+  }
+
+  // Startup and Shutdown run on the processing thread, so that whatever
+  // they set up, such as encoder contexts and the threads those start,
+  // belongs to it and inherits its options. Waits for Startup.
   void Start() {
     if (!running_) {
-      running_ = Startup();
-      if (!running_)
-        return;
-      processing_thread_ = std::thread([this] { ProcessingThread(); });
+      running_ = true;
+      std::promise<bool> started;
+      std::future<bool> result = started.get_future();
+      processing_thread_ = std::thread([this, &started] {
+        ApplyThreadOptions(thread_options_);
+        bool ok = Startup();
+        started.set_value(ok);
+        if (ok) {
+          ProcessingThread();
+          Shutdown();
+        }
+      });
+      if (!result.get()) {
+        processing_thread_.join();
+        running_ = false;
+      }
     }
   }
 
@@ -36,12 +59,14 @@ class AsyncProcessingQueueBase {
   };
 
   void Stop() {
-    running_ = false;
+    {
+      std::unique_lock<decltype(m_)> lock(m_);
+      running_ = false;
+    }
     cv_.notify_one();
     if (processing_thread_.joinable()) {
       processing_thread_.join();
     }
-    Shutdown();
   };
 
  protected:
@@ -53,7 +78,7 @@ class AsyncProcessingQueueBase {
 
   void ProcessingThread() {
     while (running_) {
-      std::list<std::vector<uint8_t>> popped;
+      std::list<T> popped;
       {
         std::unique_lock<decltype(m_)> lock(m_);
         cv_.wait(lock, [this] { return !q_.empty() || !running_; });
@@ -61,7 +86,9 @@ class AsyncProcessingQueueBase {
           popped.splice(popped.begin(), q_, q_.begin());
         }
       }
-      ProcessItem(std::move(popped.front()));
+      if (!popped.empty()) {
+        ProcessItem(std::move(popped.front()));
+      }
     }
   }
 
@@ -70,6 +97,7 @@ class AsyncProcessingQueueBase {
   mutable std::mutex m_;
   std::condition_variable cv_;
   std::thread processing_thread_;
+  ThreadOptions thread_options_;
 };
 
 template <typename T>
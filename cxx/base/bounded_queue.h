@@ -0,0 +1,194 @@
+#ifndef CXX_BASE_BOUNDED_QUEUE_H_
+#define CXX_BASE_BOUNDED_QUEUE_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+
+namespace base {
+
+// What Push does when the queue is at capacity.
+enum class OverflowPolicy {
+  // Wait for a consumer to make room, pushing back on the producer.
+  kBlock,
+  // Evict the oldest queued item to make room.
+  kDropOldest,
+  // Reject the item being pushed.
+  kDropNewest,
+};
+
+// Multi-producer multi-consumer FIFO with a fixed capacity. Alongside the
+// queue itself it tracks items that have been popped but not yet marked done
+// with TaskDone, so WaitIdle can wait for consumers to finish their work rather
+// than just for the queue to empty.
+template <typename T>
+class BoundedQueue {
+ public:
+  BoundedQueue(size_t capacity, OverflowPolicy overflow_policy)
+      : capacity_(capacity > 0 ? capacity : 1),
+        overflow_policy_(overflow_policy) {}
+  ~BoundedQueue() = default;
+  BoundedQueue(const BoundedQueue&) = delete;
+  BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+  // Returns false if the item was not queued, either because the queue is
+  // closed or because it was full with a kDropNewest policy.
+  bool Push(T&& item) {
+    std::function<void(std::optional<T>)> waiter;
+    {
+      std::unique_lock<decltype(m_)> lock(m_);
+      if (overflow_policy_ == OverflowPolicy::kBlock) {
+        not_full_cv_.wait(lock,
+                          [this] { return q_.size() < capacity_ || closed_; });
+      }
+      if (closed_) {
+        return false;
+      }
+      if (!pop_waiters_.empty()) {
+        // Consumers only wait while the queue is empty, so the item goes
+        // straight to the oldest one.
+        waiter = std::move(pop_waiters_.front());
+        pop_waiters_.pop_front();
+      } else if (q_.size() >= capacity_) {
+        dropped_++;
+        if (overflow_policy_ == OverflowPolicy::kDropNewest) {
+          return false;
+        }
+        q_.pop_front();
+        unfinished_--;
+      }
+      if (!waiter) {
+        q_.push_back(std::move(item));
+      }
+      unfinished_++;
+    }
+    if (waiter) {
+      waiter(std::move(item));
+    } else {
+      not_empty_cv_.notify_one();
+    }
+    return true;
+  }
+
+  // Blocks until an item is available. Returns nullopt once the queue is
+  // closed and drained.
+  std::optional<T> Pop() {
+    std::optional<T> item;
+    {
+      std::unique_lock<decltype(m_)> lock(m_);
+      not_empty_cv_.wait(lock, [this] { return !q_.empty() || closed_; });
+      if (q_.empty()) {
+        return std::nullopt;
+      }
+      item.emplace(std::move(q_.front()));
+      q_.pop_front();
+    }
+    not_full_cv_.notify_one();
+    return item;
+  }
+
+  std::optional<T> TryPop() {
+    std::optional<T> item;
+    {
+      std::unique_lock<decltype(m_)> lock(m_);
+      if (q_.empty()) {
+        return std::nullopt;
+      }
+      item.emplace(std::move(q_.front()));
+      q_.pop_front();
+    }
+    not_full_cv_.notify_one();
+    return item;
+  }
+
+  // Pops an item into |item| and returns true if one is available or the queue
+  // is closed. Otherwise returns false and calls |on_ready| once an item is
+  // pushed, or with nullopt if the queue is closed first. |on_ready| is called
+  // on the pushing thread.
+  bool PopOrNotify(std::optional<T>* item,
+                   std::function<void(std::optional<T>)> on_ready) {
+    {
+      std::unique_lock<decltype(m_)> lock(m_);
+      if (q_.empty() && !closed_) {
+        pop_waiters_.push_back(std::move(on_ready));
+        return false;
+      }
+      if (q_.empty()) {
+        item->reset();
+        return true;
+      }
+      item->emplace(std::move(q_.front()));
+      q_.pop_front();
+    }
+    not_full_cv_.notify_one();
+    return true;
+  }
+
+  // Marks an item returned by Pop as fully processed.
+  void TaskDone() {
+    std::unique_lock<decltype(m_)> lock(m_);
+    if (--unfinished_ == 0) {
+      idle_cv_.notify_all();
+    }
+  }
+
+  // Blocks until every pushed item has been popped and marked done.
+  void WaitIdle() {
+    std::unique_lock<decltype(m_)> lock(m_);
+    idle_cv_.wait(lock, [this] { return unfinished_ == 0; });
+  }
+
+  // Rejects further pushes and wakes blocked producers and consumers. Items
+  // already queued can still be popped.
+  void Close() {
+    std::deque<std::function<void(std::optional<T>)>> waiters;
+    {
+      std::unique_lock<decltype(m_)> lock(m_);
+      closed_ = true;
+      waiters.swap(pop_waiters_);
+    }
+    not_full_cv_.notify_all();
+    not_empty_cv_.notify_all();
+    for (auto& w : waiters) {
+      w(std::nullopt);
+    }
+  }
+
+  bool Closed() const {
+    std::unique_lock<decltype(m_)> lock(m_);
+    return closed_;
+  }
+
+  size_t Size() const {
+    std::unique_lock<decltype(m_)> lock(m_);
+    return q_.size();
+  }
+
+  size_t Capacity() const { return capacity_; }
+
+  uint64_t Dropped() const {
+    std::unique_lock<decltype(m_)> lock(m_);
+    return dropped_;
+  }
+
+ private:
+  const size_t capacity_;
+  const OverflowPolicy overflow_policy_;
+  bool closed_ = false;
+  size_t unfinished_ = 0;
+  uint64_t dropped_ = 0;
+  std::deque<T> q_;
+  std::deque<std::function<void(std::optional<T>)>> pop_waiters_;
+  mutable std::mutex m_;
+  std::condition_variable not_empty_cv_;
+  std::condition_variable not_full_cv_;
+  std::condition_variable idle_cv_;
+};
+
+}  // namespace base
+
+#endif  // CXX_BASE_BOUNDED_QUEUE_H_
@@ -0,0 +1,224 @@
+#include "crc32c.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <vector>
+
+#include "thread_pool.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <nmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#define CRC32C_X86 1
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_ARM 1
+#endif
+
+namespace base {
+
+namespace {
+
+// Reversed Castagnoli polynomial.
+constexpr uint32_t kPoly = 0x82F63B78;
+
+// Pieces smaller than this aren't worth handing to another thread.
+constexpr size_t kParallelPieceSize = 1024 * 1024;
+
+struct Tables {
+  Tables() {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t crc = i;
+      for (int bit = 0; bit < 8; bit++) {
+        crc = crc & 1 ? (crc >> 1) ^ kPoly : crc >> 1;
+      }
+      slice[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+      for (int s = 1; s < 8; s++) {
+        slice[s][i] = (slice[s - 1][i] >> 8) ^ slice[0][slice[s - 1][i] & 0xff];
+      }
+    }
+    // x^1, then each entry squares the one before: x^(2^n) mod p.
+    uint32_t p = 1u << 30;
+    for (auto& entry : x2n) {
+      entry = p;
+      p = MultModP(p, p);
+    }
+  }
+
+  // Multiplies two polynomials modulo the CRC polynomial, in the reflected
+  // bit order the CRC uses.
+  static uint32_t MultModP(uint32_t a, uint32_t b) {
+    uint32_t m = 1u << 31;
+    uint32_t p = 0;
+    while (true) {
+      if (a & m) {
+        p ^= b;
+        if ((a & (m - 1)) == 0) {
+          break;
+        }
+      }
+      m >>= 1;
+      b = b & 1 ? (b >> 1) ^ kPoly : b >> 1;
+    }
+    return p;
+  }
+
+  std::array<std::array<uint32_t, 256>, 8> slice;
+  std::array<uint32_t, 32> x2n;
+};
+
+const Tables& GetTables() {
+  static const Tables tables;
+  return tables;
+}
+
+// Works on the raw, uninverted CRC register.
+uint32_t ExtendTable(uint32_t crc, const uint8_t* data, size_t size) {
+  const auto& t = GetTables().slice;
+  while (size >= 8) {
+    uint32_t lo;
+    uint32_t hi;
+    std::memcpy(&lo, data, 4);
+    std::memcpy(&hi, data + 4, 4);
+    lo ^= crc;
+    crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^
+          t[4][lo >> 24] ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^
+          t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+    data += 8;
+    size -= 8;
+  }
+  while (size-- > 0) {
+    crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xff];
+  }
+  return crc;
+}
+
+#if defined(CRC32C_X86)
+
+#if defined(__GNUC__)
+__attribute__((target("sse4.2")))
+#endif
+uint32_t ExtendHardware(uint32_t crc, const uint8_t* data, size_t size) {
+  uint64_t crc64 = crc;
+  while (size >= 8) {
+    uint64_t word;
+    std::memcpy(&word, data, 8);
+    crc64 = _mm_crc32_u64(crc64, word);
+    data += 8;
+    size -= 8;
+  }
+  crc = static_cast<uint32_t>(crc64);
+  while (size-- > 0) {
+    crc = _mm_crc32_u8(crc, *data++);
+  }
+  return crc;
+}
+
+bool DetectHardware() {
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 1);
+  return (info[2] & (1 << 20)) != 0;
+#else
+  return __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+#elif defined(CRC32C_ARM)
+
+uint32_t ExtendHardware(uint32_t crc, const uint8_t* data, size_t size) {
+  while (size >= 8) {
+    uint64_t word;
+    std::memcpy(&word, data, 8);
+    crc = __crc32cd(crc, word);
+    data += 8;
+    size -= 8;
+  }
+  while (size-- > 0) {
+    crc = __crc32cb(crc, *data++);
+  }
+  return crc;
+}
+
+bool DetectHardware() {
+  return true;
+}
+
+#else
+
+uint32_t ExtendHardware(uint32_t crc, const uint8_t* data, size_t size) {
+  return ExtendTable(crc, data, size);
+}
+
+bool DetectHardware() {
+  return false;
+}
+
+#endif
+
+using ExtendFunction = uint32_t (*)(uint32_t, const uint8_t*, size_t);
+
+ExtendFunction GetExtend() {
+  static const ExtendFunction extend =
+      DetectHardware() ? ExtendHardware : ExtendTable;
+  return extend;
+}
+
+}  // namespace
+
+uint32_t Crc32c(const uint8_t* data, size_t size) {
+  return Crc32cExtend(0, data, size);
+}
+
+uint32_t Crc32cExtend(uint32_t crc, const uint8_t* data, size_t size) {
+  return ~GetExtend()(~crc, data, size);
+}
+
+uint32_t Crc32cCombine(uint32_t crc1, uint32_t crc2, uint64_t size2) {
+  // Shifting crc1 past size2 bytes is a multiplication by x^(8 * size2),
+  // built up from the table of x^(2^n).
+  const Tables& tables = GetTables();
+  uint32_t shift = 1u << 31;
+  unsigned n = 3;
+  while (size2 > 0) {
+    if (size2 & 1) {
+      shift = Tables::MultModP(tables.x2n[n & 31], shift);
+    }
+    size2 >>= 1;
+    n++;
+  }
+  return Tables::MultModP(shift, crc1) ^ crc2;
+}
+
+uint32_t Crc32cParallel(const uint8_t* data, size_t size, ThreadPool* pool) {
+  size_t pieces = (size + kParallelPieceSize - 1) / kParallelPieceSize;
+  if (pieces < 2 || !pool || pool->NumThreads() < 2) {
+    return Crc32c(data, size);
+  }
+  std::vector<uint32_t> crcs(pieces);
+  pool->ParallelFor(0, pieces, 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      size_t offset = i * kParallelPieceSize;
+      crcs[i] = Crc32c(data + offset,
+                       std::min(kParallelPieceSize, size - offset));
+    }
+  });
+  uint32_t crc = crcs[0];
+  for (size_t i = 1; i < pieces; i++) {
+    size_t offset = i * kParallelPieceSize;
+    crc = Crc32cCombine(crc, crcs[i],
+                        std::min(kParallelPieceSize, size - offset));
+  }
+  return crc;
+}
+
+bool Crc32cIsAccelerated() {
+  return GetExtend() != ExtendTable;
+}
+
+}  // namespace base
@@ -0,0 +1,33 @@
+#ifndef CXX_BASE_CRC32C_H_
+#define CXX_BASE_CRC32C_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace base {
+
+class ThreadPool;
+
+// CRC-32C (Castagnoli), as used by iSCSI, ext4 and Azure Storage. Uses the
+// SSE4.2 or ARMv8 crc32 instructions when the CPU has them, and a slicing by
+// 8 table otherwise.
+uint32_t Crc32c(const uint8_t* data, size_t size);
+
+// Continues |crc| of earlier data over the next |size| bytes, so that
+// Crc32cExtend(Crc32c(a), b) is the CRC of a followed by b.
+uint32_t Crc32cExtend(uint32_t crc, const uint8_t* data, size_t size);
+
+// Given the CRCs of two consecutive pieces of data, returns the CRC of both
+// without touching the data again. Takes O(log size2) time.
+uint32_t Crc32cCombine(uint32_t crc1, uint32_t crc2, uint64_t size2);
+
+// Checksums large buffers in pieces across |pool| and combines the results.
+// Small buffers are done on the calling thread.
+uint32_t Crc32cParallel(const uint8_t* data, size_t size, ThreadPool* pool);
+
+// True if Crc32c runs on dedicated instructions.
+bool Crc32cIsAccelerated();
+
+}  // namespace base
+
+#endif  // CXX_BASE_CRC32C_H_
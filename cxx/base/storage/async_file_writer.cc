@@ -0,0 +1,502 @@
+#include "async_file_writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <optional>
+#include <thread>
+
+#include "base/bounded_queue.h"
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+namespace base {
+namespace storage {
+
+namespace {
+
+constexpr size_t kAlignment = 4096;
+
+}  // namespace
+
+namespace internal {
+
+// Writes whole chunks at given offsets in the background. Each submitted chunk
+// is handed back by id once it has been written.
+class ChunkIo {
+ public:
+  virtual ~ChunkIo() = default;
+
+  virtual void Submit(size_t id,
+                      const uint8_t* data,
+                      size_t size,
+                      uint64_t offset) = 0;
+
+  // Blocks until a submitted chunk is done.
+  virtual size_t WaitForCompletion() = 0;
+
+  virtual bool PollCompletion(size_t* id) = 0;
+
+  virtual bool Failed() const = 0;
+};
+
+namespace {
+
+bool PwriteAll(int fd, const uint8_t* data, size_t size, uint64_t offset) {
+  while (size > 0) {
+    ssize_t written = pwrite(fd, data, size, static_cast<off_t>(offset));
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += written;
+    size -= written;
+    offset += written;
+  }
+  return true;
+}
+
+class ThreadChunkIo : public ChunkIo {
+ public:
+  ThreadChunkIo(int fd, size_t chunk_count, const ThreadOptions& options)
+      : fd_(fd),
+        requests_(chunk_count, OverflowPolicy::kBlock),
+        completions_(chunk_count, OverflowPolicy::kBlock) {
+    thread_ = std::thread([this, options] {
+      ApplyThreadOptions(options);
+      IoThread();
+    });
+  }
+  ~ThreadChunkIo() override {
+    requests_.Close();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  void Submit(size_t id,
+              const uint8_t* data,
+              size_t size,
+              uint64_t offset) override {
+    requests_.Push({id, data, size, offset});
+  }
+
+  size_t WaitForCompletion() override { return *completions_.Pop(); }
+
+  bool PollCompletion(size_t* id) override {
+    std::optional<size_t> completed = completions_.TryPop();
+    if (completed) {
+      *id = *completed;
+    }
+    return completed.has_value();
+  }
+
+  bool Failed() const override { return failed_; }
+
+ private:
+  struct Request {
+    size_t id;
+    const uint8_t* data;
+    size_t size;
+    uint64_t offset;
+  };
+
+  void IoThread() {
+    while (std::optional<Request> r = requests_.Pop()) {
+      if (!PwriteAll(fd_, r->data, r->size, r->offset)) {
+        failed_ = true;
+      }
+      completions_.Push(std::move(r->id));
+    }
+  }
+
+  int fd_;
+  std::atomic<bool> failed_ = false;
+  BoundedQueue<Request> requests_;
+  BoundedQueue<size_t> completions_;
+  std::thread thread_;
+};
+
+#if defined(__linux__)
+
+// Minimal io_uring driven through the raw syscalls, so that there's no
+// dependency on liburing. Only the thread that owns the writer touches the
+// rings.
+class IoUringChunkIo : public ChunkIo {
+ public:
+  static std::unique_ptr<IoUringChunkIo> Create(int fd, size_t chunk_count) {
+    auto io = std::unique_ptr<IoUringChunkIo>(new IoUringChunkIo(fd));
+    if (!io->Setup(static_cast<unsigned>(chunk_count))) {
+      return nullptr;
+    }
+    io->pending_.resize(chunk_count);
+    return io;
+  }
+
+  ~IoUringChunkIo() override {
+    if (sqes_) {
+      munmap(sqes_, sqes_size_);
+    }
+    if (cq_ptr_ && cq_ptr_ != sq_ptr_) {
+      munmap(cq_ptr_, cq_size_);
+    }
+    if (sq_ptr_) {
+      munmap(sq_ptr_, sq_size_);
+    }
+    if (ring_fd_ >= 0) {
+      close(ring_fd_);
+    }
+  }
+
+  void Submit(size_t id,
+              const uint8_t* data,
+              size_t size,
+              uint64_t offset) override {
+    Pending& p = pending_[id];
+    p.iov.iov_base = const_cast<uint8_t*>(data);
+    p.iov.iov_len = size;
+    p.offset = offset;
+    Queue(id);
+  }
+
+  size_t WaitForCompletion() override {
+    size_t id = 0;
+    while (!PollCompletion(&id)) {
+      syscall(__NR_io_uring_enter, ring_fd_, 0, 1, IORING_ENTER_GETEVENTS,
+              nullptr, 0);
+    }
+    return id;
+  }
+
+  bool PollCompletion(size_t* id) override {
+    while (true) {
+      // Checked each time round, since going again for a chunk can fail to
+      // submit it.
+      if (!unsubmitted_.empty()) {
+        *id = unsubmitted_.back();
+        unsubmitted_.pop_back();
+        return true;
+      }
+      unsigned head = *cq_head_;
+      unsigned tail = std::atomic_ref<unsigned>(*cq_tail_).load(
+          std::memory_order_acquire);
+      if (head == tail) {
+        return false;
+      }
+      io_uring_cqe* cqe = &cqes_[head & *cq_mask_];
+      size_t completed = static_cast<size_t>(cqe->user_data);
+      int32_t res = cqe->res;
+      std::atomic_ref<unsigned>(*cq_head_).store(head + 1,
+                                                 std::memory_order_release);
+
+      Pending& p = pending_[completed];
+      if (res == -EINTR || res == -EAGAIN) {
+        Queue(completed);
+        continue;
+      }
+      if (res < 0) {
+        failed_ = true;
+      } else if (static_cast<size_t>(res) < p.iov.iov_len) {
+        // Short write, go again for the rest.
+        p.iov.iov_base = static_cast<uint8_t*>(p.iov.iov_base) + res;
+        p.iov.iov_len -= res;
+        p.offset += res;
+        Queue(completed);
+        continue;
+      }
+      *id = completed;
+      return true;
+    }
+  }
+
+  bool Failed() const override { return failed_; }
+
+ private:
+  struct Pending {
+    iovec iov;
+    uint64_t offset;
+  };
+
+  explicit IoUringChunkIo(int fd) : fd_(fd) {}
+
+  bool Setup(unsigned entries) {
+    io_uring_params params = {};
+    ring_fd_ = static_cast<int>(
+        syscall(__NR_io_uring_setup, std::max(entries, 2u), &params));
+    if (ring_fd_ < 0) {
+      return false;
+    }
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+      sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    }
+    sq_ptr_ = Map(sq_size_, IORING_OFF_SQ_RING);
+    if (!sq_ptr_) {
+      return false;
+    }
+    cq_ptr_ = single_mmap ? sq_ptr_ : Map(cq_size_, IORING_OFF_CQ_RING);
+    if (!cq_ptr_) {
+      return false;
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(Map(sqes_size_, IORING_OFF_SQES));
+    if (!sqes_) {
+      return false;
+    }
+
+    uint8_t* sq = static_cast<uint8_t*>(sq_ptr_);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    uint8_t* cq = static_cast<uint8_t*>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  void* Map(size_t size, off_t offset) {
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ring_fd_, offset);
+    return p == MAP_FAILED ? nullptr : p;
+  }
+
+  void Queue(size_t id) {
+    // There are never more chunks in flight than ring entries, so the
+    // submission queue can't be full.
+    unsigned tail = *sq_tail_;
+    unsigned index = tail & *sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd_;
+    sqe->addr = reinterpret_cast<uint64_t>(&pending_[id].iov);
+    sqe->len = 1;
+    sqe->off = pending_[id].offset;
+    sqe->user_data = id;
+    sq_array_[index] = index;
+    std::atomic_ref<unsigned>(*sq_tail_).store(tail + 1,
+                                               std::memory_order_release);
+    while (syscall(__NR_io_uring_enter, ring_fd_, 1, 0, 0, nullptr, 0) < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      // The kernel only fails the call when it has taken nothing from the
+      // ring, so the entry is withdrawn, lest a later call submit it, and
+      // the chunk is handed back as done.
+      std::atomic_ref<unsigned>(*sq_tail_).store(tail,
+                                                 std::memory_order_release);
+      failed_ = true;
+      unsubmitted_.push_back(id);
+      return;
+    }
+  }
+
+  int fd_;
+  int ring_fd_ = -1;
+  bool failed_ = false;
+  void* sq_ptr_ = nullptr;
+  void* cq_ptr_ = nullptr;
+  size_t sq_size_ = 0;
+  size_t cq_size_ = 0;
+  size_t sqes_size_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  unsigned* sq_tail_ = nullptr;
+  unsigned* sq_mask_ = nullptr;
+  unsigned* sq_array_ = nullptr;
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  unsigned* cq_mask_ = nullptr;
+  io_uring_cqe* cqes_ = nullptr;
+  std::vector<Pending> pending_;
+  // Chunks that couldn't be submitted, returned before any completion.
+  std::vector<size_t> unsubmitted_;
+};
+
+#endif
+
+}  // namespace
+}  // namespace internal
+
+void AsyncFileWriter::AlignedFree::operator()(uint8_t* p) const {
+  std::free(p);
+}
+
+AsyncFileWriter::AsyncFileWriter(const char* filename,
+                                 const AsyncFileWriterOptions& options)
+    : options_(options) {
+  options_.chunk_size = std::max(
+      kAlignment,
+      (options_.chunk_size + kAlignment - 1) / kAlignment * kAlignment);
+  options_.chunk_count = std::max<size_t>(options_.chunk_count, 2);
+  for (size_t i = 0; i < options_.chunk_count; i++) {
+    chunks_.emplace_back(static_cast<uint8_t*>(
+        std::aligned_alloc(kAlignment, options_.chunk_size)));
+    if (!chunks_.back()) {
+      failed_ = true;
+      return;
+    }
+    free_chunks_.push_back(i);
+  }
+
+  int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+#if defined(__linux__)
+  if (options_.direct_io) {
+    fd_ = open(filename, flags | O_DIRECT, 0644);
+    direct_io_ = fd_ >= 0;
+  }
+#endif
+  if (fd_ < 0) {
+    fd_ = open(filename, flags, 0644);
+  }
+  if (fd_ < 0) {
+    failed_ = true;
+    return;
+  }
+#if defined(__linux__)
+  if (options_.preallocate_bytes > 0) {
+    // Keep the visible size at what has been written, Close trims the
+    // reservation back off.
+    // Only a hint, so a filesystem that can't reserve the space just goes
+    // without.
+    int result = fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0,
+                           static_cast<off_t>(options_.preallocate_bytes));
+    preallocated_ = result == 0;
+  }
+  if (options_.use_io_uring) {
+    io_ = internal::IoUringChunkIo::Create(fd_, options_.chunk_count);
+    using_io_uring_ = io_ != nullptr;
+  }
+#endif
+  if (!io_) {
+    io_ = std::make_unique<internal::ThreadChunkIo>(
+        fd_, options_.chunk_count, options_.io_thread_options);
+  }
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+  Close();
+}
+
+void AsyncFileWriter::Write(const uint8_t* data, size_t size) {
+  if (fd_ < 0) {
+    return;
+  }
+  while (size > 0) {
+    if (!has_active_) {
+      AcquireChunk();
+    }
+    size_t n = std::min(size, options_.chunk_size - active_fill_);
+    memcpy(chunks_[active_].get() + active_fill_, data, n);
+    active_fill_ += n;
+    data += n;
+    size -= n;
+    if (active_fill_ == options_.chunk_size) {
+      SubmitActive(active_fill_);
+    }
+  }
+}
+
+void AsyncFileWriter::Flush() {
+  if (fd_ < 0 || !has_active_ || active_fill_ == 0) {
+    return;
+  }
+  if (!direct_io_) {
+    SubmitActive(active_fill_);
+    return;
+  }
+  size_t aligned = active_fill_ / kAlignment * kAlignment;
+  if (aligned == 0) {
+    return;
+  }
+  size_t tail = active_fill_ - aligned;
+  size_t flushed = active_;
+  has_active_ = false;
+  AcquireChunk();
+  memcpy(chunks_[active_].get(), chunks_[flushed].get() + aligned, tail);
+  active_fill_ = tail;
+  io_->Submit(flushed, chunks_[flushed].get(), aligned, file_offset_);
+  file_offset_ += aligned;
+  in_flight_++;
+}
+
+void AsyncFileWriter::Close() {
+  if (fd_ < 0) {
+    return;
+  }
+  if (has_active_ && active_fill_ > 0) {
+    if (direct_io_ && active_fill_ % kAlignment != 0) {
+      // O_DIRECT can't write a partial block, so the tail goes through the
+      // page cache once everything before it has landed.
+      WaitForAll();
+      fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_DIRECT);
+      if (!internal::PwriteAll(fd_, chunks_[active_].get(), active_fill_,
+                               file_offset_)) {
+        failed_ = true;
+      }
+      file_offset_ += active_fill_;
+      has_active_ = false;
+    } else {
+      SubmitActive(active_fill_);
+    }
+  }
+  WaitForAll();
+  failed_ |= io_->Failed();
+  io_.reset();
+  if (preallocated_) {
+    if (ftruncate(fd_, static_cast<off_t>(file_offset_)) != 0) {
+      failed_ = true;
+    }
+  }
+  close(fd_);
+  fd_ = -1;
+}
+
+void AsyncFileWriter::AcquireChunk() {
+  size_t id = 0;
+  while (io_->PollCompletion(&id)) {
+    free_chunks_.push_back(id);
+    in_flight_--;
+  }
+  if (free_chunks_.empty()) {
+    free_chunks_.push_back(io_->WaitForCompletion());
+    in_flight_--;
+  }
+  active_ = free_chunks_.back();
+  free_chunks_.pop_back();
+  active_fill_ = 0;
+  has_active_ = true;
+}
+
+void AsyncFileWriter::SubmitActive(size_t size) {
+  io_->Submit(active_, chunks_[active_].get(), size, file_offset_);
+  file_offset_ += size;
+  in_flight_++;
+  has_active_ = false;
+  active_fill_ = 0;
+}
+
+void AsyncFileWriter::WaitForAll() {
+  while (in_flight_ > 0) {
+    free_chunks_.push_back(io_->WaitForCompletion());
+    in_flight_--;
+  }
+}
+
+}  // namespace storage
+}  // namespace base
@@ -0,0 +1,93 @@
+#ifndef CXX_BASE_STORAGE_ASYNC_FILE_WRITER_H_
+#define CXX_BASE_STORAGE_ASYNC_FILE_WRITER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "base/thread_options.h"
+#include "writer.h"
+
+namespace base {
+namespace storage {
+
+namespace internal {
+class ChunkIo;
+}  // namespace internal
+
+struct AsyncFileWriterOptions {
+  // Size of each buffer handed to the kernel. Rounded up to a multiple of
+  // 4096 so that it can be used with O_DIRECT.
+  size_t chunk_size = 4 * 1024 * 1024;
+  // Number of buffers, at least 2. Write only blocks when every buffer is
+  // waiting on the disk.
+  size_t chunk_count = 2;
+  // Bypass the page cache. Falls back to buffered I/O if the filesystem
+  // doesn't support it.
+  bool direct_io = false;
+  // Reserve this much disk up front so that the file doesn't fragment and
+  // writes don't stall on block allocation. Skipped if the filesystem can't.
+  uint64_t preallocate_bytes = 0;
+  // Submit writes through io_uring, falling back to a dedicated I/O thread
+  // using pwrite when io_uring is unavailable.
+  bool use_io_uring = true;
+  // Applied to the I/O thread when io_uring isn't used.
+  ThreadOptions io_thread_options = {"file_io"};
+};
+
+// File writer that copies into large aligned buffers and writes them out in
+// the background, so that the caller only waits on the disk in Close, or when
+// the disk falls a whole set of buffers behind.
+class AsyncFileWriter : public Writer {
+ public:
+  AsyncFileWriter(const char* filename,
+                  const AsyncFileWriterOptions& options = {});
+  ~AsyncFileWriter();
+  AsyncFileWriter(const AsyncFileWriter&) = delete;
+  AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+  void Write(const uint8_t* data, size_t size) override;
+
+  // Starts writing the partly filled buffer. With O_DIRECT only the aligned
+  // part is written, the tail is carried over to the next buffer.
+  void Flush() override;
+
+  void Close() override;
+
+  // True if the file or the buffers couldn't be set up, or a write failed.
+  bool Failed() const { return failed_; }
+
+  bool UsingIoUring() const { return using_io_uring_; }
+
+ private:
+  struct AlignedFree {
+    void operator()(uint8_t* p) const;
+  };
+
+  void AcquireChunk();
+
+  void SubmitActive(size_t size);
+
+  void WaitForAll();
+
+  AsyncFileWriterOptions options_;
+  int fd_ = -1;
+  bool direct_io_ = false;
+  bool using_io_uring_ = false;
+  bool failed_ = false;
+  bool preallocated_ = false;
+  std::unique_ptr<internal::ChunkIo> io_;
+  std::vector<std::unique_ptr<uint8_t[], AlignedFree>> chunks_;
+  std::vector<size_t> free_chunks_;
+  size_t in_flight_ = 0;
+  bool has_active_ = false;
+  size_t active_ = 0;
+  size_t active_fill_ = 0;
+  uint64_t file_offset_ = 0;
+};
+
+}  // namespace storage
+}  // namespace base
+
+#endif  // CXX_BASE_STORAGE_ASYNC_FILE_WRITER_H_
@@ -0,0 +1,37 @@
+#ifndef CXX_BASE_STORAGE_ASYNC_WRITER_H_
+#define CXX_BASE_STORAGE_ASYNC_WRITER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "base/task.h"
+#include "base/thread_pool.h"
+#include "writer.h"
+
+namespace base {
+namespace storage {
+
+// Coroutine adapters for the blocking Writer calls. The call runs on
+// |io_pool| and the awaiting coroutine continues there once it returns, so a
+// slow sink only holds up an I/O thread. |data| must stay valid until the
+// returned task completes.
+inline Task<void> WriteAsync(Writer* writer,
+                             ThreadPool* io_pool,
+                             const uint8_t* data,
+                             size_t size) {
+  co_await Offload(io_pool,
+                   [writer, data, size] { writer->Write(data, size); });
+}
+
+inline Task<void> FlushAsync(Writer* writer, ThreadPool* io_pool) {
+  co_await Offload(io_pool, [writer] { writer->Flush(); });
+}
+
+inline Task<void> CloseAsync(Writer* writer, ThreadPool* io_pool) {
+  co_await Offload(io_pool, [writer] { writer->Close(); });
+}
+
+}  // namespace storage
+}  // namespace base
+
+#endif  // CXX_BASE_STORAGE_ASYNC_WRITER_H_
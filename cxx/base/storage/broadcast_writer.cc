@@ -1,29 +1,511 @@
 #include "broadcast_writer.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
 namespace base {
 namespace storage {
 
+namespace {
+
+// A null chunk marks a sync point.
+using Chunk = std::shared_ptr<const std::vector<uint8_t>>;
+
+constexpr size_t kSpillReadSize = 1024 * 1024;
+
+// Spill files share a directory with other writers and other processes, so
+// their names combine the process id with a count that never repeats within
+// the process.
+std::atomic<uint64_t> spill_count = 0;
+
+std::string SpillFileName() {
+#if defined(_WIN32)
+  int pid = _getpid();
+#else
+  int pid = static_cast<int>(getpid());
+#endif
+  return "broadcast_spill_" + std::to_string(pid) + "_" +
+         std::to_string(spill_count++) + ".tmp";
+}
+
+}  // namespace
+
+// Queue and thread feeding one internal writer. Chunks are shared between all
+// sinks, so each write is only copied once however many sinks there are.
+//
+// With kSpillToDisk, once the queue fills everything after it is handed to a
+// spill thread, which appends it to the spill file, so the caller never
+// waits on the disk. The sink reads the file back in order, then takes
+// whatever the spill thread hasn't got to yet straight from memory, and
+// goes back to the queue once it has caught up.
+class BroadcastWriter::Sink {
+ public:
+  Sink(std::unique_ptr<Writer> writer,
+       const BroadcastOptions& options,
+       const std::filesystem::path& spill_path)
+      : writer_(std::move(writer)), options_(options), spill_path_(spill_path) {
+    thread_ = std::thread([this] {
+      ApplyThreadOptions(options_.sink_thread_options);
+      SinkThread();
+    });
+  }
+  ~Sink() { Close(); }
+  Sink(const Sink&) = delete;
+  Sink& operator=(const Sink&) = delete;
+
+  void Push(const Chunk& chunk) {
+    std::unique_lock<decltype(m_)> lock(m_);
+    if (dropped_ || closed_) {
+      return;
+    }
+    // Once anything has been spilled, newer chunks follow it so that the
+    // sink still sees the stream in order.
+    if (!Spilling() && q_.size() < options_.max_queued_chunks) {
+      Enqueue(chunk);
+    } else {
+      switch (options_.lagging_sink_policy) {
+        case LaggingSinkPolicy::kBlock:
+          space_cv_.wait(lock, [this] {
+            return q_.size() < options_.max_queued_chunks || dropped_ ||
+                   closed_;
+          });
+          if (!dropped_ && !closed_) {
+            Enqueue(chunk);
+          }
+          break;
+        case LaggingSinkPolicy::kDropSink:
+          dropped_ = true;
+          Clear();
+          break;
+        case LaggingSinkPolicy::kSpillToDisk:
+          Spill(chunk);
+          break;
+      }
+    }
+    UpdateLag();
+    data_cv_.notify_all();
+  }
+
+  // Sync points carry no data, so they are queued even when the queue is
+  // full, and follow the data to disk when spilling.
+  void PushSyncPoint() {
+    std::unique_lock<decltype(m_)> lock(m_);
+    if (dropped_ || closed_) {
+      return;
+    }
+    if (Spilling()) {
+      Spill(nullptr);
+    } else {
+      q_.push_back(nullptr);
+    }
+    data_cv_.notify_all();
+  }
+
+  void RequestFlush() {
+    std::unique_lock<decltype(m_)> lock(m_);
+    flush_requested_ = true;
+    data_cv_.notify_all();
+  }
+
+  void Close() {
+    {
+      std::unique_lock<decltype(m_)> lock(m_);
+      if (closed_) {
+        return;
+      }
+      closed_ = true;
+    }
+    data_cv_.notify_all();
+    space_cv_.notify_all();
+    spill_cv_.notify_all();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    if (spill_thread_.joinable()) {
+      spill_thread_.join();
+    }
+    writer_->Close();
+    if (spill_out_.is_open()) {
+      spill_out_.close();
+      spill_in_.close();
+      std::error_code ec;
+      std::filesystem::remove(spill_path_, ec);
+    }
+  }
+
+  SinkStats GetStats() const {
+    std::unique_lock<decltype(m_)> lock(m_);
+    return stats_;
+  }
+
+ private:
+  bool Spilling() const {
+    return spill_read_ < spill_write_ || !spill_pending_.empty() ||
+           !spill_sync_points_.empty() || spill_writing_;
+  }
+
+  void Enqueue(const Chunk& chunk) {
+    q_.push_back(chunk);
+    queued_bytes_ += chunk->size();
+  }
+
+  void Clear() {
+    q_.clear();
+    queued_bytes_ = 0;
+    spill_pending_.clear();
+    pending_bytes_ = 0;
+    spill_sync_points_.clear();
+  }
+
+  // Hands the chunk, or a sync point if null, to the spill thread.
+  void Spill(const Chunk& chunk) {
+    if (!spill_thread_.joinable()) {
+      spill_thread_ = std::thread([this] {
+        ApplyThreadOptions(options_.sink_thread_options);
+        SpillThread();
+      });
+    }
+    spill_pending_.push_back(chunk);
+    if (chunk) {
+      pending_bytes_ += chunk->size();
+    }
+    spill_cv_.notify_all();
+  }
+
+  // Appends |chunk| to the spill file at |offset|. Only the spill thread
+  // writes the file.
+  bool WriteSpill(const Chunk& chunk, uint64_t offset) {
+    if (!spill_out_.is_open()) {
+      spill_out_.open(spill_path_, std::ios::binary | std::ios::trunc);
+      if (!spill_out_.is_open()) {
+        return false;
+      }
+    }
+    spill_out_.seekp(static_cast<std::streamoff>(offset));
+    spill_out_.write(reinterpret_cast<const char*>(chunk->data()),
+                     chunk->size());
+    // Flushed so that the sink thread can read it back, and so that a full
+    // disk shows up here rather than as a gap when it does.
+    spill_out_.flush();
+    return static_cast<bool>(spill_out_);
+  }
+
+  // Reads |size| bytes at |offset| back from the spill file. Only the sink
+  // thread reads the file.
+  bool ReadSpill(uint64_t offset, size_t size, std::vector<uint8_t>* data) {
+    if (!spill_in_.is_open()) {
+      spill_in_.open(spill_path_, std::ios::binary);
+    }
+    spill_in_.clear();
+    data->resize(size);
+    spill_in_.seekg(static_cast<std::streamoff>(offset));
+    spill_in_.read(reinterpret_cast<char*>(data->data()), size);
+    return static_cast<size_t>(spill_in_.gcount()) == size;
+  }
+
+  void Drop() {
+    dropped_ = true;
+    Clear();
+    UpdateLag();
+    data_cv_.notify_all();
+    space_cv_.notify_all();
+    spill_cv_.notify_all();
+  }
+
+  void UpdateLag() {
+    stats_.lag_bytes =
+        queued_bytes_ + (spill_write_ - spill_read_) + pending_bytes_;
+    stats_.max_lag_bytes = std::max(stats_.max_lag_bytes, stats_.lag_bytes);
+    stats_.dropped = dropped_;
+  }
+
+  void SpillThread() {
+    std::unique_lock<decltype(m_)> lock(m_);
+    while (true) {
+      spill_cv_.wait(lock, [this] {
+        return !spill_pending_.empty() || closed_ || dropped_;
+      });
+      if (dropped_ || spill_pending_.empty()) {
+        return;
+      }
+      Chunk chunk = spill_pending_.front();
+      if (!chunk) {
+        spill_sync_points_.push_back(spill_write_);
+        spill_pending_.pop_front();
+        data_cv_.notify_all();
+        continue;
+      }
+      // The chunk stays at the front of spill_pending_ while it is written,
+      // which keeps the sink from taking the chunks behind it first.
+      uint64_t offset = spill_write_;
+      spill_writing_ = true;
+      lock.unlock();
+      bool written = WriteSpill(chunk, offset);
+      lock.lock();
+      spill_writing_ = false;
+      if (!written) {
+        // Nowhere to put it, so this sink can't be kept whole.
+        Drop();
+        return;
+      }
+      spill_pending_.pop_front();
+      pending_bytes_ -= chunk->size();
+      spill_write_ += chunk->size();
+      stats_.spilled_bytes += chunk->size();
+      UpdateLag();
+      data_cv_.notify_all();
+    }
+  }
+
+  void SinkThread() {
+    std::vector<uint8_t> spilled;
+    while (true) {
+      std::unique_lock<decltype(m_)> lock(m_);
+      // Whatever the spill thread is writing comes before anything else
+      // left, so with only that to go there is nothing to do but wait.
+      data_cv_.wait(lock, [this] {
+        return !q_.empty() || spill_read_ < spill_write_ ||
+               (!spill_sync_points_.empty() &&
+                spill_sync_points_.front() == spill_read_) ||
+               (!spill_writing_ && (!spill_pending_.empty() ||
+                                    flush_requested_ || closed_)) ||
+               dropped_;
+      });
+      if (dropped_) {
+        UpdateLag();
+        return;
+      }
+      if (spill_read_ == spill_write_ && spill_sync_points_.empty() &&
+          !spill_writing_) {
+        // Caught up with the file, reuse it from the start for the next
+        // backlog.
+        spill_read_ = spill_write_ = 0;
+      }
+      if (!q_.empty()) {
+        Chunk chunk = std::move(q_.front());
+        q_.pop_front();
+        space_cv_.notify_all();
+        if (!chunk) {
+          lock.unlock();
+          writer_->MarkSyncPoint();
+          continue;
+        }
+        queued_bytes_ -= chunk->size();
+        lock.unlock();
+        writer_->Write(chunk->data(), chunk->size());
+        lock.lock();
+        stats_.bytes_written += chunk->size();
+        UpdateLag();
+        continue;
+      }
+      if (!spill_sync_points_.empty() &&
+          spill_sync_points_.front() == spill_read_) {
+        spill_sync_points_.pop_front();
+        lock.unlock();
+        writer_->MarkSyncPoint();
+        continue;
+      }
+      if (spill_read_ < spill_write_) {
+        uint64_t end = spill_write_;
+        if (!spill_sync_points_.empty()) {
+          end = std::min(end, spill_sync_points_.front());
+        }
+        size_t size = static_cast<size_t>(
+            std::min<uint64_t>(kSpillReadSize, end - spill_read_));
+        uint64_t offset = spill_read_;
+        lock.unlock();
+        bool read = ReadSpill(offset, size, &spilled);
+        lock.lock();
+        if (!read) {
+          Drop();
+          return;
+        }
+        spill_read_ += size;
+        lock.unlock();
+        writer_->Write(spilled.data(), spilled.size());
+        lock.lock();
+        stats_.bytes_written += size;
+        UpdateLag();
+        continue;
+      }
+      if (!spill_writing_ && !spill_pending_.empty()) {
+        // The spill thread hasn't got to it yet, so it skips the disk.
+        Chunk chunk = std::move(spill_pending_.front());
+        spill_pending_.pop_front();
+        if (!chunk) {
+          lock.unlock();
+          writer_->MarkSyncPoint();
+          continue;
+        }
+        pending_bytes_ -= chunk->size();
+        lock.unlock();
+        writer_->Write(chunk->data(), chunk->size());
+        lock.lock();
+        stats_.bytes_written += chunk->size();
+        UpdateLag();
+        continue;
+      }
+      if (flush_requested_) {
+        flush_requested_ = false;
+        lock.unlock();
+        writer_->Flush();
+        continue;
+      }
+      if (closed_) {
+        return;
+      }
+    }
+  }
+
+  std::unique_ptr<Writer> writer_;
+  BroadcastOptions options_;
+  std::filesystem::path spill_path_;
+  // Chunks, and null sync points, waiting for the spill thread, in order
+  // after everything in the file.
+  std::deque<Chunk> spill_pending_;
+  uint64_t pending_bytes_ = 0;
+  // Set while the spill thread writes the front of spill_pending_.
+  bool spill_writing_ = false;
+  // Offsets in the spill file that sync points fall at.
+  std::deque<uint64_t> spill_sync_points_;
+  std::ofstream spill_out_;
+  std::ifstream spill_in_;
+  uint64_t spill_read_ = 0;
+  uint64_t spill_write_ = 0;
+  std::deque<Chunk> q_;
+  uint64_t queued_bytes_ = 0;
+  bool flush_requested_ = false;
+  bool closed_ = false;
+  bool dropped_ = false;
+  SinkStats stats_;
+  mutable std::mutex m_;
+  std::condition_variable data_cv_;
+  std::condition_variable space_cv_;
+  std::condition_variable spill_cv_;
+  std::thread thread_;
+  std::thread spill_thread_;
+};
+
 BroadcastWriter::BroadcastWriter(
-    std::vector<std::unique_ptr<Writer>> internal_writers)
-    : internal_writers_(std::move(internal_writers)) {}
+    std::vector<std::unique_ptr<Writer>> internal_writers,
+    const BroadcastOptions& options) {
+  if (!options.asynchronous) {
+    internal_writers_ = std::move(internal_writers);
+    return;
+  }
+  std::filesystem::path spill_directory = options.spill_directory;
+  if (spill_directory.empty()) {
+    std::error_code ec;
+    spill_directory = std::filesystem::temp_directory_path(ec);
+  }
+  for (size_t i = 0; i < internal_writers.size(); i++) {
+    if (!internal_writers[i]) {
+      continue;
+    }
+    sinks_.push_back(std::make_unique<Sink>(std::move(internal_writers[i]),
+                                            options,
+                                            spill_directory / SpillFileName()));
+  }
+}
 
-BroadcastWriter::~BroadcastWriter() {}
+BroadcastWriter::~BroadcastWriter() {
+  sinks_.clear();
+}
 
-void BroadcastWriter::Write(uint8_t* data, size_t size) {
+void BroadcastWriter::Write(const uint8_t* data, size_t size) {
   for (auto& w : internal_writers_) {
     if (w) {
       w->Write(data, size);
     }
   }
+  if (!sinks_.empty()) {
+    auto chunk =
+        std::make_shared<const std::vector<uint8_t>>(data, data + size);
+    for (auto& s : sinks_) {
+      s->Push(chunk);
+    }
+  }
+}
+
+void BroadcastWriter::WriteV(std::span<const WriteBuffer> buffers) {
+  for (auto& w : internal_writers_) {
+    if (w) {
+      w->WriteV(buffers);
+    }
+  }
+  if (!sinks_.empty()) {
+    size_t total = 0;
+    for (const auto& b : buffers) {
+      total += b.size;
+    }
+    auto chunk = std::make_shared<std::vector<uint8_t>>();
+    chunk->reserve(total);
+    for (const auto& b : buffers) {
+      chunk->insert(chunk->end(), b.data, b.data + b.size);
+    }
+    Chunk shared = std::move(chunk);
+    for (auto& s : sinks_) {
+      s->Push(shared);
+    }
+  }
+}
+
+void BroadcastWriter::Flush() {
+  for (auto& w : internal_writers_) {
+    if (w) {
+      w->Flush();
+    }
+  }
+  for (auto& s : sinks_) {
+    s->RequestFlush();
+  }
+}
+
+void BroadcastWriter::MarkSyncPoint() {
+  for (auto& w : internal_writers_) {
+    if (w) {
+      w->MarkSyncPoint();
+    }
+  }
+  for (auto& s : sinks_) {
+    s->PushSyncPoint();
+  }
 }
 
 void BroadcastWriter::Close() {
+  if (closed_) {
+    return;
+  }
+  closed_ = true;
   for (auto& w : internal_writers_) {
     if (w) {
       w->Close();
     }
   }
+  for (auto& s : sinks_) {
+    s->Close();
+  }
+}
+
+std::vector<SinkStats> BroadcastWriter::GetSinkStats() const {
+  std::vector<SinkStats> stats;
+  for (const auto& s : sinks_) {
+    stats.push_back(s->GetStats());
+  }
+  return stats;
 }
 
 }  // namespace storage
-}  // namespace base
\ No newline at end of file
+}  // namespace base
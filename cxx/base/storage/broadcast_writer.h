@@ -1,29 +1,85 @@
 #ifndef CXX_BASE_STORAGE_BROADCAST_WRITER_H_
 #define CXX_BASE_STORAGE_BROADCAST_WRITER_H_
 
+#include <cstdint>
 #include <memory>
+#include <string>
 #include <vector>
+#include "base/thread_options.h"
 #include "writer.h"
 
 namespace base {
 namespace storage {
 
+// What an asynchronous BroadcastWriter does with a sink whose queue is full.
+enum class LaggingSinkPolicy {
+  // Wait for the sink to catch up, stalling the caller and every other sink.
+  kBlock,
+  // Stop sending to the sink. It is still closed along with the others.
+  kDropSink,
+  // Append to a file on local disk and feed the sink from it once it catches
+  // up. The file is written on a thread of its own, so the caller doesn't
+  // wait on the disk. The sink is dropped if the file can't be written or
+  // read back.
+  kSpillToDisk,
+};
+
+struct BroadcastOptions {
+  // When false every sink is written in turn on the calling thread. When true
+  // each write is copied once into a shared chunk which every sink consumes
+  // from its own queue on its own thread.
+  bool asynchronous = false;
+  size_t max_queued_chunks = 64;
+  LaggingSinkPolicy lagging_sink_policy = LaggingSinkPolicy::kBlock;
+  // Where kSpillToDisk files go, the system temp directory when empty.
+  std::string spill_directory;
+  ThreadOptions sink_thread_options = {"broadcast_sink"};
+};
+
+struct SinkStats {
+  uint64_t bytes_written = 0;
+  // Bytes handed to the broadcast writer but not yet to the sink, including
+  // anything spilled to disk.
+  uint64_t lag_bytes = 0;
+  uint64_t max_lag_bytes = 0;
+  uint64_t spilled_bytes = 0;
+  bool dropped = false;
+};
+
 class BroadcastWriter : public Writer {
  public:
-  BroadcastWriter(std::vector<std::unique_ptr<Writer>> internal_writers);
+  BroadcastWriter(std::vector<std::unique_ptr<Writer>> internal_writers,
+                  const BroadcastOptions& options = {});
   ~BroadcastWriter();
   BroadcastWriter(const BroadcastWriter&) = delete;
   BroadcastWriter& operator=(const BroadcastWriter&) = delete;
 
-  virtual void Write(uint8_t* data, size_t size) override;
+  void Write(const uint8_t* data, size_t size) override;
 
-  virtual void Close() override;
+  void WriteV(std::span<const WriteBuffer> buffers) override;
+
+  // In asynchronous mode this asks each sink to flush once it has caught up,
+  // without waiting for it.
+  void Flush() override;
+
+  // Passed on to each sink in order with the data, including sinks that are
+  // lagging or spilling to disk.
+  void MarkSyncPoint() override;
+
+  void Close() override;
+
+  // One entry per internal writer, empty in synchronous mode.
+  std::vector<SinkStats> GetSinkStats() const;
 
  private:
+  class Sink;
+
   std::vector<std::unique_ptr<Writer>> internal_writers_;
+  std::vector<std::unique_ptr<Sink>> sinks_;
+  bool closed_ = false;
 };
 
 }  // namespace storage
 }  // namespace base
 
-#endif  // CXX_BASE_STORAGE_BROADCAST_WRITER_H_
\ No newline at end of file
+#endif  // CXX_BASE_STORAGE_BROADCAST_WRITER_H_
@@ -0,0 +1,187 @@
+#include "buffered_file_reader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+namespace base {
+namespace storage {
+
+BufferedFileReader::BufferedFileReader(const char* filename,
+                                       const BufferedFileReaderOptions& options)
+    : options_(options), file_(filename, std::ios::binary) {
+  options_.buffer_size = std::max<size_t>(options_.buffer_size, 1);
+  options_.buffer_count = std::max<size_t>(options_.buffer_count, 2);
+  std::error_code ec;
+  size_ = std::filesystem::file_size(filename, ec);
+  if (!file_.is_open() || ec) {
+    failed_ = true;
+    size_ = 0;
+    return;
+  }
+  for (size_t i = 0; i < options_.buffer_count; i++) {
+    auto buffer = std::make_unique<Buffer>();
+    buffer->data.resize(options_.buffer_size);
+    free_.push_back(std::move(buffer));
+  }
+  thread_ = std::thread([this] {
+    ApplyThreadOptions(options_.read_thread_options);
+    ReadThread();
+  });
+}
+
+BufferedFileReader::~BufferedFileReader() {
+  Close();
+}
+
+size_t BufferedFileReader::Read(uint8_t* data, size_t size) {
+  size_t copied = 0;
+  while (copied < size) {
+    std::span<const uint8_t> next = Next(size - copied);
+    if (next.empty()) {
+      break;
+    }
+    std::memcpy(data + copied, next.data(), next.size());
+    copied += next.size();
+  }
+  return copied;
+}
+
+std::span<const uint8_t> BufferedFileReader::Next(size_t max_size) {
+  std::unique_lock<decltype(m_)> lock(m_);
+  if (current_ && current_pos_ == current_->size) {
+    Recycle(std::move(current_));
+  }
+  if (!current_) {
+    if (position_ >= size_) {
+      return {};
+    }
+    cv_.wait(lock, [this] { return !ready_.empty() || failed_ || closed_; });
+    if (ready_.empty()) {
+      return {};
+    }
+    current_ = std::move(ready_.front());
+    ready_.pop_front();
+    current_pos_ = static_cast<size_t>(position_ - current_->offset);
+  }
+  size_t n = std::min(max_size, current_->size - current_pos_);
+  std::span<const uint8_t> next(current_->data.data() + current_pos_, n);
+  current_pos_ += n;
+  position_ += n;
+  return next;
+}
+
+bool BufferedFileReader::Seek(uint64_t offset) {
+  std::unique_lock<decltype(m_)> lock(m_);
+  if (offset > size_ || closed_) {
+    return false;
+  }
+  position_ = offset;
+  auto contains = [offset](const Buffer& b) {
+    return offset >= b.offset && offset < b.offset + b.size;
+  };
+  if (current_ && contains(*current_)) {
+    current_pos_ = static_cast<size_t>(offset - current_->offset);
+    return true;
+  }
+  // Skip forward through what has been read ahead if possible.
+  auto it = std::find_if(ready_.begin(), ready_.end(),
+                         [&contains](const auto& b) { return contains(*b); });
+  if (it != ready_.end()) {
+    if (current_) {
+      Recycle(std::move(current_));
+    }
+    size_t skipped = static_cast<size_t>(it - ready_.begin());
+    for (size_t i = 0; i < skipped; i++) {
+      Recycle(std::move(ready_.front()));
+      ready_.pop_front();
+    }
+    return true;
+  }
+  if (current_) {
+    Recycle(std::move(current_));
+  }
+  while (!ready_.empty()) {
+    Recycle(std::move(ready_.front()));
+    ready_.pop_front();
+  }
+  generation_++;
+  next_read_ = offset;
+  cv_.notify_all();
+  return true;
+}
+
+uint64_t BufferedFileReader::Position() const {
+  std::unique_lock<decltype(m_)> lock(m_);
+  return position_;
+}
+
+void BufferedFileReader::Close() {
+  {
+    std::unique_lock<decltype(m_)> lock(m_);
+    if (closed_) {
+      return;
+    }
+    closed_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  file_.close();
+}
+
+bool BufferedFileReader::Failed() const {
+  std::unique_lock<decltype(m_)> lock(m_);
+  return failed_;
+}
+
+void BufferedFileReader::ReadThread() {
+  std::unique_lock<decltype(m_)> lock(m_);
+  while (true) {
+    cv_.wait(lock, [this] {
+      return closed_ || (!free_.empty() && next_read_ < size_ && !failed_);
+    });
+    if (closed_) {
+      return;
+    }
+    std::unique_ptr<Buffer> buffer = std::move(free_.back());
+    free_.pop_back();
+    uint64_t offset = next_read_;
+    uint64_t generation = generation_;
+    size_t size = static_cast<size_t>(
+        std::min<uint64_t>(options_.buffer_size, size_ - offset));
+    next_read_ += size;
+    lock.unlock();
+
+    // Only this thread touches the file once it is running.
+    file_.clear();
+    file_.seekg(static_cast<std::streamoff>(offset));
+    file_.read(reinterpret_cast<char*>(buffer->data.data()), size);
+    bool complete = static_cast<size_t>(file_.gcount()) == size;
+
+    lock.lock();
+    if (generation != generation_) {
+      free_.push_back(std::move(buffer));
+      continue;
+    }
+    if (!complete) {
+      failed_ = true;
+      free_.push_back(std::move(buffer));
+      cv_.notify_all();
+      continue;
+    }
+    buffer->offset = offset;
+    buffer->size = size;
+    ready_.push_back(std::move(buffer));
+    cv_.notify_all();
+  }
+}
+
+void BufferedFileReader::Recycle(std::unique_ptr<Buffer> buffer) {
+  free_.push_back(std::move(buffer));
+  cv_.notify_all();
+}
+
+}  // namespace storage
+}  // namespace base
@@ -0,0 +1,90 @@
+#ifndef CXX_BASE_STORAGE_BUFFERED_FILE_READER_H_
+#define CXX_BASE_STORAGE_BUFFERED_FILE_READER_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "base/thread_options.h"
+#include "reader.h"
+
+namespace base {
+namespace storage {
+
+struct BufferedFileReaderOptions {
+  // Size of each read from the file.
+  size_t buffer_size = 1024 * 1024;
+  // Number of buffers, at least 2. All but the one being consumed can be
+  // filled ahead of the reader.
+  size_t buffer_count = 4;
+  ThreadOptions read_thread_options = {"file_read"};
+};
+
+// Reads the file ahead of the caller on a background thread, so that
+// sequential reads rarely wait on the disk. Seeking outside the buffered
+// range throws away the read-ahead and starts again from the new position.
+class BufferedFileReader : public Reader {
+ public:
+  BufferedFileReader(const char* filename,
+                     const BufferedFileReaderOptions& options = {});
+  ~BufferedFileReader();
+  BufferedFileReader(const BufferedFileReader&) = delete;
+  BufferedFileReader& operator=(const BufferedFileReader&) = delete;
+
+  size_t Read(uint8_t* data, size_t size) override;
+
+  // Views never cross the end of a buffer, so they may be shorter than
+  // |max_size| before the end of the file.
+  std::span<const uint8_t> Next(size_t max_size) override;
+
+  bool Seek(uint64_t offset) override;
+
+  uint64_t Position() const override;
+
+  uint64_t Size() const override { return size_; }
+
+  void Close() override;
+
+  // True if the file couldn't be opened or a read came up short.
+  bool Failed() const;
+
+ private:
+  struct Buffer {
+    std::vector<uint8_t> data;
+    uint64_t offset = 0;
+    size_t size = 0;
+  };
+
+  void ReadThread();
+
+  void Recycle(std::unique_ptr<Buffer> buffer);
+
+  BufferedFileReaderOptions options_;
+  std::ifstream file_;
+  uint64_t size_ = 0;
+  std::vector<std::unique_ptr<Buffer>> free_;
+  std::deque<std::unique_ptr<Buffer>> ready_;
+  std::unique_ptr<Buffer> current_;
+  size_t current_pos_ = 0;
+  uint64_t position_ = 0;
+  uint64_t next_read_ = 0;
+  // Bumped on every seek that discards the read-ahead, so that a read in
+  // progress at the time knows to throw its result away.
+  uint64_t generation_ = 0;
+  bool failed_ = false;
+  bool closed_ = false;
+  mutable std::mutex m_;
+  std::condition_variable cv_;
+  std::thread thread_;
+};
+
+}  // namespace storage
+}  // namespace base
+
+#endif  // CXX_BASE_STORAGE_BUFFERED_FILE_READER_H_
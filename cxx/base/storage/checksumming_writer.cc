@@ -0,0 +1,188 @@
+#include "checksumming_writer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+
+#include "base/crc32c.h"
+#include "base/thread_pool.h"
+#include "endian.h"
+
+namespace base {
+namespace storage {
+
+namespace {
+
+constexpr uint8_t kSidecarMagic[4] = {'M', 'C', 'C', 'K'};
+constexpr uint8_t kTrailerMagic[4] = {'M', 'C', 'C', 'E'};
+constexpr uint32_t kSidecarVersion = 1;
+constexpr size_t kHeaderSize = 12;
+constexpr size_t kTrailerSize = 16;
+}  // namespace
+
+ChecksummingWriter::ChecksummingWriter(std::unique_ptr<Writer> output,
+                                       std::unique_ptr<Writer> sidecar,
+                                       const ChecksumOptions& options)
+    : output_(std::move(output)),
+      sidecar_(std::move(sidecar)),
+      options_(options) {
+  options_.chunk_size = std::max<size_t>(options_.chunk_size, 1);
+  uint8_t header[kHeaderSize];
+  std::copy(std::begin(kSidecarMagic), std::end(kSidecarMagic), header);
+  internal::PutLe(kSidecarVersion, 4, header + 4);
+  internal::PutLe(options_.chunk_size, 4, header + 8);
+  sidecar_->Write(header, sizeof(header));
+}
+
+ChecksummingWriter::~ChecksummingWriter() {
+  Close();
+}
+
+void ChecksummingWriter::Write(const uint8_t* data, size_t size) {
+  if (closed_) {
+    return;
+  }
+  output_->Write(data, size);
+  Update(data, size);
+}
+
+void ChecksummingWriter::WriteV(std::span<const WriteBuffer> buffers) {
+  if (closed_) {
+    return;
+  }
+  output_->WriteV(buffers);
+  for (const auto& b : buffers) {
+    Update(b.data, b.size);
+  }
+}
+
+void ChecksummingWriter::Flush() {
+  output_->Flush();
+  sidecar_->Flush();
+}
+
+void ChecksummingWriter::MarkSyncPoint() {
+  output_->MarkSyncPoint();
+}
+
+std::optional<uint64_t> ChecksummingWriter::CommittedBytes() const {
+  return output_->CommittedBytes();
+}
+
+void ChecksummingWriter::Close() {
+  if (closed_) {
+    return;
+  }
+  closed_ = true;
+  output_->Close();
+  if (chunk_fill_ > 0) {
+    FinishChunk();
+  }
+  uint8_t trailer[kTrailerSize];
+  internal::PutLe(total_bytes_, 8, trailer);
+  internal::PutLe(stream_crc_, 4, trailer + 8);
+  std::copy(std::begin(kTrailerMagic), std::end(kTrailerMagic), trailer + 12);
+  sidecar_->Write(trailer, sizeof(trailer));
+  sidecar_->Close();
+}
+
+uint32_t ChecksummingWriter::StreamCrc() const {
+  return chunk_fill_ > 0
+             ? Crc32cCombine(stream_crc_, chunk_crc_, chunk_fill_)
+             : stream_crc_;
+}
+
+void ChecksummingWriter::Update(const uint8_t* data, size_t size) {
+  total_bytes_ += size;
+  while (size > 0) {
+    size_t n = std::min(size, options_.chunk_size - chunk_fill_);
+    chunk_crc_ = Crc32cExtend(chunk_crc_, data, n);
+    chunk_fill_ += n;
+    data += n;
+    size -= n;
+    if (chunk_fill_ == options_.chunk_size) {
+      FinishChunk();
+    }
+  }
+}
+
+void ChecksummingWriter::FinishChunk() {
+  uint8_t record[4];
+  internal::PutLe(chunk_crc_, 4, record);
+  sidecar_->Write(record, sizeof(record));
+  stream_crc_ = Crc32cCombine(stream_crc_, chunk_crc_, chunk_fill_);
+  chunk_crc_ = 0;
+  chunk_fill_ = 0;
+}
+
+bool ReadChecksumSidecar(const std::string& path, ChecksumSidecar* sidecar) {
+  std::ifstream f(path, std::ios::binary);
+  if (!f.is_open()) {
+    return false;
+  }
+  std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(f)), {});
+  if (bytes.size() < kHeaderSize ||
+      !std::equal(std::begin(kSidecarMagic), std::end(kSidecarMagic),
+                  bytes.begin()) ||
+      internal::GetLe(bytes.data() + 4, 4) != kSidecarVersion) {
+    return false;
+  }
+  *sidecar = ChecksumSidecar();
+  sidecar->chunk_size =
+      static_cast<uint32_t>(internal::GetLe(bytes.data() + 8, 4));
+  size_t records_end = bytes.size();
+  if (bytes.size() >= kHeaderSize + kTrailerSize &&
+      (bytes.size() - kHeaderSize - kTrailerSize) % 4 == 0 &&
+      std::equal(std::begin(kTrailerMagic), std::end(kTrailerMagic),
+                 bytes.end() - 4)) {
+    records_end = bytes.size() - kTrailerSize;
+    sidecar->complete = true;
+    sidecar->total_size = internal::GetLe(bytes.data() + records_end, 8);
+    sidecar->stream_crc = static_cast<uint32_t>(
+        internal::GetLe(bytes.data() + records_end + 8, 4));
+  }
+  for (size_t pos = kHeaderSize; pos + 4 <= records_end; pos += 4) {
+    sidecar->chunk_crcs.push_back(
+        static_cast<uint32_t>(internal::GetLe(bytes.data() + pos, 4)));
+  }
+  return true;
+}
+
+std::vector<size_t> FindCorruptChunks(const uint8_t* data,
+                                      size_t size,
+                                      const ChecksumSidecar& sidecar,
+                                      ThreadPool* pool) {
+  std::vector<size_t> corrupt;
+  std::mutex m;
+  size_t chunk_size = std::max<size_t>(sidecar.chunk_size, 1);
+  size_t count = sidecar.chunk_crcs.size();
+  auto check = [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      size_t offset = i * chunk_size;
+      // Only the last chunk of a complete stream may be short.
+      uint64_t expected_size = chunk_size;
+      if (sidecar.complete && i + 1 == count) {
+        expected_size =
+            sidecar.total_size > offset ? sidecar.total_size - offset : 0;
+      }
+      if (expected_size == 0 || expected_size > chunk_size ||
+          offset + expected_size > size ||
+          Crc32c(data + offset, static_cast<size_t>(expected_size)) !=
+              sidecar.chunk_crcs[i]) {
+        std::unique_lock<std::mutex> lock(m);
+        corrupt.push_back(i);
+      }
+    }
+  };
+  if (pool) {
+    pool->ParallelFor(0, count, 1, check);
+  } else {
+    check(0, count);
+  }
+  std::sort(corrupt.begin(), corrupt.end());
+  return corrupt;
+}
+
+}  // namespace storage
+}  // namespace base
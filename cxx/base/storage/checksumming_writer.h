@@ -0,0 +1,95 @@
+#ifndef CXX_BASE_STORAGE_CHECKSUMMING_WRITER_H_
+#define CXX_BASE_STORAGE_CHECKSUMMING_WRITER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "writer.h"
+
+namespace base {
+
+class ThreadPool;
+
+namespace storage {
+
+struct ChecksumOptions {
+  // Bytes of the stream covered by each checksum. Smaller chunks narrow down
+  // where damage is, at 4 bytes of sidecar per chunk.
+  size_t chunk_size = 4 * 1024 * 1024;
+};
+
+// Passes everything through to |output| while writing a CRC-32C for every
+// chunk of the stream to |sidecar|. The sidecar holds a small header, one
+// little endian CRC per chunk as each chunk completes, and on Close the total
+// size and the CRC of the whole stream.
+class ChecksummingWriter : public Writer {
+ public:
+  ChecksummingWriter(std::unique_ptr<Writer> output,
+                     std::unique_ptr<Writer> sidecar,
+                     const ChecksumOptions& options = {});
+  ~ChecksummingWriter();
+  ChecksummingWriter(const ChecksummingWriter&) = delete;
+  ChecksummingWriter& operator=(const ChecksummingWriter&) = delete;
+
+  void Write(const uint8_t* data, size_t size) override;
+
+  void WriteV(std::span<const WriteBuffer> buffers) override;
+
+  void Flush() override;
+
+  void MarkSyncPoint() override;
+
+  // What |output| reports, the sidecar aside.
+  std::optional<uint64_t> CommittedBytes() const override;
+
+  void Close() override;
+
+  uint64_t TotalBytes() const { return total_bytes_; }
+
+  // CRC-32C of everything written so far.
+  uint32_t StreamCrc() const;
+
+ private:
+  void Update(const uint8_t* data, size_t size);
+
+  void FinishChunk();
+
+  std::unique_ptr<Writer> output_;
+  std::unique_ptr<Writer> sidecar_;
+  ChecksumOptions options_;
+  uint32_t chunk_crc_ = 0;
+  size_t chunk_fill_ = 0;
+  uint32_t stream_crc_ = 0;
+  uint64_t total_bytes_ = 0;
+  bool closed_ = false;
+};
+
+struct ChecksumSidecar {
+  uint32_t chunk_size = 0;
+  std::vector<uint32_t> chunk_crcs;
+  // False if the writer was never closed, in which case only whole chunks
+  // are listed and the totals below are unknown.
+  bool complete = false;
+  uint64_t total_size = 0;
+  uint32_t stream_crc = 0;
+};
+
+// Returns false if the file can't be read or isn't a checksum sidecar.
+bool ReadChecksumSidecar(const std::string& path, ChecksumSidecar* sidecar);
+
+// Checks |data| against the sidecar and returns the indices of the chunks
+// that don't match, including chunks the data is too short to contain.
+// Chunks are checked in parallel on |pool| if one is given.
+std::vector<size_t> FindCorruptChunks(const uint8_t* data,
+                                      size_t size,
+                                      const ChecksumSidecar& sidecar,
+                                      ThreadPool* pool = nullptr);
+
+}  // namespace storage
+}  // namespace base
+
+#endif  // CXX_BASE_STORAGE_CHECKSUMMING_WRITER_H_
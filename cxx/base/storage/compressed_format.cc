@@ -0,0 +1,101 @@
+#include "compressed_format.h"
+
+#include <lz4.h>
+#include <lz4hc.h>
+#include <zstd.h>
+
+#include <memory>
+
+namespace base {
+namespace storage {
+namespace internal {
+
+namespace {
+
+struct ZstdCCtxFree {
+  void operator()(ZSTD_CCtx* ctx) const { ZSTD_freeCCtx(ctx); }
+};
+
+struct ZstdDCtxFree {
+  void operator()(ZSTD_DCtx* ctx) const { ZSTD_freeDCtx(ctx); }
+};
+
+// Contexts are reused per thread, since setting one up costs about as much
+// as compressing a small block.
+ZSTD_CCtx* ThreadCCtx() {
+  thread_local std::unique_ptr<ZSTD_CCtx, ZstdCCtxFree> ctx(ZSTD_createCCtx());
+  return ctx.get();
+}
+
+ZSTD_DCtx* ThreadDCtx() {
+  thread_local std::unique_ptr<ZSTD_DCtx, ZstdDCtxFree> ctx(ZSTD_createDCtx());
+  return ctx.get();
+}
+
+}  // namespace
+
+bool CompressBlock(CompressionCodec codec,
+                   int level,
+                   const uint8_t* data,
+                   size_t size,
+                   std::vector<uint8_t>* out) {
+  switch (codec) {
+    case CompressionCodec::kNone:
+      return false;
+    case CompressionCodec::kLz4: {
+      int bound = LZ4_compressBound(static_cast<int>(size));
+      out->resize(bound);
+      const char* src = reinterpret_cast<const char*>(data);
+      char* dst = reinterpret_cast<char*>(out->data());
+      int written =
+          level > 1
+              ? LZ4_compress_HC(src, dst, static_cast<int>(size), bound, level)
+              : LZ4_compress_default(src, dst, static_cast<int>(size), bound);
+      if (written <= 0 || static_cast<size_t>(written) >= size) {
+        return false;
+      }
+      out->resize(written);
+      return true;
+    }
+    case CompressionCodec::kZstd: {
+      out->resize(ZSTD_compressBound(size));
+      size_t written =
+          ZSTD_compressCCtx(ThreadCCtx(), out->data(), out->size(), data, size,
+                            level == 0 ? ZSTD_CLEVEL_DEFAULT : level);
+      if (ZSTD_isError(written) || written >= size) {
+        return false;
+      }
+      out->resize(written);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool DecompressBlock(CompressionCodec codec,
+                     const uint8_t* data,
+                     size_t size,
+                     uint8_t* out,
+                     size_t raw_size) {
+  switch (codec) {
+    case CompressionCodec::kNone:
+      return false;
+    case CompressionCodec::kLz4: {
+      int read = LZ4_decompress_safe(reinterpret_cast<const char*>(data),
+                                     reinterpret_cast<char*>(out),
+                                     static_cast<int>(size),
+                                     static_cast<int>(raw_size));
+      return read >= 0 && static_cast<size_t>(read) == raw_size;
+    }
+    case CompressionCodec::kZstd: {
+      size_t read =
+          ZSTD_decompressDCtx(ThreadDCtx(), out, raw_size, data, size);
+      return !ZSTD_isError(read) && read == raw_size;
+    }
+  }
+  return false;
+}
+
+}  // namespace internal
+}  // namespace storage
+}  // namespace base
@@ -0,0 +1,69 @@
+#ifndef CXX_BASE_STORAGE_COMPRESSED_FORMAT_H_
+#define CXX_BASE_STORAGE_COMPRESSED_FORMAT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "endian.h"
+
+namespace base {
+namespace storage {
+
+enum class CompressionCodec : uint8_t {
+  kNone = 0,
+  kLz4 = 1,
+  kZstd = 2,
+};
+
+namespace internal {
+
+// Layout of a compressed stream, all integers little endian:
+//
+//   header:  "MCZB" u8 version, u8 codec, u16 reserved, u32 block_size
+//   blocks:  u32 stored_size, u32 raw_size, u32 flags, payload
+//   index:   a block flagged kIndexBlock holding one IndexEntry per block
+//   footer:  u64 index offset, u32 block count, "MCZE"
+//
+// Each block is compressed on its own, so blocks can be decompressed in
+// parallel or individually. The index and footer are written on Close. A
+// stream without them can still be read by walking the block headers.
+constexpr uint8_t kStreamMagic[4] = {'M', 'C', 'Z', 'B'};
+constexpr uint8_t kFooterMagic[4] = {'M', 'C', 'Z', 'E'};
+constexpr uint8_t kFormatVersion = 1;
+constexpr size_t kStreamHeaderSize = 12;
+constexpr size_t kBlockHeaderSize = 12;
+constexpr size_t kIndexEntrySize = 16;
+constexpr size_t kFooterSize = 16;
+
+// The payload is the raw data, compressing it didn't help.
+constexpr uint32_t kStoredBlock = 1;
+constexpr uint32_t kIndexBlock = 2;
+
+struct IndexEntry {
+  // Position of the block header in the stream.
+  uint64_t offset = 0;
+  uint32_t raw_size = 0;
+  uint32_t stored_size = 0;
+};
+
+// Compresses |size| bytes into |out|. Returns false if the codec failed or
+// the result wasn't any smaller, in which case the block should be stored.
+bool CompressBlock(CompressionCodec codec,
+                   int level,
+                   const uint8_t* data,
+                   size_t size,
+                   std::vector<uint8_t>* out);
+
+// Decompresses into exactly |raw_size| bytes at |out|.
+bool DecompressBlock(CompressionCodec codec,
+                     const uint8_t* data,
+                     size_t size,
+                     uint8_t* out,
+                     size_t raw_size);
+
+}  // namespace internal
+}  // namespace storage
+}  // namespace base
+
+#endif  // CXX_BASE_STORAGE_COMPRESSED_FORMAT_H_
@@ -0,0 +1,184 @@
+#include "compressed_reader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+namespace base {
+namespace storage {
+
+namespace {
+
+bool ReadBytes(std::ifstream* file, uint64_t offset, uint8_t* data,
+               size_t size) {
+  file->clear();
+  file->seekg(static_cast<std::streamoff>(offset));
+  file->read(reinterpret_cast<char*>(data), size);
+  return static_cast<size_t>(file->gcount()) == size;
+}
+
+}  // namespace
+
+CompressedReader::CompressedReader(const char* filename)
+    : file_(filename, std::ios::binary) {
+  uint8_t header[internal::kStreamHeaderSize];
+  if (!file_.is_open() || !ReadBytes(&file_, 0, header, sizeof(header)) ||
+      !std::equal(std::begin(internal::kStreamMagic),
+                  std::end(internal::kStreamMagic), header) ||
+      header[4] != internal::kFormatVersion) {
+    failed_ = true;
+    return;
+  }
+  codec_ = static_cast<CompressionCodec>(header[5]);
+  file_.clear();
+  file_.seekg(0, std::ios::end);
+  uint64_t file_size = static_cast<uint64_t>(file_.tellg());
+  if (!ReadIndex(file_size)) {
+    ScanBlocks(file_size);
+  }
+  raw_starts_.push_back(0);
+  for (const auto& block : blocks_) {
+    raw_starts_.push_back(raw_starts_.back() + block.raw_size);
+  }
+}
+
+bool CompressedReader::ReadBlock(size_t block, std::vector<uint8_t>* out) {
+  if (block >= blocks_.size() || !ReadStored(block, &stored_)) {
+    return false;
+  }
+  const internal::IndexEntry& entry = blocks_[block];
+  uint8_t header[internal::kBlockHeaderSize];
+  std::memcpy(header, stored_.data(), sizeof(header));
+  uint32_t flags = static_cast<uint32_t>(internal::GetLe(header + 8, 4));
+  const uint8_t* payload = stored_.data() + sizeof(header);
+  if (flags & internal::kStoredBlock) {
+    out->assign(payload, payload + entry.stored_size);
+    return entry.stored_size == entry.raw_size;
+  }
+  out->resize(entry.raw_size);
+  return internal::DecompressBlock(codec_, payload, entry.stored_size,
+                                   out->data(), entry.raw_size);
+}
+
+size_t CompressedReader::ReadAt(uint64_t offset, uint8_t* data, size_t size) {
+  size_t copied = 0;
+  while (copied < size && offset < Size()) {
+    size_t block = static_cast<size_t>(
+        std::upper_bound(raw_starts_.begin(), raw_starts_.end(), offset) -
+        raw_starts_.begin() - 1);
+    if (block != cached_block_) {
+      if (!ReadBlock(block, &cached_)) {
+        cached_block_ = SIZE_MAX;
+        break;
+      }
+      cached_block_ = block;
+    }
+    size_t in_block = static_cast<size_t>(offset - raw_starts_[block]);
+    size_t n = std::min(size - copied, cached_.size() - in_block);
+    std::memcpy(data + copied, cached_.data() + in_block, n);
+    copied += n;
+    offset += n;
+  }
+  return copied;
+}
+
+bool CompressedReader::ReadAll(std::vector<uint8_t>* out, ThreadPool* pool) {
+  if (failed_) {
+    return false;
+  }
+  if (!pool) {
+    pool = ThreadPool::GetDefault();
+  }
+  // Read everything up front in one pass, the file handle can't be shared
+  // between threads.
+  std::vector<std::vector<uint8_t>> stored(blocks_.size());
+  for (size_t i = 0; i < blocks_.size(); i++) {
+    if (!ReadStored(i, &stored[i])) {
+      return false;
+    }
+  }
+  out->resize(Size());
+  std::atomic<bool> ok = true;
+  pool->ParallelFor(0, blocks_.size(), 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const internal::IndexEntry& entry = blocks_[i];
+      const uint8_t* header = stored[i].data();
+      const uint8_t* payload = header + internal::kBlockHeaderSize;
+      uint8_t* dst = out->data() + raw_starts_[i];
+      if (internal::GetLe(header + 8, 4) & internal::kStoredBlock) {
+        if (entry.stored_size != entry.raw_size) {
+          ok = false;
+          continue;
+        }
+        std::memcpy(dst, payload, entry.raw_size);
+      } else if (!internal::DecompressBlock(codec_, payload, entry.stored_size,
+                                            dst, entry.raw_size)) {
+        ok = false;
+      }
+    }
+  });
+  return ok;
+}
+
+bool CompressedReader::ReadIndex(uint64_t file_size) {
+  uint8_t footer[internal::kFooterSize];
+  if (file_size < internal::kStreamHeaderSize + internal::kFooterSize ||
+      !ReadBytes(&file_, file_size - sizeof(footer), footer, sizeof(footer)) ||
+      !std::equal(std::begin(internal::kFooterMagic),
+                  std::end(internal::kFooterMagic), footer + 12)) {
+    return false;
+  }
+  uint64_t index_offset = internal::GetLe(footer, 8);
+  uint64_t count = internal::GetLe(footer + 8, 4);
+  uint64_t index_size = count * internal::kIndexEntrySize;
+  if (index_offset + internal::kBlockHeaderSize + index_size +
+          internal::kFooterSize !=
+      file_size) {
+    return false;
+  }
+  std::vector<uint8_t> index(internal::kBlockHeaderSize + index_size);
+  if (!ReadBytes(&file_, index_offset, index.data(), index.size()) ||
+      !(internal::GetLe(index.data() + 8, 4) & internal::kIndexBlock)) {
+    return false;
+  }
+  blocks_.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t* entry = index.data() + internal::kBlockHeaderSize +
+                           i * internal::kIndexEntrySize;
+    blocks_[i].offset = internal::GetLe(entry, 8);
+    blocks_[i].raw_size = static_cast<uint32_t>(internal::GetLe(entry + 8, 4));
+    blocks_[i].stored_size =
+        static_cast<uint32_t>(internal::GetLe(entry + 12, 4));
+  }
+  return true;
+}
+
+void CompressedReader::ScanBlocks(uint64_t file_size) {
+  blocks_.clear();
+  uint64_t offset = internal::kStreamHeaderSize;
+  uint8_t header[internal::kBlockHeaderSize];
+  while (offset + sizeof(header) <= file_size &&
+         ReadBytes(&file_, offset, header, sizeof(header))) {
+    internal::IndexEntry entry;
+    entry.offset = offset;
+    entry.stored_size = static_cast<uint32_t>(internal::GetLe(header, 4));
+    entry.raw_size = static_cast<uint32_t>(internal::GetLe(header + 4, 4));
+    uint32_t flags = static_cast<uint32_t>(internal::GetLe(header + 8, 4));
+    if ((flags & internal::kIndexBlock) ||
+        offset + sizeof(header) + entry.stored_size > file_size) {
+      break;
+    }
+    blocks_.push_back(entry);
+    offset += sizeof(header) + entry.stored_size;
+  }
+}
+
+bool CompressedReader::ReadStored(size_t block,
+                                  std::vector<uint8_t>* stored) {
+  const internal::IndexEntry& entry = blocks_[block];
+  stored->resize(internal::kBlockHeaderSize + entry.stored_size);
+  return ReadBytes(&file_, entry.offset, stored->data(), stored->size());
+}
+
+}  // namespace storage
+}  // namespace base
@@ -0,0 +1,68 @@
+#ifndef CXX_BASE_STORAGE_COMPRESSED_READER_H_
+#define CXX_BASE_STORAGE_COMPRESSED_READER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <vector>
+
+#include "base/thread_pool.h"
+#include "compressed_format.h"
+
+namespace base {
+namespace storage {
+
+// Reads a file written through CompressingWriter. Blocks are located from the
+// index at the end of the file, or by walking the block headers if the writer
+// never got to close it, in which case a partly written last block is
+// skipped.
+class CompressedReader {
+ public:
+  explicit CompressedReader(const char* filename);
+  CompressedReader(const CompressedReader&) = delete;
+  CompressedReader& operator=(const CompressedReader&) = delete;
+
+  // True if the file couldn't be opened or isn't a compressed stream.
+  bool Failed() const { return failed_; }
+
+  CompressionCodec Codec() const { return codec_; }
+
+  // Uncompressed size of the whole stream.
+  uint64_t Size() const { return raw_starts_.empty() ? 0 : raw_starts_.back(); }
+
+  size_t NumBlocks() const { return blocks_.size(); }
+
+  // Decompresses one block into |out|.
+  bool ReadBlock(size_t block, std::vector<uint8_t>* out);
+
+  // Copies up to |size| uncompressed bytes starting at |offset| into |data|,
+  // decompressing only the blocks that overlap them. Returns the number of
+  // bytes copied, short at the end of the stream or on a corrupt block.
+  size_t ReadAt(uint64_t offset, uint8_t* data, size_t size);
+
+  // Decompresses the whole stream into |out|, spreading the blocks over
+  // |pool|, or the default pool if null.
+  bool ReadAll(std::vector<uint8_t>* out, ThreadPool* pool = nullptr);
+
+ private:
+  bool ReadIndex(uint64_t file_size);
+
+  void ScanBlocks(uint64_t file_size);
+
+  bool ReadStored(size_t block, std::vector<uint8_t>* stored);
+
+  std::ifstream file_;
+  bool failed_ = false;
+  CompressionCodec codec_ = CompressionCodec::kNone;
+  std::vector<internal::IndexEntry> blocks_;
+  // Uncompressed offset of each block, plus the total at the end.
+  std::vector<uint64_t> raw_starts_;
+  std::vector<uint8_t> stored_;
+  std::vector<uint8_t> cached_;
+  size_t cached_block_ = SIZE_MAX;
+};
+
+}  // namespace storage
+}  // namespace base
+
+#endif  // CXX_BASE_STORAGE_COMPRESSED_READER_H_
@@ -0,0 +1,151 @@
+#include "compressing_writer.h"
+
+#include <algorithm>
+
+namespace base {
+namespace storage {
+
+CompressingWriter::CompressingWriter(std::unique_ptr<Writer> output,
+                                     const CompressionOptions& options)
+    : output_(std::move(output)),
+      options_(options),
+      pool_(options.pool ? options.pool : ThreadPool::GetDefault()) {
+  options_.block_size = std::max<size_t>(options_.block_size, 1);
+  if (options_.max_blocks_in_flight == 0) {
+    options_.max_blocks_in_flight = 2 * pool_->NumThreads();
+  }
+  uint8_t header[internal::kStreamHeaderSize] = {};
+  std::copy(std::begin(internal::kStreamMagic),
+            std::end(internal::kStreamMagic), header);
+  header[4] = internal::kFormatVersion;
+  header[5] = static_cast<uint8_t>(options_.codec);
+  internal::PutLe(options_.block_size, 4, header + 8);
+  output_->Write(header, sizeof(header));
+  offset_ = sizeof(header);
+}
+
+CompressingWriter::~CompressingWriter() {
+  Close();
+}
+
+void CompressingWriter::Write(const uint8_t* data, size_t size) {
+  if (closed_) {
+    return;
+  }
+  raw_bytes_ += size;
+  while (size > 0) {
+    if (!current_) {
+      if (spare_.empty()) {
+        current_ = std::make_unique<Block>();
+        current_->raw.reserve(options_.block_size);
+      } else {
+        current_ = std::move(spare_.back());
+        spare_.pop_back();
+      }
+    }
+    size_t n = std::min(size, options_.block_size - current_->raw.size());
+    current_->raw.insert(current_->raw.end(), data, data + n);
+    data += n;
+    size -= n;
+    if (current_->raw.size() == options_.block_size) {
+      SubmitBlock();
+    }
+  }
+}
+
+void CompressingWriter::Flush() {
+  if (closed_) {
+    return;
+  }
+  SubmitBlock();
+  WriteAllBlocks();
+  output_->Flush();
+}
+
+void CompressingWriter::Close() {
+  if (closed_) {
+    return;
+  }
+  closed_ = true;
+  SubmitBlock();
+  WriteAllBlocks();
+
+  uint64_t index_offset = offset_;
+  std::vector<uint8_t> index(index_.size() * internal::kIndexEntrySize);
+  for (size_t i = 0; i < index_.size(); i++) {
+    uint8_t* entry = index.data() + i * internal::kIndexEntrySize;
+    internal::PutLe(index_[i].offset, 8, entry);
+    internal::PutLe(index_[i].raw_size, 4, entry + 8);
+    internal::PutLe(index_[i].stored_size, 4, entry + 12);
+  }
+  WriteBlock(internal::kIndexBlock, index.data(), index.size(), 0);
+
+  uint8_t footer[internal::kFooterSize];
+  internal::PutLe(index_offset, 8, footer);
+  internal::PutLe(index_.size(), 4, footer + 8);
+  std::copy(std::begin(internal::kFooterMagic),
+            std::end(internal::kFooterMagic), footer + 12);
+  output_->Write(footer, sizeof(footer));
+  offset_ += sizeof(footer);
+  output_->Close();
+}
+
+void CompressingWriter::SubmitBlock() {
+  if (!current_ || current_->raw.empty()) {
+    return;
+  }
+  if (in_flight_.size() >= options_.max_blocks_in_flight) {
+    WriteOldestBlock();
+  }
+  Block* block = current_.get();
+  block->task = std::make_unique<TaskGroup>(pool_);
+  block->task->Run([block, codec = options_.codec, level = options_.level] {
+    block->stored = !internal::CompressBlock(codec, level, block->raw.data(),
+                                             block->raw.size(),
+                                             &block->compressed);
+  });
+  in_flight_.push_back(std::move(current_));
+}
+
+void CompressingWriter::WriteOldestBlock() {
+  std::unique_ptr<Block> block = std::move(in_flight_.front());
+  in_flight_.pop_front();
+  block->task->Wait();
+  block->task.reset();
+  if (block->stored) {
+    WriteBlock(internal::kStoredBlock, block->raw.data(), block->raw.size(),
+               block->raw.size());
+  } else {
+    WriteBlock(0, block->compressed.data(), block->compressed.size(),
+               block->raw.size());
+  }
+  block->raw.clear();
+  block->compressed.clear();
+  spare_.push_back(std::move(block));
+}
+
+void CompressingWriter::WriteAllBlocks() {
+  while (!in_flight_.empty()) {
+    WriteOldestBlock();
+  }
+}
+
+void CompressingWriter::WriteBlock(uint32_t flags,
+                                   const uint8_t* payload,
+                                   size_t payload_size,
+                                   size_t raw_size) {
+  uint8_t header[internal::kBlockHeaderSize];
+  internal::PutLe(payload_size, 4, header);
+  internal::PutLe(raw_size, 4, header + 4);
+  internal::PutLe(flags, 4, header + 8);
+  WriteBuffer buffers[] = {{header, sizeof(header)}, {payload, payload_size}};
+  output_->WriteV(buffers);
+  if (!(flags & internal::kIndexBlock)) {
+    index_.push_back({offset_, static_cast<uint32_t>(raw_size),
+                      static_cast<uint32_t>(payload_size)});
+  }
+  offset_ += sizeof(header) + payload_size;
+}
+
+}  // namespace storage
+}  // namespace base
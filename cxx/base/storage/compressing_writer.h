@@ -0,0 +1,90 @@
+#ifndef CXX_BASE_STORAGE_COMPRESSING_WRITER_H_
+#define CXX_BASE_STORAGE_COMPRESSING_WRITER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "base/thread_pool.h"
+#include "compressed_format.h"
+#include "writer.h"
+
+namespace base {
+namespace storage {
+
+struct CompressionOptions {
+  CompressionCodec codec = CompressionCodec::kZstd;
+  // For Zstd the compression level, 0 meaning its default. For LZ4 levels
+  // above 1 switch to LZ4HC at that level.
+  int level = 0;
+  // Uncompressed size of each block. Larger blocks compress better, smaller
+  // ones give finer random access.
+  size_t block_size = 1024 * 1024;
+  // Blocks being compressed at once. 0 means twice the pool's threads. Write
+  // blocks once this many are waiting to go out.
+  size_t max_blocks_in_flight = 0;
+  // Pool to compress on, the default pool if null.
+  ThreadPool* pool = nullptr;
+};
+
+// Compresses everything written to it in independent blocks, compressing
+// several blocks at once on a thread pool and passing them to |output| in
+// order. Read the result back with CompressedReader.
+class CompressingWriter : public Writer {
+ public:
+  CompressingWriter(std::unique_ptr<Writer> output,
+                    const CompressionOptions& options = {});
+  ~CompressingWriter();
+  CompressingWriter(const CompressingWriter&) = delete;
+  CompressingWriter& operator=(const CompressingWriter&) = delete;
+
+  void Write(const uint8_t* data, size_t size) override;
+
+  // Ends the current block early and waits until every block has been passed
+  // on to the output before flushing it.
+  void Flush() override;
+
+  // Writes the block index after the last block and closes the output.
+  void Close() override;
+
+  uint64_t RawBytes() const { return raw_bytes_; }
+
+  uint64_t CompressedBytes() const { return offset_; }
+
+ private:
+  struct Block {
+    std::vector<uint8_t> raw;
+    std::vector<uint8_t> compressed;
+    bool stored = false;
+    std::unique_ptr<TaskGroup> task;
+  };
+
+  void SubmitBlock();
+
+  void WriteOldestBlock();
+
+  void WriteAllBlocks();
+
+  void WriteBlock(uint32_t flags,
+                  const uint8_t* payload,
+                  size_t payload_size,
+                  size_t raw_size);
+
+  std::unique_ptr<Writer> output_;
+  CompressionOptions options_;
+  ThreadPool* pool_;
+  std::unique_ptr<Block> current_;
+  std::deque<std::unique_ptr<Block>> in_flight_;
+  std::vector<std::unique_ptr<Block>> spare_;
+  std::vector<internal::IndexEntry> index_;
+  uint64_t offset_ = 0;
+  uint64_t raw_bytes_ = 0;
+  bool closed_ = false;
+};
+
+}  // namespace storage
+}  // namespace base
+
+#endif  // CXX_BASE_STORAGE_COMPRESSING_WRITER_H_
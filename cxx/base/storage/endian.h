@@ -0,0 +1,31 @@
+#ifndef CXX_BASE_STORAGE_ENDIAN_H_
+#define CXX_BASE_STORAGE_ENDIAN_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace base {
+namespace storage {
+namespace internal {
+
+// Little endian integers of |bytes| bytes, as used by every on-disk format in
+// base/storage regardless of the host's byte order.
+inline void PutLe(uint64_t value, size_t bytes, uint8_t* out) {
+  for (size_t i = 0; i < bytes; i++) {
+    out[i] = static_cast<uint8_t>(value >> (8 * i));
+  }
+}
+
+inline uint64_t GetLe(const uint8_t* in, size_t bytes) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < bytes; i++) {
+    value |= static_cast<uint64_t>(in[i]) << (8 * i);
+  }
+  return value;
+}
+
+}  // namespace internal
+}  // namespace storage
+}  // namespace base
+
+#endif  // CXX_BASE_STORAGE_ENDIAN_H_
@@ -1,21 +1,112 @@
 #include "file_writer.h"
 
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+#endif
+
 namespace base {
 namespace storage {
 
+#if defined(_WIN32)
+
 FileWriter::FileWriter(const char* filename) {
   output_file_.open(filename, std::ifstream::binary | std::ifstream::out);
 }
 
 FileWriter::~FileWriter() {}
 
-void FileWriter::Write(uint8_t* data, size_t size) {
-  output_file_.write(reinterpret_cast<char*>(data), size);
+void FileWriter::Write(const uint8_t* data, size_t size) {
+  output_file_.write(reinterpret_cast<const char*>(data), size);
+}
+
+void FileWriter::WriteV(std::span<const WriteBuffer> buffers) {
+  for (const auto& b : buffers) {
+    Write(b.data, b.size);
+  }
+}
+
+void FileWriter::Flush() {
+  output_file_.flush();
 }
 
 void FileWriter::Close() {
   output_file_.close();
 }
 
+#else
+
+FileWriter::FileWriter(const char* filename) {
+  fd_ = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+}
+
+FileWriter::~FileWriter() {
+  Close();
+}
+
+void FileWriter::Write(const uint8_t* data, size_t size) {
+  while (fd_ >= 0 && size > 0) {
+    ssize_t written = write(fd_, data, size);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+    data += written;
+    size -= written;
+  }
+}
+
+void FileWriter::WriteV(std::span<const WriteBuffer> buffers) {
+  if (fd_ < 0) {
+    return;
+  }
+  std::vector<iovec> iov(buffers.size());
+  for (size_t i = 0; i < buffers.size(); i++) {
+    iov[i].iov_base = const_cast<uint8_t*>(buffers[i].data);
+    iov[i].iov_len = buffers[i].size;
+  }
+  size_t next = 0;
+  while (next < iov.size()) {
+    int count = static_cast<int>(std::min<size_t>(iov.size() - next, IOV_MAX));
+    ssize_t written = writev(fd_, &iov[next], count);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+    // Skip whatever was fully written and trim a partially written buffer.
+    size_t remaining = static_cast<size_t>(written);
+    while (next < iov.size() && remaining >= iov[next].iov_len) {
+      remaining -= iov[next].iov_len;
+      next++;
+    }
+    if (remaining > 0) {
+      iov[next].iov_base =
+          static_cast<uint8_t*>(iov[next].iov_base) + remaining;
+      iov[next].iov_len -= remaining;
+    }
+  }
+}
+
+void FileWriter::Flush() {
+  // Writes go straight to the kernel, there is nothing buffered here.
+}
+
+void FileWriter::Close() {
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+#endif
+
 }  // namespace storage
-}  // namespace base
\ No newline at end of file
+}  // namespace base
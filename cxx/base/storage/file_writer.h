@@ -1,7 +1,9 @@
 #ifndef CXX_BASE_STORAGE_FILE_WRITER_H_
 #define CXX_BASE_STORAGE_FILE_WRITER_H_
 
+#if defined(_WIN32)
 #include <fstream>
+#endif
 #include "writer.h"
 
 namespace base {
@@ -14,15 +16,23 @@ class FileWriter : public Writer {
   FileWriter(const FileWriter&) = delete;
   FileWriter& operator=(const FileWriter&) = delete;
 
-  void Write(uint8_t* data, size_t size) override;
+  void Write(const uint8_t* data, size_t size) override;
+
+  void WriteV(std::span<const WriteBuffer> buffers) override;
+
+  void Flush() override;
 
   void Close() override;
 
  private:
+#if defined(_WIN32)
   std::ofstream output_file_;
+#else
+  int fd_;
+#endif
 };
 
 }  // namespace storage
 }  // namespace base
 
-#endif  // CXX_BASE_STORAGE_FILE_WRITER_H_
\ No newline at end of file
+#endif  // CXX_BASE_STORAGE_FILE_WRITER_H_
@@ -0,0 +1,171 @@
+#include "mapped_file_reader.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+namespace base {
+namespace storage {
+
+#if defined(_WIN32)
+
+MappedFileReader::MappedFileReader(const char* filename,
+                                   AccessPattern pattern) {
+  DWORD flags = FILE_ATTRIBUTE_NORMAL;
+  if (pattern == AccessPattern::kSequential) {
+    flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+  } else if (pattern == AccessPattern::kRandom) {
+    flags |= FILE_FLAG_RANDOM_ACCESS;
+  }
+  HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                            OPEN_EXISTING, flags, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    failed_ = true;
+    return;
+  }
+  file_ = file;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size)) {
+    failed_ = true;
+    return;
+  }
+  size_ = static_cast<uint64_t>(size.QuadPart);
+  if (size_ == 0) {
+    // Empty files can't be mapped, and there is nothing to map anyway.
+    return;
+  }
+  mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping_) {
+    failed_ = true;
+    return;
+  }
+  data_ = static_cast<const uint8_t*>(
+      MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  if (!data_) {
+    failed_ = true;
+  }
+}
+
+void MappedFileReader::Close() {
+  if (data_) {
+    UnmapViewOfFile(data_);
+    data_ = nullptr;
+  }
+  if (mapping_) {
+    CloseHandle(mapping_);
+    mapping_ = nullptr;
+  }
+  if (file_) {
+    CloseHandle(file_);
+    file_ = nullptr;
+  }
+  size_ = 0;
+  position_ = 0;
+}
+
+void MappedFileReader::WillNeed(uint64_t offset, uint64_t size) {
+  if (!data_ || offset >= size_) {
+    return;
+  }
+  WIN32_MEMORY_RANGE_ENTRY range;
+  range.VirtualAddress = const_cast<uint8_t*>(data_ + offset);
+  range.NumberOfBytes = static_cast<SIZE_T>(std::min(size, size_ - offset));
+  PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+#else
+
+MappedFileReader::MappedFileReader(const char* filename,
+                                   AccessPattern pattern) {
+  int fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    failed_ = true;
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    failed_ = true;
+    return;
+  }
+  size_ = static_cast<uint64_t>(st.st_size);
+  if (size_ > 0) {
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      failed_ = true;
+      size_ = 0;
+    } else {
+      data_ = static_cast<const uint8_t*>(data);
+      int advice = MADV_NORMAL;
+      if (pattern == AccessPattern::kSequential) {
+        advice = MADV_SEQUENTIAL;
+      } else if (pattern == AccessPattern::kRandom) {
+        advice = MADV_RANDOM;
+      }
+      madvise(data, size_, advice);
+    }
+  }
+  // The mapping keeps the file alive.
+  close(fd);
+}
+
+void MappedFileReader::Close() {
+  if (data_) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+    data_ = nullptr;
+  }
+  size_ = 0;
+  position_ = 0;
+}
+
+void MappedFileReader::WillNeed(uint64_t offset, uint64_t size) {
+  if (!data_ || offset >= size_) {
+    return;
+  }
+  // madvise wants a page aligned start.
+  uint64_t page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+  uint64_t start = offset / page_size * page_size;
+  uint64_t end = std::min(size_, offset + size);
+  madvise(const_cast<uint8_t*>(data_ + start), end - start, MADV_WILLNEED);
+}
+
+#endif
+
+MappedFileReader::~MappedFileReader() {
+  Close();
+}
+
+size_t MappedFileReader::Read(uint8_t* data, size_t size) {
+  std::span<const uint8_t> next = Next(size);
+  if (!next.empty()) {
+    std::memcpy(data, next.data(), next.size());
+  }
+  return next.size();
+}
+
+std::span<const uint8_t> MappedFileReader::Next(size_t max_size) {
+  size_t n =
+      static_cast<size_t>(std::min<uint64_t>(max_size, size_ - position_));
+  std::span<const uint8_t> next(data_ + position_, n);
+  position_ += n;
+  return next;
+}
+
+bool MappedFileReader::Seek(uint64_t offset) {
+  if (offset > size_) {
+    return false;
+  }
+  position_ = offset;
+  return true;
+}
+
+}  // namespace storage
+}  // namespace base
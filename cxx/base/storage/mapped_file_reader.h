@@ -0,0 +1,70 @@
+#ifndef CXX_BASE_STORAGE_MAPPED_FILE_READER_H_
+#define CXX_BASE_STORAGE_MAPPED_FILE_READER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "reader.h"
+
+namespace base {
+namespace storage {
+
+// Tells the OS how the file is going to be read, so that it can read ahead
+// aggressively or not at all.
+enum class AccessPattern {
+  kNormal,
+  kSequential,
+  kRandom,
+};
+
+// Maps the whole file into memory, so reads are served straight from the
+// page cache. Data and Next hand out views of the mapping without copying.
+class MappedFileReader : public Reader {
+ public:
+  MappedFileReader(const char* filename,
+                   AccessPattern pattern = AccessPattern::kSequential);
+  ~MappedFileReader();
+  MappedFileReader(const MappedFileReader&) = delete;
+  MappedFileReader& operator=(const MappedFileReader&) = delete;
+
+  size_t Read(uint8_t* data, size_t size) override;
+
+  // The view stays valid until Close, not just until the next call.
+  std::span<const uint8_t> Next(size_t max_size) override;
+
+  bool Seek(uint64_t offset) override;
+
+  uint64_t Position() const override { return position_; }
+
+  uint64_t Size() const override { return size_; }
+
+  void Close() override;
+
+  // The whole file, valid until Close.
+  std::span<const uint8_t> Data() const {
+    return {data_, static_cast<size_t>(size_)};
+  }
+
+  // Asks the OS to start reading the range in the background, ahead of it
+  // being touched.
+  void WillNeed(uint64_t offset, uint64_t size);
+
+  // True if the file couldn't be opened or mapped.
+  bool Failed() const { return failed_; }
+
+ private:
+  const uint8_t* data_ = nullptr;
+  uint64_t size_ = 0;
+  uint64_t position_ = 0;
+  bool failed_ = false;
+#if defined(_WIN32)
+  void* file_ = nullptr;
+  void* mapping_ = nullptr;
+#endif
+};
+
+}  // namespace storage
+}  // namespace base
+
+#endif  // CXX_BASE_STORAGE_MAPPED_FILE_READER_H_
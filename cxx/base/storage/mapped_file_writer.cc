@@ -0,0 +1,133 @@
+#include "mapped_file_writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace base {
+namespace storage {
+
+MappedFileWriter::MappedFileWriter(const char* filename,
+                                   const MappedFileWriterOptions& options)
+    : options_(options) {
+  size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  options_.window_size =
+      std::max(page_size,
+               (options_.window_size + page_size - 1) / page_size * page_size);
+  options_.extent_size =
+      std::max<uint64_t>(options_.extent_size, options_.window_size);
+
+  fd_ = open(filename, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    failed_ = true;
+    return;
+  }
+  if (!MapWindow(0)) {
+    failed_ = true;
+  }
+}
+
+MappedFileWriter::~MappedFileWriter() {
+  Close();
+}
+
+void MappedFileWriter::Write(const uint8_t* data, size_t size) {
+  while (size > 0 && window_) {
+    uint64_t window_used = written_ - window_offset_;
+    if (window_used == options_.window_size) {
+      if (options_.flush_behind) {
+        StartWriteback(window_offset_, options_.window_size);
+      }
+      if (!MapWindow(window_offset_ + options_.window_size)) {
+        failed_ = true;
+        return;
+      }
+      window_used = 0;
+    }
+    size_t n = static_cast<size_t>(
+        std::min<uint64_t>(size, options_.window_size - window_used));
+    memcpy(window_ + window_used, data, n);
+    written_ += n;
+    data += n;
+    size -= n;
+  }
+}
+
+void MappedFileWriter::Flush() {
+  if (window_ && written_ > window_offset_) {
+    StartWriteback(window_offset_, written_ - window_offset_);
+  }
+}
+
+void MappedFileWriter::Close() {
+  if (fd_ < 0) {
+    return;
+  }
+  UnmapWindow();
+  // Drop the preallocated space past the end of the data.
+  if (ftruncate(fd_, static_cast<off_t>(written_)) != 0) {
+    failed_ = true;
+  }
+  close(fd_);
+  fd_ = -1;
+}
+
+bool MappedFileWriter::MapWindow(uint64_t offset) {
+  UnmapWindow();
+  uint64_t needed = std::max(offset + options_.window_size,
+                             std::min<uint64_t>(options_.expected_size,
+                                                offset + options_.extent_size));
+  if (needed > allocated_) {
+    // Mapped pages past the end of the file fault, so the file has to really
+    // be extended rather than just reserved.
+    uint64_t target =
+        std::max(needed, allocated_ + options_.extent_size);
+    int error = posix_fallocate(fd_, static_cast<off_t>(allocated_),
+                                static_cast<off_t>(target - allocated_));
+    // Only a file system that can't preallocate gets a sparse file instead.
+    // Anything else, ENOSPC in particular, would otherwise turn up later as a
+    // SIGBUS in Write.
+    if (error == EOPNOTSUPP || error == EINVAL) {
+      error = ftruncate(fd_, static_cast<off_t>(target)) != 0 ? errno : 0;
+    }
+    if (error != 0) {
+      return false;
+    }
+    allocated_ = target;
+  }
+  void* p = mmap(nullptr, options_.window_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED, fd_, static_cast<off_t>(offset));
+  if (p == MAP_FAILED) {
+    return false;
+  }
+  madvise(p, options_.window_size, MADV_SEQUENTIAL);
+  window_ = static_cast<uint8_t*>(p);
+  window_offset_ = offset;
+  return true;
+}
+
+void MappedFileWriter::UnmapWindow() {
+  if (window_) {
+    munmap(window_, options_.window_size);
+    window_ = nullptr;
+  }
+}
+
+void MappedFileWriter::StartWriteback(uint64_t offset, uint64_t size) {
+#if defined(__linux__)
+  sync_file_range(fd_, static_cast<off_t>(offset), static_cast<off_t>(size),
+                  SYNC_FILE_RANGE_WRITE);
+#else
+  // Without sync_file_range, msync on the live window is the closest option.
+  if (window_) {
+    msync(window_ + (offset - window_offset_), size, MS_ASYNC);
+  }
+#endif
+}
+
+}  // namespace storage
+}  // namespace base
@@ -0,0 +1,65 @@
+#ifndef CXX_BASE_STORAGE_MAPPED_FILE_WRITER_H_
+#define CXX_BASE_STORAGE_MAPPED_FILE_WRITER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "writer.h"
+
+namespace base {
+namespace storage {
+
+struct MappedFileWriterOptions {
+  // The file is grown this much at a time, ahead of the data written.
+  uint64_t extent_size = 64 * 1024 * 1024;
+  // Size of the mapped window that writes are copied into. Rounded up to a
+  // whole number of pages.
+  size_t window_size = 16 * 1024 * 1024;
+  // Reserved up front when the final size is roughly known.
+  uint64_t expected_size = 0;
+  // Start writeback of each window as the writer moves past it, so that dirty
+  // pages don't pile up for the kernel to flush all at once.
+  bool flush_behind = true;
+};
+
+// Writes by copying into a mapped window of a preallocated file, so Write
+// only makes a syscall when the window slides forward. The file is trimmed to
+// the length actually written on Close.
+class MappedFileWriter : public Writer {
+ public:
+  MappedFileWriter(const char* filename,
+                   const MappedFileWriterOptions& options = {});
+  ~MappedFileWriter();
+  MappedFileWriter(const MappedFileWriter&) = delete;
+  MappedFileWriter& operator=(const MappedFileWriter&) = delete;
+
+  void Write(const uint8_t* data, size_t size) override;
+
+  // Starts writeback of what has been written so far without waiting for it.
+  void Flush() override;
+
+  void Close() override;
+
+  // True if the file couldn't be opened, grown or mapped.
+  bool Failed() const { return failed_; }
+
+ private:
+  bool MapWindow(uint64_t offset);
+
+  void UnmapWindow();
+
+  void StartWriteback(uint64_t offset, uint64_t size);
+
+  MappedFileWriterOptions options_;
+  int fd_ = -1;
+  bool failed_ = false;
+  uint64_t allocated_ = 0;
+  uint64_t written_ = 0;
+  uint8_t* window_ = nullptr;
+  uint64_t window_offset_ = 0;
+};
+
+}  // namespace storage
+}  // namespace base
+
+#endif  // CXX_BASE_STORAGE_MAPPED_FILE_WRITER_H_
@@ -0,0 +1,39 @@
+#include "position_file.h"
+
+#include <filesystem>
+#include <fstream>
+
+#include "endian.h"
+
+namespace base {
+namespace storage {
+
+bool ReadPositionFile(const std::string& path, uint64_t* position) {
+  std::ifstream f(path, std::ios::binary);
+  uint8_t bytes[8];
+  if (!f.read(reinterpret_cast<char*>(bytes), sizeof(bytes))) {
+    return false;
+  }
+  *position = internal::GetLe(bytes, sizeof(bytes));
+  return true;
+}
+
+bool SavePositionFile(const std::string& path, uint64_t position) {
+  std::string temp_path = path + ".tmp";
+  {
+    std::ofstream f(temp_path, std::ios::binary | std::ios::trunc);
+    uint8_t bytes[8];
+    internal::PutLe(position, sizeof(bytes), bytes);
+    f.write(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+    f.close();
+    if (!f) {
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(temp_path, path, ec);
+  return !ec;
+}
+
+}  // namespace storage
+}  // namespace base
@@ -0,0 +1,24 @@
+#ifndef CXX_BASE_STORAGE_POSITION_FILE_H_
+#define CXX_BASE_STORAGE_POSITION_FILE_H_
+
+#include <cstdint>
+#include <string>
+
+namespace base {
+namespace storage {
+
+// A single 64 bit little endian position kept in a file of its own, such as
+// how far through a journal delivery has got.
+
+// Returns false if there is no readable position at |path|.
+bool ReadPositionFile(const std::string& path, uint64_t* position);
+
+// Writes to <path>.tmp and renames it over |path|, so that a crash leaves
+// either the old position or the new one, never half of one. Returns false if
+// the position couldn't be saved.
+bool SavePositionFile(const std::string& path, uint64_t position);
+
+}  // namespace storage
+}  // namespace base
+
+#endif  // CXX_BASE_STORAGE_POSITION_FILE_H_
@@ -0,0 +1,37 @@
+#ifndef CXX_BASE_STORAGE_READER_H_
+#define CXX_BASE_STORAGE_READER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace base {
+namespace storage {
+
+class Reader {
+ public:
+  virtual ~Reader() {}
+
+  // Copies up to |size| bytes into |data| and returns how many were copied,
+  // 0 at the end of the data or on an error.
+  virtual size_t Read(uint8_t* data, size_t size) = 0;
+
+  // Returns a view of up to |max_size| of the next bytes without copying
+  // them, and moves past them. The view is only valid until the next call on
+  // the reader, and is empty at the end of the data or on an error.
+  virtual std::span<const uint8_t> Next(size_t max_size) = 0;
+
+  // Moves the read position. Returns false if |offset| is past the end.
+  virtual bool Seek(uint64_t offset) = 0;
+
+  virtual uint64_t Position() const = 0;
+
+  virtual uint64_t Size() const = 0;
+
+  virtual void Close() = 0;
+};
+
+}  // namespace storage
+}  // namespace base
+
+#endif  // CXX_BASE_STORAGE_READER_H_
@@ -0,0 +1,245 @@
+#include "segmenting_writer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+#include "endian.h"
+#include "file_writer.h"
+
+namespace base {
+namespace storage {
+
+namespace {
+
+constexpr uint8_t kIndexMagic[4] = {'M', 'C', 'S', 'I'};
+constexpr uint32_t kIndexVersion = 2;
+constexpr size_t kIndexHeaderSize = 8;
+constexpr size_t kIndexRecordSize = 48;
+// Version 1 records stop before header_size.
+constexpr size_t kIndexRecordSizeV1 = 40;
+
+// A stream that goes this long without a sync point has no header worth
+// repeating.
+constexpr size_t kMaxHeaderSize = 1024 * 1024;
+
+// Record layout: segment u32, flags u32, offset u64, size u64,
+// start_time_us i64, duration_us i64, header_size u64.
+void EncodeRecord(const SegmentInfo& info, uint8_t* out) {
+  internal::PutLe(info.segment, 4, out);
+  internal::PutLe(info.starts_at_sync_point ? 1 : 0, 4, out + 4);
+  internal::PutLe(info.offset, 8, out + 8);
+  internal::PutLe(info.size, 8, out + 16);
+  internal::PutLe(static_cast<uint64_t>(info.start_time_us), 8, out + 24);
+  internal::PutLe(static_cast<uint64_t>(info.duration_us), 8, out + 32);
+  internal::PutLe(info.header_size, 8, out + 40);
+}
+
+SegmentInfo DecodeRecord(const uint8_t* in, size_t size) {
+  SegmentInfo info;
+  info.segment = static_cast<uint32_t>(internal::GetLe(in, 4));
+  info.starts_at_sync_point = (internal::GetLe(in + 4, 4) & 1) != 0;
+  info.offset = internal::GetLe(in + 8, 8);
+  info.size = internal::GetLe(in + 16, 8);
+  info.start_time_us = static_cast<int64_t>(internal::GetLe(in + 24, 8));
+  info.duration_us = static_cast<int64_t>(internal::GetLe(in + 32, 8));
+  if (size >= kIndexRecordSize) {
+    info.header_size = internal::GetLe(in + 40, 8);
+  }
+  return info;
+}
+
+}  // namespace
+
+SegmentWriterFactory FileSegmentFactory(const std::string& prefix,
+                                        const std::string& extension) {
+  return [prefix, extension](uint32_t segment) -> std::unique_ptr<Writer> {
+    char number[16];
+    std::snprintf(number, sizeof(number), "_%05u", segment);
+    std::string filename = prefix + number + extension;
+    return std::make_unique<FileWriter>(filename.c_str());
+  };
+}
+
+SegmentingWriter::SegmentingWriter(SegmentWriterFactory factory,
+                                   std::unique_ptr<Writer> index,
+                                   const SegmentingOptions& options)
+    : factory_(std::move(factory)),
+      index_(std::move(index)),
+      options_(options) {
+  if (index_) {
+    uint8_t header[kIndexHeaderSize];
+    std::copy(std::begin(kIndexMagic), std::end(kIndexMagic), header);
+    internal::PutLe(kIndexVersion, 4, header + 4);
+    index_->Write(header, sizeof(header));
+  }
+}
+
+SegmentingWriter::~SegmentingWriter() {
+  Close();
+}
+
+void SegmentingWriter::Write(const uint8_t* data, size_t size) {
+  if (closed_ || size == 0) {
+    return;
+  }
+  GatherHeader(data, size);
+  BeforeWrite(size);
+  current_->Write(data, size);
+}
+
+void SegmentingWriter::WriteV(std::span<const WriteBuffer> buffers) {
+  size_t total = 0;
+  for (const auto& b : buffers) {
+    total += b.size;
+  }
+  if (closed_ || total == 0) {
+    return;
+  }
+  for (const auto& b : buffers) {
+    GatherHeader(b.data, b.size);
+  }
+  BeforeWrite(total);
+  current_->WriteV(buffers);
+}
+
+void SegmentingWriter::Flush() {
+  if (current_) {
+    current_->Flush();
+  }
+  if (index_) {
+    index_->Flush();
+  }
+}
+
+void SegmentingWriter::MarkSyncPoint() {
+  header_done_ = true;
+  if (!current_) {
+    next_starts_at_sync_point_ = true;
+    return;
+  }
+  if (LimitReached(options_.max_segment_bytes)) {
+    FinishSegment();
+    next_starts_at_sync_point_ = true;
+  } else {
+    current_->MarkSyncPoint();
+  }
+}
+
+void SegmentingWriter::Close() {
+  if (closed_) {
+    return;
+  }
+  closed_ = true;
+  FinishSegment();
+  if (index_) {
+    index_->Close();
+  }
+}
+
+void SegmentingWriter::Roll() {
+  FinishSegment();
+}
+
+bool SegmentingWriter::LimitReached(uint64_t byte_limit) const {
+  if (byte_limit > 0 && current_info_.size >= byte_limit) {
+    return true;
+  }
+  return options_.max_segment_duration.count() > 0 &&
+         std::chrono::steady_clock::now() - current_start_ >=
+             options_.max_segment_duration;
+}
+
+void SegmentingWriter::BeforeWrite(size_t size) {
+  if (current_) {
+    // Writes are never split, so a segment overshoots its limit by at most
+    // the one write that crossed it.
+    bool roll = options_.align_to_sync_points
+                    ? options_.max_segment_bytes > 0 &&
+                          current_info_.size >= 2 * options_.max_segment_bytes
+                    : LimitReached(options_.max_segment_bytes);
+    if (roll) {
+      FinishSegment();
+    }
+  }
+  if (!current_) {
+    current_ = factory_(next_segment_);
+    current_info_ = SegmentInfo();
+    current_info_.segment = next_segment_++;
+    current_info_.starts_at_sync_point = next_starts_at_sync_point_;
+    current_info_.offset = offset_;
+    current_info_.start_time_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+            .count();
+    current_start_ = std::chrono::steady_clock::now();
+    next_starts_at_sync_point_ = false;
+    // The first segment has the header already, as part of the stream.
+    if (options_.repeat_header && header_done_ && offset_ > 0 &&
+        !header_.empty()) {
+      current_->Write(header_.data(), header_.size());
+      current_info_.header_size = header_.size();
+    }
+  }
+  current_info_.size += size;
+  offset_ += size;
+}
+
+void SegmentingWriter::FinishSegment() {
+  if (!current_) {
+    return;
+  }
+  current_->Close();
+  current_.reset();
+  current_info_.duration_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - current_start_)
+          .count();
+  segments_.push_back(current_info_);
+  if (index_) {
+    uint8_t record[kIndexRecordSize];
+    EncodeRecord(current_info_, record);
+    index_->Write(record, sizeof(record));
+  }
+}
+
+void SegmentingWriter::GatherHeader(const uint8_t* data, size_t size) {
+  if (!options_.repeat_header || header_done_) {
+    return;
+  }
+  if (header_.size() + size > kMaxHeaderSize) {
+    header_.clear();
+    header_done_ = true;
+    return;
+  }
+  header_.insert(header_.end(), data, data + size);
+}
+
+bool ReadSegmentIndex(const std::string& path,
+                      std::vector<SegmentInfo>* segments) {
+  std::ifstream f(path, std::ios::binary);
+  if (!f.is_open()) {
+    return false;
+  }
+  std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(f)), {});
+  if (bytes.size() < kIndexHeaderSize ||
+      !std::equal(std::begin(kIndexMagic), std::end(kIndexMagic),
+                  bytes.begin())) {
+    return false;
+  }
+  uint64_t version = internal::GetLe(bytes.data() + 4, 4);
+  if (version != 1 && version != kIndexVersion) {
+    return false;
+  }
+  size_t record_size = version == 1 ? kIndexRecordSizeV1 : kIndexRecordSize;
+  segments->clear();
+  for (size_t pos = kIndexHeaderSize; pos + record_size <= bytes.size();
+       pos += record_size) {
+    segments->push_back(DecodeRecord(bytes.data() + pos, record_size));
+  }
+  return true;
+}
+
+}  // namespace storage
+}  // namespace base
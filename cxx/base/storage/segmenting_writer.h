@@ -0,0 +1,123 @@
+#ifndef CXX_BASE_STORAGE_SEGMENTING_WRITER_H_
+#define CXX_BASE_STORAGE_SEGMENTING_WRITER_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "writer.h"
+
+namespace base {
+namespace storage {
+
+// Creates the writer for segment number |segment|, counting from 0.
+using SegmentWriterFactory =
+    std::function<std::unique_ptr<Writer>(uint32_t segment)>;
+
+// Factory writing segments to files named <prefix>_00000<extension> and so on.
+SegmentWriterFactory FileSegmentFactory(const std::string& prefix,
+                                        const std::string& extension);
+
+struct SegmentingOptions {
+  // Start a new segment once this many bytes have gone into the current one.
+  // 0 means no size limit.
+  uint64_t max_segment_bytes = 0;
+  // Start a new segment once the current one has been open this long. 0 means
+  // no time limit.
+  std::chrono::milliseconds max_segment_duration{0};
+  // Only roll at sync points, so that every segment starts where a reader can
+  // pick up the stream. If no sync point comes by twice the size limit the
+  // writer rolls anyway.
+  bool align_to_sync_points = false;
+  // Take everything written before the first sync point to be the stream's
+  // header, such as a container header, and write it again at the start of
+  // every later segment, so that each one can be opened on its own.
+  bool repeat_header = false;
+};
+
+// One entry of the segment index.
+struct SegmentInfo {
+  uint32_t segment = 0;
+  bool starts_at_sync_point = false;
+  // Position of the segment's first byte in the whole stream.
+  uint64_t offset = 0;
+  uint64_t size = 0;
+  // Bytes of repeated header the segment starts with, ahead of its part of
+  // the stream. Skip them to put the stream back together.
+  uint64_t header_size = 0;
+  // Wall clock time of the first write, in microseconds since the epoch.
+  int64_t start_time_us = 0;
+  int64_t duration_us = 0;
+};
+
+// Splits a stream over a series of writers, rolling over to a new one on a
+// size or time limit. Each finished segment is appended to an index of fixed
+// size little endian records, so the stream can be put back together or
+// searched without opening every segment. Segments are opened on their first
+// write, so a roll never leaves an empty segment behind.
+class SegmentingWriter : public Writer {
+ public:
+  // |index| may be null if no index is wanted.
+  SegmentingWriter(SegmentWriterFactory factory,
+                   std::unique_ptr<Writer> index,
+                   const SegmentingOptions& options = {});
+  ~SegmentingWriter();
+  SegmentingWriter(const SegmentingWriter&) = delete;
+  SegmentingWriter& operator=(const SegmentingWriter&) = delete;
+
+  void Write(const uint8_t* data, size_t size) override;
+
+  void WriteV(std::span<const WriteBuffer> buffers) override;
+
+  void Flush() override;
+
+  // Rolls here if a limit has been reached.
+  void MarkSyncPoint() override;
+
+  void Close() override;
+
+  // Finishes the current segment now, whatever the limits.
+  void Roll();
+
+  // Segments finished so far.
+  const std::vector<SegmentInfo>& Segments() const { return segments_; }
+
+ private:
+  bool LimitReached(uint64_t byte_limit) const;
+
+  void BeforeWrite(size_t size);
+
+  void FinishSegment();
+
+  // Keeps |data| as part of the header, if it is still being gathered.
+  void GatherHeader(const uint8_t* data, size_t size);
+
+  SegmentWriterFactory factory_;
+  std::unique_ptr<Writer> index_;
+  SegmentingOptions options_;
+  std::unique_ptr<Writer> current_;
+  SegmentInfo current_info_;
+  std::chrono::steady_clock::time_point current_start_;
+  bool next_starts_at_sync_point_ = true;
+  uint32_t next_segment_ = 0;
+  uint64_t offset_ = 0;
+  std::vector<uint8_t> header_;
+  // Set at the first sync point, after which header_ is complete.
+  bool header_done_ = false;
+  std::vector<SegmentInfo> segments_;
+  bool closed_ = false;
+};
+
+// Reads back an index written by SegmentingWriter. Returns false if the file
+// can't be read or isn't an index. A truncated final record is ignored.
+bool ReadSegmentIndex(const std::string& path,
+                      std::vector<SegmentInfo>* segments);
+
+}  // namespace storage
+}  // namespace base
+
+#endif  // CXX_BASE_STORAGE_SEGMENTING_WRITER_H_
@@ -0,0 +1,373 @@
+#include "socket_stream_writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
+namespace base {
+namespace storage {
+
+namespace {
+
+constexpr auto kCloseDrainTimeout = std::chrono::seconds(1);
+
+bool SetNonBlocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+int ListenUnix(const std::string& path) {
+  sockaddr_un address = {};
+  if (path.size() >= sizeof(address.sun_path)) {
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  address.sun_family = AF_UNIX;
+  memcpy(address.sun_path, path.c_str(), path.size() + 1);
+  // A socket file left behind by an earlier run would make bind fail.
+  unlink(path.c_str());
+  if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int ListenTcp(int port, int* bound_port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  int reuse = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(static_cast<uint16_t>(port));
+  socklen_t length = sizeof(address);
+  if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(fd, SOMAXCONN) != 0 ||
+      getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+    close(fd);
+    return -1;
+  }
+  *bound_port = ntohs(address.sin_port);
+  return fd;
+}
+
+}  // namespace
+
+// One connected client and the bytes queued for it, in a fixed size ring so
+// that a slow client costs a bounded amount of memory.
+class SocketStreamWriter::Subscriber {
+ public:
+  Subscriber(int fd, size_t capacity) : fd_(fd), ring_(capacity) {}
+  ~Subscriber() { close(fd_); }
+  Subscriber(const Subscriber&) = delete;
+  Subscriber& operator=(const Subscriber&) = delete;
+
+  int fd() const { return fd_; }
+
+  bool Empty() const { return size_ == 0; }
+
+  // Returns false, queueing nothing, if there isn't room for all of it.
+  bool Push(const uint8_t* data, size_t size) {
+    if (size > ring_.size() - size_) {
+      return false;
+    }
+    size_t tail = (head_ + size_) % ring_.size();
+    size_t first = std::min(size, ring_.size() - tail);
+    memcpy(ring_.data() + tail, data, first);
+    memcpy(ring_.data(), data + first, size - first);
+    size_ += size;
+    return true;
+  }
+
+  // Sends as much as the socket will take without blocking. Returns false if
+  // the connection is gone.
+  bool Send() {
+    while (size_ > 0) {
+      iovec iov[2];
+      size_t first = std::min(size_, ring_.size() - head_);
+      iov[0] = {ring_.data() + head_, first};
+      iov[1] = {ring_.data(), size_ - first};
+      msghdr message = {};
+      message.msg_iov = iov;
+      message.msg_iovlen = size_ > first ? 2 : 1;
+      ssize_t sent = sendmsg(fd_, &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (sent < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+      }
+      head_ = (head_ + static_cast<size_t>(sent)) % ring_.size();
+      size_ -= static_cast<size_t>(sent);
+    }
+    head_ = 0;
+    return true;
+  }
+
+  void Clear() { head_ = size_ = 0; }
+
+  // Disconnected for falling behind, or by the client.
+  bool dropped = false;
+  // Joined when there was no complete stretch since the last sync point, so
+  // gets nothing until the next one.
+  bool waiting_for_sync = false;
+
+ private:
+  int fd_;
+  std::vector<uint8_t> ring_;
+  size_t head_ = 0;
+  size_t size_ = 0;
+};
+
+SocketStreamWriter::SocketStreamWriter(const SocketStreamOptions& options)
+    : options_(options) {
+  options_.subscriber_buffer_size =
+      std::max<size_t>(options_.subscriber_buffer_size, 1);
+  if (!options_.unix_socket_path.empty()) {
+    listen_fd_ = ListenUnix(options_.unix_socket_path);
+  } else {
+    listen_fd_ = ListenTcp(options_.tcp_port, &port_);
+  }
+  if (listen_fd_ < 0 || !SetNonBlocking(listen_fd_) || pipe(wake_fds_) != 0 ||
+      !SetNonBlocking(wake_fds_[0]) || !SetNonBlocking(wake_fds_[1])) {
+    failed_ = true;
+    closed_ = true;
+    return;
+  }
+  thread_ = std::thread([this] {
+    ApplyThreadOptions(options_.thread_options);
+    ServeThread();
+  });
+}
+
+SocketStreamWriter::~SocketStreamWriter() {
+  Close();
+  for (int fd : {listen_fd_, wake_fds_[0], wake_fds_[1]}) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+}
+
+void SocketStreamWriter::Write(const uint8_t* data, size_t size) {
+  std::unique_lock<decltype(m_)> lock(m_);
+  if (closed_ || size == 0) {
+    return;
+  }
+  if (!seen_sync_) {
+    if (keep_header_ &&
+        header_.size() + size <= options_.max_sync_cache_size) {
+      header_.insert(header_.end(), data, data + size);
+    } else {
+      // Not a header after all, late joiners just get the stream as it is.
+      keep_header_ = false;
+      header_.clear();
+      header_.shrink_to_fit();
+    }
+  } else if (since_sync_complete_) {
+    if (since_sync_.size() + size <= options_.max_sync_cache_size) {
+      since_sync_.insert(since_sync_.end(), data, data + size);
+    } else {
+      since_sync_complete_ = false;
+      since_sync_.clear();
+    }
+  }
+  bool queued = false;
+  for (auto& s : subscribers_) {
+    if (s->dropped || s->waiting_for_sync) {
+      continue;
+    }
+    if (!s->Push(data, size)) {
+      s->dropped = true;
+      s->Clear();
+      stats_.evicted++;
+    }
+    queued = true;
+  }
+  if (queued) {
+    Wake();
+  }
+}
+
+void SocketStreamWriter::MarkSyncPoint() {
+  std::unique_lock<decltype(m_)> lock(m_);
+  seen_sync_ = true;
+  since_sync_.clear();
+  since_sync_complete_ = true;
+  for (auto& s : subscribers_) {
+    s->waiting_for_sync = false;
+  }
+}
+
+void SocketStreamWriter::Close() {
+  {
+    std::unique_lock<decltype(m_)> lock(m_);
+    if (closed_) {
+      return;
+    }
+    closed_ = true;
+    closing_ = true;
+  }
+  Wake();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  subscribers_.clear();
+  if (!options_.unix_socket_path.empty()) {
+    unlink(options_.unix_socket_path.c_str());
+  }
+}
+
+SocketStreamStats SocketStreamWriter::GetStats() const {
+  std::unique_lock<decltype(m_)> lock(m_);
+  SocketStreamStats stats = stats_;
+  stats.subscribers = static_cast<size_t>(
+      std::count_if(subscribers_.begin(), subscribers_.end(),
+                    [](const auto& s) { return !s->dropped; }));
+  return stats;
+}
+
+void SocketStreamWriter::AddSubscriber(int fd) {
+  if (!SetNonBlocking(fd)) {
+    close(fd);
+    return;
+  }
+  if (options_.unix_socket_path.empty()) {
+    int no_delay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+  }
+  auto subscriber =
+      std::make_unique<Subscriber>(fd, options_.subscriber_buffer_size);
+  std::unique_lock<decltype(m_)> lock(m_);
+  stats_.accepted++;
+  // Start the newcomer off with the header and everything since the last sync
+  // point, or have it wait for the next sync point if that wasn't kept.
+  bool fits = subscriber->Push(header_.data(), header_.size());
+  if (seen_sync_) {
+    if (since_sync_complete_) {
+      fits = fits && subscriber->Push(since_sync_.data(), since_sync_.size());
+    } else {
+      subscriber->waiting_for_sync = true;
+    }
+  }
+  if (!fits) {
+    subscriber->dropped = true;
+    stats_.evicted++;
+  }
+  subscribers_.push_back(std::move(subscriber));
+}
+
+void SocketStreamWriter::ServeThread() {
+  std::vector<pollfd> fds;
+  std::vector<Subscriber*> polled;
+  std::chrono::steady_clock::time_point drain_deadline;
+  bool draining = false;
+  uint8_t scratch[4096];
+  while (true) {
+    fds.clear();
+    polled.clear();
+    fds.push_back({wake_fds_[0], POLLIN, 0});
+    {
+      std::unique_lock<decltype(m_)> lock(m_);
+      std::erase_if(subscribers_, [](const auto& s) { return s->dropped; });
+      if (closing_) {
+        if (!draining) {
+          draining = true;
+          drain_deadline =
+              std::chrono::steady_clock::now() + kCloseDrainTimeout;
+        }
+        bool drained = std::all_of(subscribers_.begin(), subscribers_.end(),
+                                   [](const auto& s) { return s->Empty(); });
+        if (drained || std::chrono::steady_clock::now() >= drain_deadline) {
+          return;
+        }
+      } else {
+        fds.push_back({listen_fd_, POLLIN, 0});
+      }
+      for (auto& s : subscribers_) {
+        short events = POLLIN;
+        if (!s->Empty()) {
+          events |= POLLOUT;
+        }
+        fds.push_back({s->fd(), events, 0});
+        polled.push_back(s.get());
+      }
+    }
+    // Only this thread removes subscribers, so the pointers stay valid.
+    int ready = poll(fds.data(), fds.size(), draining ? 10 : -1);
+    if (ready < 0 && errno != EINTR) {
+      return;
+    }
+    if (ready <= 0) {
+      continue;
+    }
+    size_t i = 0;
+    if (fds[i++].revents & POLLIN) {
+      wake_pending_ = false;
+      while (read(wake_fds_[0], scratch, sizeof(scratch)) > 0) {
+      }
+    }
+    if (!draining && (fds[i++].revents & POLLIN)) {
+      while (true) {
+        int fd = accept(listen_fd_, nullptr, nullptr);
+        if (fd < 0) {
+          break;
+        }
+        AddSubscriber(fd);
+      }
+    }
+    std::unique_lock<decltype(m_)> lock(m_);
+    for (Subscriber* s : polled) {
+      short revents = fds[i++].revents;
+      if (s->dropped || revents == 0) {
+        continue;
+      }
+      if (revents & (POLLERR | POLLNVAL)) {
+        s->dropped = true;
+        continue;
+      }
+      if (revents & (POLLIN | POLLHUP)) {
+        // Subscribers have nothing to say, anything readable is either junk
+        // to discard or the connection closing.
+        ssize_t n = recv(s->fd(), scratch, sizeof(scratch), MSG_DONTWAIT);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+                       errno != EINTR)) {
+          s->dropped = true;
+          continue;
+        }
+      }
+      if ((revents & POLLOUT) && !s->Send()) {
+        s->dropped = true;
+      }
+    }
+  }
+}
+
+void SocketStreamWriter::Wake() {
+  if (!wake_pending_.exchange(true)) {
+    uint8_t byte = 0;
+    ssize_t ignored = write(wake_fds_[1], &byte, 1);
+    (void)ignored;
+  }
+}
+
+}  // namespace storage
+}  // namespace base
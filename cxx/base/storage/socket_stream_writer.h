@@ -0,0 +1,101 @@
+#ifndef CXX_BASE_STORAGE_SOCKET_STREAM_WRITER_H_
+#define CXX_BASE_STORAGE_SOCKET_STREAM_WRITER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/thread_options.h"
+#include "writer.h"
+
+namespace base {
+namespace storage {
+
+struct SocketStreamOptions {
+  // Listen on this Unix domain socket. When empty, listen on TCP instead.
+  std::string unix_socket_path;
+  // TCP port on 127.0.0.1, 0 to pick a free one.
+  int tcp_port = 0;
+  // Data queued for each subscriber. A subscriber that falls this far behind
+  // is disconnected.
+  size_t subscriber_buffer_size = 8 * 1024 * 1024;
+  // Bytes since the last sync point kept for subscribers joining late. If a
+  // stretch between sync points is longer, late joiners wait for the next
+  // sync point.
+  size_t max_sync_cache_size = 16 * 1024 * 1024;
+  ThreadOptions thread_options = {"stream_server"};
+};
+
+struct SocketStreamStats {
+  size_t subscribers = 0;
+  uint64_t accepted = 0;
+  uint64_t evicted = 0;
+};
+
+// Streams everything written to it to any number of local subscribers, over
+// a Unix domain socket or TCP on the loopback interface. Everything before
+// the first sync point is treated as the stream header. A subscriber joining
+// late is sent the header and then the stream from the most recent sync point
+// on, so that a decoder can start straight away. Write never waits on
+// subscribers, each has its own buffer, and one that can't keep up is
+// dropped. Sockets are served from a background thread. POSIX only.
+class SocketStreamWriter : public Writer {
+ public:
+  explicit SocketStreamWriter(const SocketStreamOptions& options = {});
+  ~SocketStreamWriter();
+  SocketStreamWriter(const SocketStreamWriter&) = delete;
+  SocketStreamWriter& operator=(const SocketStreamWriter&) = delete;
+
+  void Write(const uint8_t* data, size_t size) override;
+
+  void MarkSyncPoint() override;
+
+  // Gives subscribers up to a second to take what is queued for them, then
+  // disconnects them and stops listening.
+  void Close() override;
+
+  // True if the listening socket couldn't be set up.
+  bool Failed() const { return failed_; }
+
+  // The TCP port being listened on, 0 when using a Unix domain socket.
+  int Port() const { return port_; }
+
+  SocketStreamStats GetStats() const;
+
+ private:
+  class Subscriber;
+
+  void AddSubscriber(int fd);
+
+  void ServeThread();
+
+  void Wake();
+
+  SocketStreamOptions options_;
+  bool failed_ = false;
+  int listen_fd_ = -1;
+  int port_ = 0;
+  int wake_fds_[2] = {-1, -1};
+  std::atomic<bool> wake_pending_ = false;
+  std::vector<uint8_t> header_;
+  bool keep_header_ = true;
+  std::vector<uint8_t> since_sync_;
+  bool seen_sync_ = false;
+  bool since_sync_complete_ = true;
+  std::vector<std::unique_ptr<Subscriber>> subscribers_;
+  SocketStreamStats stats_;
+  bool closing_ = false;
+  bool closed_ = false;
+  mutable std::mutex m_;
+  std::thread thread_;
+};
+
+}  // namespace storage
+}  // namespace base
+
+#endif  // CXX_BASE_STORAGE_SOCKET_STREAM_WRITER_H_
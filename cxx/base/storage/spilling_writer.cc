@@ -0,0 +1,374 @@
+#include "spilling_writer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+#include "position_file.h"
+
+namespace base {
+namespace storage {
+
+namespace {
+
+constexpr char kSegmentExtension[] = ".seg";
+constexpr char kPositionFileName[] = "position";
+
+// Segments are named after the stream offset they start at, in hex so that
+// they list in order.
+std::string SegmentPath(const std::string& journal_path, uint64_t start) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx%s",
+                static_cast<unsigned long long>(start), kSegmentExtension);
+  return (std::filesystem::path(journal_path) / name).string();
+}
+
+struct Segment {
+  uint64_t start;
+  uint64_t size;
+};
+
+// What an earlier run left in a journal directory.
+struct JournalContents {
+  // Committed offset, delivery resumes from here.
+  uint64_t position = 0;
+  // In order and back to back, starting at or before |position|. Empty if
+  // there is nothing that can be delivered without leaving a gap.
+  std::vector<Segment> segments;
+  uint64_t end = 0;
+};
+
+JournalContents ScanJournal(const std::string& journal_path) {
+  std::vector<Segment> found;
+  std::error_code ec;
+  for (const auto& entry :
+       std::filesystem::directory_iterator(journal_path, ec)) {
+    std::string name = entry.path().filename().string();
+    if (!name.ends_with(kSegmentExtension)) {
+      continue;
+    }
+    std::string stem =
+        name.substr(0, name.size() - std::strlen(kSegmentExtension));
+    char* stem_end = nullptr;
+    uint64_t start = std::strtoull(stem.c_str(), &stem_end, 16);
+    std::error_code size_ec;
+    uint64_t size = entry.file_size(size_ec);
+    if (!stem.empty() && *stem_end == '\0' && !size_ec) {
+      found.push_back({start, size});
+    }
+  }
+  std::sort(found.begin(), found.end(), [](const Segment& a, const Segment& b) {
+    return a.start < b.start;
+  });
+
+  JournalContents contents;
+  if (found.empty()) {
+    return contents;
+  }
+  // A crash before the first save leaves no position, when nothing has been
+  // committed yet.
+  if (!ReadPositionFile(
+          (std::filesystem::path(journal_path) / kPositionFileName).string(),
+          &contents.position)) {
+    contents.position = found.front().start;
+  }
+  // Only what follows on from the committed offset without a break can be
+  // delivered.
+  if (found.front().start > contents.position) {
+    return contents;
+  }
+  contents.end = found.front().start;
+  for (const auto& segment : found) {
+    if (segment.start != contents.end) {
+      break;
+    }
+    contents.segments.push_back(segment);
+    contents.end += segment.size;
+  }
+  if (contents.end < contents.position) {
+    contents.segments.clear();
+  }
+  return contents;
+}
+
+}  // namespace
+
+SpillingWriter::SpillingWriter(std::unique_ptr<Writer> inner,
+                               const SpillingWriterOptions& options)
+    : inner_(std::move(inner)),
+      options_(options),
+      position_path_(
+          (std::filesystem::path(options.journal_path) / kPositionFileName)
+              .string()) {
+  options_.journal_read_size = std::max<size_t>(options_.journal_read_size, 1);
+  options_.journal_segment_size =
+      std::max<uint64_t>(options_.journal_segment_size, 1);
+  OpenJournal();
+  thread_ = std::thread([this] {
+    ApplyThreadOptions(options_.drain_thread_options);
+    DrainThread();
+  });
+}
+
+SpillingWriter::~SpillingWriter() {
+  Close();
+}
+
+void SpillingWriter::Write(const uint8_t* data, size_t size) {
+  if (size == 0) {
+    return;
+  }
+  std::unique_lock<std::mutex> journal_lock(journal_m_);
+  std::unique_lock<decltype(m_)> lock(m_);
+  if (closed_) {
+    return;
+  }
+  // The journal is written without m_, so that delivery carries on
+  // meanwhile. Holding journal_m_ keeps writes in order.
+  lock.unlock();
+  bool journaled = !journal_failed_ && AppendToJournal(data, size);
+  lock.lock();
+  bool fits = stats_.memory_bytes + size <= options_.memory_limit;
+  if (!journaled && !fits) {
+    // Memory is the only copy, so wait for room rather than drop anything.
+    space_cv_.wait(lock, [this, size] {
+      return closed_ || delivery_failed_ || memory_.empty() ||
+             stats_.memory_bytes + size <= options_.memory_limit;
+    });
+    if (closed_ || delivery_failed_) {
+      return;
+    }
+  }
+  // Journaled writes that don't fit are read back from the journal instead.
+  if (!journaled || fits) {
+    memory_.push_back({end_, std::vector<uint8_t>(data, data + size)});
+    stats_.memory_bytes += size;
+  }
+  end_ += size;
+  data_cv_.notify_all();
+}
+
+void SpillingWriter::Flush() {
+  std::unique_lock<decltype(m_)> lock(m_);
+  flush_requested_ = true;
+  data_cv_.notify_all();
+}
+
+void SpillingWriter::Close() {
+  {
+    std::unique_lock<decltype(m_)> lock(m_);
+    if (closed_) {
+      return;
+    }
+    closed_ = true;
+  }
+  data_cv_.notify_all();
+  space_cv_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  inner_->Close();
+  {
+    std::unique_lock<std::mutex> journal_lock(journal_m_);
+    segment_.close();
+  }
+  std::unique_lock<decltype(m_)> lock(m_);
+  UpdateCommitted(lock);
+  if (committed_ >= end_) {
+    lock.unlock();
+    std::error_code ec;
+    std::filesystem::remove_all(options_.journal_path, ec);
+  }
+}
+
+SpillStats SpillingWriter::GetStats() const {
+  std::unique_lock<decltype(m_)> lock(m_);
+  SpillStats stats = stats_;
+  stats.journal_bytes = end_ - committed_;
+  stats.delivered_bytes = delivered_ - start_;
+  stats.committed_bytes = committed_ - start_;
+  return stats;
+}
+
+void SpillingWriter::OpenJournal() {
+  JournalContents contents = ScanJournal(options_.journal_path);
+  std::error_code ec;
+  if (!contents.segments.empty() && contents.position < contents.end) {
+    // Left over from an earlier run.
+    start_ = delivered_ = committed_ = contents.position;
+    end_ = contents.end;
+    stats_.recovered_bytes = end_ - start_;
+    for (const auto& segment : contents.segments) {
+      segments_.push_back(segment.start);
+    }
+    // Drops anything that can't be delivered, such as segments after a gap.
+    for (const auto& entry :
+         std::filesystem::directory_iterator(options_.journal_path, ec)) {
+      if (entry.path().extension() == kSegmentExtension &&
+          std::none_of(contents.segments.begin(), contents.segments.end(),
+                       [&](const Segment& segment) {
+                         return entry.path() ==
+                                SegmentPath(options_.journal_path,
+                                            segment.start);
+                       })) {
+        std::filesystem::remove(entry.path(), ec);
+      }
+    }
+  } else {
+    std::filesystem::remove_all(options_.journal_path, ec);
+  }
+  std::filesystem::create_directories(options_.journal_path, ec);
+  // New writes go in a segment of their own.
+  journal_end_ = end_;
+  segment_start_ = end_;
+  if (segments_.empty() || segments_.back() != end_) {
+    segments_.push_back(end_);
+  }
+  segment_.open(SegmentPath(options_.journal_path, segment_start_),
+                std::ios::binary | std::ios::trunc);
+  journal_failed_ = !segment_.is_open();
+}
+
+bool SpillingWriter::AppendToJournal(const uint8_t* data, size_t size) {
+  if (journal_end_ - segment_start_ >= options_.journal_segment_size) {
+    segment_.close();
+    segment_start_ = journal_end_;
+    segment_.open(SegmentPath(options_.journal_path, segment_start_),
+                  std::ios::binary | std::ios::trunc);
+    std::unique_lock<decltype(m_)> lock(m_);
+    segments_.push_back(segment_start_);
+  }
+  segment_.write(reinterpret_cast<const char*>(data), size);
+  // Hand it to the OS straight away so that it survives the process.
+  segment_.flush();
+  if (!segment_) {
+    // Everything after this is only in memory, so the journal stays a
+    // contiguous record of the stream up to here.
+    journal_failed_ = true;
+    return false;
+  }
+  journal_end_ += size;
+  return true;
+}
+
+void SpillingWriter::DeliverNext(std::unique_lock<std::mutex>& lock) {
+  std::vector<uint8_t> chunk;
+  if (!memory_.empty() && memory_.front().offset == delivered_) {
+    chunk = std::move(memory_.front().data);
+    memory_.pop_front();
+    stats_.memory_bytes -= chunk.size();
+    space_cv_.notify_all();
+    lock.unlock();
+    inner_->Write(chunk.data(), chunk.size());
+    lock.lock();
+    delivered_ += chunk.size();
+    return;
+  }
+  // Everything up to the next chunk in memory is in the journal.
+  uint64_t end = memory_.empty() ? end_ : memory_.front().offset;
+  auto next = std::upper_bound(segments_.begin(), segments_.end(), delivered_);
+  uint64_t segment_start = *(next - 1);
+  if (next != segments_.end()) {
+    end = std::min(end, *next);
+  }
+  size_t size = static_cast<size_t>(
+      std::min<uint64_t>(options_.journal_read_size, end - delivered_));
+  uint64_t offset = delivered_;
+  // Only this thread reads the journal or removes segments, so neither the
+  // read nor the segment needs the lock.
+  lock.unlock();
+  chunk.resize(size);
+  std::ifstream segment(SegmentPath(options_.journal_path, segment_start),
+                        std::ios::binary);
+  segment.seekg(static_cast<std::streamoff>(offset - segment_start));
+  segment.read(reinterpret_cast<char*>(chunk.data()), size);
+  bool read = static_cast<size_t>(segment.gcount()) == size;
+  if (read) {
+    inner_->Write(chunk.data(), chunk.size());
+  }
+  lock.lock();
+  if (!read) {
+    // Skipping ahead would leave a gap, so the rest stays in the journal.
+    delivery_failed_ = true;
+    space_cv_.notify_all();
+    return;
+  }
+  delivered_ += size;
+  stats_.spilled_bytes += size;
+}
+
+void SpillingWriter::UpdateCommitted(std::unique_lock<std::mutex>& lock) {
+  uint64_t delivered = delivered_;
+  lock.unlock();
+  std::optional<uint64_t> inner_committed = inner_->CommittedBytes();
+  lock.lock();
+  uint64_t committed = start_ + inner_committed.value_or(delivered - start_);
+  if (committed <= committed_) {
+    return;
+  }
+  committed_ = committed;
+  // Segments wholly before the committed offset, never the one being
+  // written.
+  std::vector<uint64_t> removed;
+  while (segments_.size() > 1 && segments_[1] <= committed_) {
+    removed.push_back(segments_.front());
+    segments_.pop_front();
+  }
+  lock.unlock();
+  // Saved first, so that a crash in between can't leave the offset pointing
+  // into a segment that is gone.
+  SavePositionFile(position_path_, committed);
+  std::error_code ec;
+  for (uint64_t start : removed) {
+    std::filesystem::remove(SegmentPath(options_.journal_path, start), ec);
+  }
+  lock.lock();
+}
+
+void SpillingWriter::DrainThread() {
+  auto next_commit_check = std::chrono::steady_clock::now();
+  std::unique_lock<decltype(m_)> lock(m_);
+  while (true) {
+    if (delivered_ < end_ && !delivery_failed_) {
+      DeliverNext(lock);
+    } else if (flush_requested_) {
+      flush_requested_ = false;
+      lock.unlock();
+      inner_->Flush();
+      lock.lock();
+    } else if (closed_) {
+      return;
+    } else {
+      auto ready = [this] {
+        return (delivered_ < end_ && !delivery_failed_) || flush_requested_ ||
+               closed_;
+      };
+      // Keeps checking while |inner| still has data to commit.
+      if (committed_ < delivered_) {
+        data_cv_.wait_until(lock, next_commit_check, ready);
+      } else {
+        data_cv_.wait(lock, ready);
+      }
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now >= next_commit_check) {
+      UpdateCommitted(lock);
+      next_commit_check = now + options_.commit_poll_interval;
+    }
+  }
+}
+
+bool ReadJournalResumePosition(const std::string& journal_path,
+                               uint64_t* position) {
+  JournalContents contents = ScanJournal(journal_path);
+  if (contents.segments.empty() || contents.position >= contents.end) {
+    return false;
+  }
+  *position = contents.position;
+  return true;
+}
+
+}  // namespace storage
+}  // namespace base
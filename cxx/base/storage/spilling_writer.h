@@ -0,0 +1,154 @@
+#ifndef CXX_BASE_STORAGE_SPILLING_WRITER_H_
+#define CXX_BASE_STORAGE_SPILLING_WRITER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/thread_options.h"
+#include "writer.h"
+
+namespace base {
+namespace storage {
+
+struct SpillingWriterOptions {
+  // Directory for the journal, which every write is appended to before it
+  // is handed on. Whatever an earlier run left in it uncommitted is
+  // delivered before anything new.
+  std::string journal_path;
+  // Bytes of recent writes also kept in memory, so that an inner writer
+  // that keeps up is fed without reading the journal back.
+  size_t memory_limit = 16 * 1024 * 1024;
+  // The journal is split into files of about this size, each removed once
+  // everything in it has been committed.
+  uint64_t journal_segment_size = 64 * 1024 * 1024;
+  // Size of each read from the journal when draining it.
+  size_t journal_read_size = 1024 * 1024;
+  // How often the inner writer is asked how much it has committed, and the
+  // journal trimmed to match.
+  std::chrono::milliseconds commit_poll_interval =
+      std::chrono::milliseconds(100);
+  ThreadOptions drain_thread_options = {"spill_drain"};
+};
+
+struct SpillStats {
+  // Held in memory waiting to be delivered.
+  uint64_t memory_bytes = 0;
+  // Written but not yet committed by the inner writer.
+  uint64_t journal_bytes = 0;
+  // Totals since the writer was created. Spilled bytes had to be read back
+  // from the journal because they didn't fit in memory.
+  uint64_t delivered_bytes = 0;
+  uint64_t committed_bytes = 0;
+  uint64_t spilled_bytes = 0;
+  uint64_t recovered_bytes = 0;
+};
+
+// Decouples a slow writer, such as an upload, from the caller. Every write
+// is appended to a journal on disk and the most recent ones are also kept
+// in memory, and a background thread delivers them to |inner| in order, so
+// Write doesn't wait on |inner| and memory stays bounded. The journal is
+// only trimmed, a whole segment at a time, once |inner| reports the data as
+// committed through CommittedBytes, and the committed offset is saved in
+// the journal directory. A writer created after a crash with the same
+// journal delivers everything after that offset again, so |inner| has to
+// start at that offset of its destination, see ReadJournalResumePosition,
+// and skip whatever the destination already holds past it. Nothing written
+// is lost unless the journal can't be written, in which case writes wait
+// for room in memory instead.
+class SpillingWriter : public Writer {
+ public:
+  SpillingWriter(std::unique_ptr<Writer> inner,
+                 const SpillingWriterOptions& options);
+  ~SpillingWriter();
+  SpillingWriter(const SpillingWriter&) = delete;
+  SpillingWriter& operator=(const SpillingWriter&) = delete;
+
+  void Write(const uint8_t* data, size_t size) override;
+
+  // Flushes |inner| once everything written so far has been delivered,
+  // without waiting for that to happen.
+  void Flush() override;
+
+  // Waits for everything to be delivered and closes |inner|. The journal is
+  // removed if |inner| committed all of it, and otherwise kept for a later
+  // run to finish.
+  void Close() override;
+
+  SpillStats GetStats() const;
+
+ private:
+  struct MemoryChunk {
+    uint64_t offset;
+    std::vector<uint8_t> data;
+  };
+
+  void OpenJournal();
+
+  // Called with journal_m_ held.
+  bool AppendToJournal(const uint8_t* data, size_t size);
+
+  // Hands the next piece of the stream to |inner|. Called with m_ held,
+  // which it releases while reading the journal and writing.
+  void DeliverNext(std::unique_lock<std::mutex>& lock);
+
+  // Catches up with what |inner| has committed, saves the offset and
+  // removes the segments before it. Called with m_ held, which it releases
+  // for the file I/O.
+  void UpdateCommitted(std::unique_lock<std::mutex>& lock);
+
+  void DrainThread();
+
+  std::unique_ptr<Writer> inner_;
+  SpillingWriterOptions options_;
+  std::string position_path_;
+  // Offsets are into the stream the journal was started with. |inner| was
+  // handed the stream from start_ on.
+  uint64_t start_ = 0;
+  uint64_t delivered_ = 0;
+  uint64_t committed_ = 0;
+  uint64_t end_ = 0;
+  // Start offsets of the segments, in order. The last one is being written.
+  std::deque<uint64_t> segments_;
+  // Recent writes, in order but not necessarily contiguous. Anything
+  // written from delivered_ on that isn't here is in the journal.
+  std::deque<MemoryChunk> memory_;
+  // Set if the journal can't be read back, which stops delivery and leaves
+  // the rest for a later run.
+  bool delivery_failed_ = false;
+  // Set when a flush has been asked for, cleared once it is handed on.
+  bool flush_requested_ = false;
+  bool closed_ = false;
+  SpillStats stats_;
+  mutable std::mutex m_;
+  std::condition_variable data_cv_;
+  std::condition_variable space_cv_;
+  std::thread thread_;
+  // Held while appending to the journal, so that Write doesn't hold m_ and
+  // stall delivery while it waits on the disk.
+  std::mutex journal_m_;
+  std::ofstream segment_;
+  uint64_t segment_start_ = 0;
+  uint64_t journal_end_ = 0;
+  bool journal_failed_ = false;
+};
+
+// Where a SpillingWriter given |journal_path| resumes delivering from, as an
+// offset into the stream the journal was started with, which is where
+// |inner| should resume its destination. Returns false if there is nothing
+// there left to deliver.
+bool ReadJournalResumePosition(const std::string& journal_path,
+                               uint64_t* position);
+
+}  // namespace storage
+}  // namespace base
+
+#endif  // CXX_BASE_STORAGE_SPILLING_WRITER_H_
@@ -1,12 +1,50 @@
 #ifndef CXX_BASE_STORAGE_WRITER_H_
 #define CXX_BASE_STORAGE_WRITER_H_
 
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+
 namespace base {
 namespace storage {
 
+// One fragment of a vectored write, laid out like iovec.
+struct WriteBuffer {
+  const uint8_t* data;
+  size_t size;
+};
+
 class Writer {
  public:
-  virtual void Write(uint8_t* data, size_t size) = 0;
+  virtual ~Writer() = default;
+
+  virtual void Write(const uint8_t* data, size_t size) = 0;
+
+  // Writes the buffers back to back, as if by one Write of their
+  // concatenation. Implementations that can pass fragments through without
+  // joining them first should override this.
+  virtual void WriteV(std::span<const WriteBuffer> buffers) {
+    for (const auto& b : buffers) {
+      Write(b.data, b.size);
+    }
+  }
+
+  // Pushes anything the writer is holding on to out to its destination.
+  virtual void Flush() {}
+
+  // Hint that a reader could start from the next byte written, e.g. because
+  // a keyframe follows. Writers that split their output use it to pick where.
+  virtual void MarkSyncPoint() {}
+
+  // How many of the bytes written so far have reached the destination for
+  // good, for writers that hold on to data after Write returns, such as
+  // uploads. It only grows, and stops growing if the writer fails. Writers
+  // that don't report it return nullopt, in which case callers count what
+  // they have written as delivered.
+  virtual std::optional<uint64_t> CommittedBytes() const {
+    return std::nullopt;
+  }
 
   virtual void Close() = 0;
 };
@@ -14,4 +52,4 @@ class Writer {
 }  // namespace storage
 }  // namespace base
 
-#endif  // CXX_BASE_STORAGE_WRITER_H_
\ No newline at end of file
+#endif  // CXX_BASE_STORAGE_WRITER_H_
@@ -0,0 +1,269 @@
+#ifndef CXX_BASE_TASK_H_
+#define CXX_BASE_TASK_H_
+
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "base/bounded_queue.h"
+#include "base/thread_pool.h"
+
+namespace base {
+
+template <typename T = void>
+class Task;
+
+namespace internal {
+
+struct TaskPromiseBase {
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<Promise> h) noexcept {
+      return h.promise().continuation;
+    }
+
+    void await_resume() noexcept {}
+  };
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+
+  FinalAwaiter final_suspend() noexcept { return {}; }
+
+  void unhandled_exception() { std::terminate(); }
+
+  std::coroutine_handle<> continuation = std::noop_coroutine();
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+  Task<T> get_return_object() noexcept;
+
+  void return_value(T v) { value.emplace(std::move(v)); }
+
+  std::optional<T> value;
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+  Task<void> get_return_object() noexcept;
+
+  void return_void() {}
+};
+
+}  // namespace internal
+
+// Lazily started coroutine producing a T. A Task does nothing until it is
+// co_awaited, at which point it runs on the awaiting thread until its first
+// suspension, and resumes the awaiting coroutine when it finishes. Use
+// SyncWait to drive a Task from ordinary code, or Spawn to run one on a pool
+// without waiting for it.
+template <typename T>
+class [[nodiscard]] Task {
+ public:
+  using promise_type = internal::TaskPromise<T>;
+
+  Task(Task&& other) noexcept : h_(std::exchange(other.h_, nullptr)) {}
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      if (h_) {
+        h_.destroy();
+      }
+      h_ = std::exchange(other.h_, nullptr);
+    }
+    return *this;
+  }
+  ~Task() {
+    if (h_) {
+      h_.destroy();
+    }
+  }
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+
+  bool Done() const { return !h_ || h_.done(); }
+
+  auto operator co_await() noexcept {
+    struct Awaiter {
+      bool await_ready() noexcept { return !h || h.done(); }
+
+      std::coroutine_handle<> await_suspend(
+          std::coroutine_handle<> awaiting) noexcept {
+        h.promise().continuation = awaiting;
+        return h;
+      }
+
+      T await_resume() {
+        if constexpr (!std::is_void_v<T>) {
+          return std::move(*h.promise().value);
+        }
+      }
+
+      std::coroutine_handle<promise_type> h;
+    };
+    return Awaiter{h_};
+  }
+
+ private:
+  friend promise_type;
+
+  explicit Task(std::coroutine_handle<promise_type> h) : h_(h) {}
+
+  std::coroutine_handle<promise_type> h_;
+};
+
+namespace internal {
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() noexcept {
+  return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+  return Task<void>(
+      std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// Coroutine that starts immediately and frees itself when done, used to root
+// Spawn and SyncWait.
+struct DetachedTask {
+  struct promise_type {
+    DetachedTask get_return_object() noexcept { return {}; }
+
+    std::suspend_never initial_suspend() noexcept { return {}; }
+
+    std::suspend_never final_suspend() noexcept { return {}; }
+
+    void return_void() {}
+
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+}  // namespace internal
+
+// co_await Schedule(pool) continues the coroutine on one of the pool's
+// workers.
+inline auto Schedule(ThreadPool* pool) {
+  struct Awaiter {
+    bool await_ready() noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> h) {
+      pool->Submit([h] { h.resume(); });
+    }
+
+    void await_resume() noexcept {}
+
+    ThreadPool* pool;
+  };
+  return Awaiter{pool};
+}
+
+// co_await Offload(pool, function) runs a blocking function on the pool and
+// continues the coroutine on that pool thread with its result. Give blocking
+// I/O its own pool so that it doesn't hold up compute tasks.
+template <typename Function>
+auto Offload(ThreadPool* pool, Function function) {
+  using Result = std::invoke_result_t<Function>;
+  struct Awaiter {
+    bool await_ready() noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> h) {
+      pool->Submit([this, h] {
+        if constexpr (std::is_void_v<Result>) {
+          function();
+        } else {
+          result.emplace(function());
+        }
+        h.resume();
+      });
+    }
+
+    Result await_resume() {
+      if constexpr (!std::is_void_v<Result>) {
+        return std::move(*result);
+      }
+    }
+
+    ThreadPool* pool;
+    Function function;
+    std::optional<std::conditional_t<std::is_void_v<Result>, bool, Result>>
+        result;
+  };
+  return Awaiter{pool, std::move(function), std::nullopt};
+}
+
+// co_await PopAsync(queue, pool) suspends until the queue has an item rather
+// than blocking the thread, and yields nullopt once the queue is closed and
+// drained. When an item arrives the coroutine continues on |pool|, or on the
+// pushing thread if |pool| is null. The popped item still needs TaskDone.
+template <typename T>
+auto PopAsync(BoundedQueue<T>* queue, ThreadPool* pool) {
+  struct Awaiter {
+    bool await_ready() noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> h) {
+      return !queue->PopOrNotify(
+          &item, [this, h](std::optional<T> popped) {
+            item = std::move(popped);
+            if (pool) {
+              pool->Submit([h] { h.resume(); });
+            } else {
+              h.resume();
+            }
+          });
+    }
+
+    std::optional<T> await_resume() { return std::move(item); }
+
+    BoundedQueue<T>* queue;
+    ThreadPool* pool;
+    std::optional<T> item;
+  };
+  return Awaiter{queue, pool, std::nullopt};
+}
+
+// Runs the task on |pool| without waiting for it to finish.
+inline void Spawn(ThreadPool* pool, Task<void> task) {
+  [](ThreadPool* pool, Task<void> task) -> internal::DetachedTask {
+    co_await Schedule(pool);
+    co_await std::move(task);
+  }(pool, std::move(task));
+}
+
+// Blocks the calling thread until the task has finished and returns its
+// result. The task starts on the calling thread.
+template <typename T>
+T SyncWait(Task<T> task) {
+  std::mutex m;
+  std::condition_variable cv;
+  bool done = false;
+  std::optional<std::conditional_t<std::is_void_v<T>, bool, T>> result;
+  [](Task<T> task, std::mutex* m, std::condition_variable* cv, bool* done,
+     decltype(result)* result) -> internal::DetachedTask {
+    if constexpr (std::is_void_v<T>) {
+      co_await std::move(task);
+    } else {
+      result->emplace(co_await std::move(task));
+    }
+    std::unique_lock<std::mutex> lock(*m);
+    *done = true;
+    cv->notify_all();
+  }(std::move(task), &m, &cv, &done, &result);
+  std::unique_lock<std::mutex> lock(m);
+  cv.wait(lock, [&done] { return done; });
+  if constexpr (!std::is_void_v<T>) {
+    return std::move(*result);
+  }
+}
+
+}  // namespace base
+
+#endif  // CXX_BASE_TASK_H_
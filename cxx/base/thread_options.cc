@@ -0,0 +1,97 @@
+#include "base/thread_options.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace base {
+
+#if defined(__linux__)
+
+bool ApplyThreadOptions(const ThreadOptions& options) {
+  bool success = true;
+  if (!options.name.empty()) {
+    std::string name = options.name.substr(0, 15);
+    success &= pthread_setname_np(pthread_self(), name.c_str()) == 0;
+  }
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  for (int cpu : options.cpu_affinity) {
+    if (cpu >= 0 && cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &cpus);
+    }
+  }
+  if (options.cpu_affinity.empty()) {
+    // The kernel leaves out CPUs that don't exist or that the process may
+    // not use.
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      CPU_SET(cpu, &cpus);
+    }
+  }
+  success &= pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+  if (options.realtime_priority > 0) {
+    sched_param param = {};
+    param.sched_priority = options.realtime_priority;
+    success &= pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+  } else if (options.nice != 0) {
+    // On Linux nice values are per thread when given a thread id.
+    pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+    success &= setpriority(PRIO_PROCESS, tid, options.nice) == 0;
+  }
+  return success;
+}
+
+#elif defined(_WIN32)
+
+bool ApplyThreadOptions(const ThreadOptions& options) {
+  bool success = true;
+  HANDLE thread = GetCurrentThread();
+  if (!options.name.empty()) {
+    std::wstring name(options.name.begin(), options.name.end());
+    success &= SUCCEEDED(SetThreadDescription(thread, name.c_str()));
+  }
+  DWORD_PTR mask = 0;
+  for (int cpu : options.cpu_affinity) {
+    if (cpu >= 0 && cpu < static_cast<int>(sizeof(mask) * 8)) {
+      mask |= DWORD_PTR(1) << cpu;
+    }
+  }
+  if (options.cpu_affinity.empty()) {
+    DWORD_PTR system_mask = 0;
+    GetProcessAffinityMask(GetCurrentProcess(), &mask, &system_mask);
+  }
+  success &= SetThreadAffinityMask(thread, mask) != 0;
+  if (options.realtime_priority > 0) {
+    success &= SetThreadPriority(thread, THREAD_PRIORITY_TIME_CRITICAL) != 0;
+  } else if (options.nice != 0) {
+    int priority = THREAD_PRIORITY_NORMAL;
+    if (options.nice <= -10) {
+      priority = THREAD_PRIORITY_HIGHEST;
+    } else if (options.nice < 0) {
+      priority = THREAD_PRIORITY_ABOVE_NORMAL;
+    } else if (options.nice < 10) {
+      priority = THREAD_PRIORITY_BELOW_NORMAL;
+    } else {
+      priority = THREAD_PRIORITY_LOWEST;
+    }
+    success &= SetThreadPriority(thread, priority) != 0;
+  }
+  return success;
+}
+
+#else
+
+bool ApplyThreadOptions(const ThreadOptions& options) {
+  return options.name.empty() && options.cpu_affinity.empty() &&
+         options.nice == 0 && options.realtime_priority == 0;
+}
+
+#endif
+
+}  // namespace base
@@ -0,0 +1,29 @@
+#ifndef CXX_BASE_THREAD_OPTIONS_H_
+#define CXX_BASE_THREAD_OPTIONS_H_
+
+#include <string>
+#include <vector>
+
+namespace base {
+
+struct ThreadOptions {
+  // Shown by top and perf. Linux truncates names to 15 characters.
+  std::string name;
+  // CPUs the thread may run on, empty for all of them. Threads otherwise
+  // inherit the affinity of the thread that started them.
+  std::vector<int> cpu_affinity;
+  // Nice level from -20 to 19, 0 leaves the priority alone. Negative values
+  // need CAP_SYS_NICE on Linux.
+  int nice = 0;
+  // When above 0 the thread is switched to SCHED_FIFO at this priority, which
+  // takes precedence over nice. Needs CAP_SYS_NICE on Linux.
+  int realtime_priority = 0;
+};
+
+// Applies the options to the calling thread. Returns false if any of them
+// could not be applied, the rest are still attempted.
+bool ApplyThreadOptions(const ThreadOptions& options);
+
+}  // namespace base
+
+#endif  // CXX_BASE_THREAD_OPTIONS_H_
@@ -0,0 +1,242 @@
+#include "base/thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace base {
+
+namespace {
+
+thread_local ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+
+size_t NextVictim(size_t worker_count) {
+  // xorshift, only needs to spread thieves across victims.
+  thread_local uint32_t state =
+      static_cast<uint32_t>(
+          std::hash<std::thread::id>()(std::this_thread::get_id())) |
+      1;
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state % worker_count;
+}
+
+void SplitRange(TaskGroup* group,
+                size_t begin,
+                size_t end,
+                size_t grain_size,
+                const std::function<void(size_t, size_t)>& body) {
+  while (end - begin > grain_size) {
+    size_t middle = begin + (end - begin) / 2;
+    group->Run([group, middle, end, grain_size, &body] {
+      SplitRange(group, middle, end, grain_size, body);
+    });
+    end = middle;
+  }
+  body(begin, end);
+}
+
+}  // namespace
+
+ThreadPool::ThreadPool(size_t num_threads, const ThreadOptions& thread_options)
+    : pending_tasks_(0), sleeping_workers_(0), stopping_(false) {
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (size_t i = 0; i < num_threads; i++) {
+    workers_.push_back(std::make_unique<Worker>());
+  }
+  for (size_t i = 0; i < num_threads; i++) {
+    workers_[i]->thread = std::thread([this, i, thread_options] {
+      ApplyThreadOptions(thread_options);
+      WorkerThread(i);
+    });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::unique_lock<decltype(sleep_mutex_)> lock(sleep_mutex_);
+    stopping_ = true;
+  }
+  sleep_cv_.notify_all();
+  for (auto& w : workers_) {
+    if (w->thread.joinable()) {
+      w->thread.join();
+    }
+  }
+}
+
+ThreadPool* ThreadPool::GetDefault() {
+  static ThreadPool* pool = new ThreadPool();
+  return pool;
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+  Task* t = new Task{std::move(task)};
+  if (current_pool == this) {
+    workers_[current_worker]->deque.Push(t);
+  } else {
+    std::unique_lock<decltype(injection_mutex_)> lock(injection_mutex_);
+    injection_queue_.push_back(t);
+  }
+  pending_tasks_.fetch_add(1, std::memory_order_seq_cst);
+  if (sleeping_workers_.load(std::memory_order_seq_cst) > 0) {
+    std::unique_lock<decltype(sleep_mutex_)> lock(sleep_mutex_);
+    sleep_cv_.notify_one();
+  }
+}
+
+void ThreadPool::ParallelFor(size_t begin,
+                             size_t end,
+                             size_t grain_size,
+                             const std::function<void(size_t, size_t)>& body) {
+  if (begin >= end) {
+    return;
+  }
+  grain_size = std::max<size_t>(grain_size, 1);
+  if (end - begin <= grain_size) {
+    body(begin, end);
+    return;
+  }
+  TaskGroup group(this);
+  SplitRange(&group, begin, end, grain_size, body);
+  group.Wait();
+}
+
+bool ThreadPool::RunPendingTask() {
+  Task* task = nullptr;
+  if (current_pool == this) {
+    task = FindTask(current_worker);
+  } else {
+    {
+      std::unique_lock<decltype(injection_mutex_)> lock(injection_mutex_);
+      if (!injection_queue_.empty()) {
+        task = injection_queue_.front();
+        injection_queue_.pop_front();
+      }
+    }
+    if (!task) {
+      task = StealTask(NextVictim(workers_.size()));
+    }
+  }
+  if (!task) {
+    return false;
+  }
+  Execute(task);
+  return true;
+}
+
+void ThreadPool::WorkerThread(size_t index) {
+  current_pool = this;
+  current_worker = index;
+  while (true) {
+    Task* task = FindTask(index);
+    if (task) {
+      Execute(task);
+      continue;
+    }
+    std::unique_lock<decltype(sleep_mutex_)> lock(sleep_mutex_);
+    if (stopping_ && pending_tasks_.load() == 0) {
+      break;
+    }
+    sleeping_workers_.fetch_add(1, std::memory_order_seq_cst);
+    sleep_cv_.wait(lock, [this] {
+      return pending_tasks_.load(std::memory_order_seq_cst) > 0 || stopping_;
+    });
+    sleeping_workers_.fetch_sub(1, std::memory_order_seq_cst);
+  }
+  current_pool = nullptr;
+}
+
+ThreadPool::Task* ThreadPool::FindTask(size_t index) {
+  Task* task = workers_[index]->deque.Pop();
+  if (task) {
+    return task;
+  }
+  {
+    std::unique_lock<decltype(injection_mutex_)> lock(injection_mutex_);
+    if (!injection_queue_.empty()) {
+      task = injection_queue_.front();
+      injection_queue_.pop_front();
+      return task;
+    }
+  }
+  if (workers_.size() > 1) {
+    return StealTask(NextVictim(workers_.size()));
+  }
+  return nullptr;
+}
+
+ThreadPool::Task* ThreadPool::StealTask(size_t first_victim) {
+  // A steal can fail spuriously when racing another thief, so only give up
+  // once every deque has been seen empty.
+  while (pending_tasks_.load(std::memory_order_relaxed) > 0) {
+    bool saw_work = false;
+    for (size_t i = 0; i < workers_.size(); i++) {
+      auto& victim = workers_[(first_victim + i) % workers_.size()]->deque;
+      if (victim.Empty()) {
+        continue;
+      }
+      saw_work = true;
+      Task* task = victim.Steal();
+      if (task) {
+        return task;
+      }
+    }
+    if (!saw_work) {
+      break;
+    }
+  }
+  return nullptr;
+}
+
+void ThreadPool::Execute(Task* task) {
+  pending_tasks_.fetch_sub(1, std::memory_order_relaxed);
+  task->function();
+  delete task;
+}
+
+TaskGroup::TaskGroup(ThreadPool* pool) : pool_(pool), pending_(0) {}
+
+TaskGroup::~TaskGroup() {
+  Wait();
+}
+
+void TaskGroup::Run(std::function<void()> task) {
+  {
+    std::unique_lock<decltype(m_)> lock(m_);
+    pending_++;
+  }
+  pool_->Submit([this, task = std::move(task)] {
+    task();
+    // The notify happens under the lock so that Wait can't return, and the
+    // group be destroyed, before this task is done touching it.
+    std::unique_lock<decltype(m_)> lock(m_);
+    if (--pending_ == 0) {
+      cv_.notify_all();
+    }
+  });
+}
+
+void TaskGroup::Wait() {
+  while (true) {
+    {
+      std::unique_lock<decltype(m_)> lock(m_);
+      if (pending_ == 0) {
+        return;
+      }
+    }
+    if (pool_->RunPendingTask()) {
+      continue;
+    }
+    // Everything left is running on other threads, but those tasks may queue
+    // more work, so wake up periodically to help with it.
+    std::unique_lock<decltype(m_)> lock(m_);
+    cv_.wait_for(lock, std::chrono::milliseconds(1),
+                 [this] { return pending_ == 0; });
+  }
+}
+
+}  // namespace base
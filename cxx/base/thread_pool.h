@@ -0,0 +1,104 @@
+#ifndef CXX_BASE_THREAD_POOL_H_
+#define CXX_BASE_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "base/thread_options.h"
+#include "base/work_stealing_deque.h"
+
+namespace base {
+
+// Fixed set of worker threads, each with its own work stealing deque. Tasks
+// submitted from a worker go onto that worker's deque, tasks submitted from
+// any other thread go onto a shared injection queue. Idle workers steal from
+// each other before going to sleep.
+class ThreadPool {
+ public:
+  // A num_threads of 0 uses one thread per hardware thread. The thread options
+  // are applied to every worker.
+  explicit ThreadPool(size_t num_threads = 0,
+                      const ThreadOptions& thread_options = {});
+  ~ThreadPool();
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Process wide pool shared by the libraries, created on first use.
+  static ThreadPool* GetDefault();
+
+  size_t NumThreads() const { return workers_.size(); }
+
+  void Submit(std::function<void()> task);
+
+  // Calls body(chunk_begin, chunk_end) over [begin, end) in chunks of at most
+  // grain_size indices and returns once every chunk has run. The range is split
+  // in halves so that thieves take large pieces of work.
+  void ParallelFor(size_t begin,
+                   size_t end,
+                   size_t grain_size,
+                   const std::function<void(size_t, size_t)>& body);
+
+  // Runs one queued task on the calling thread. Returns false if no task could
+  // be found.
+  bool RunPendingTask();
+
+ private:
+  struct Task {
+    std::function<void()> function;
+  };
+
+  struct Worker {
+    WorkStealingDeque<Task> deque;
+    std::thread thread;
+  };
+
+  void WorkerThread(size_t index);
+
+  Task* FindTask(size_t index);
+
+  Task* StealTask(size_t first_victim);
+
+  void Execute(Task* task);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::mutex injection_mutex_;
+  std::deque<Task*> injection_queue_;
+  std::atomic<int64_t> pending_tasks_;
+  std::atomic<int32_t> sleeping_workers_;
+  std::atomic<bool> stopping_;
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cv_;
+};
+
+// Tracks a set of tasks run on a pool so that they can be waited on together.
+// Waiting threads help by running queued tasks, so groups can be nested inside
+// tasks without exhausting the workers.
+class TaskGroup {
+ public:
+  explicit TaskGroup(ThreadPool* pool);
+  ~TaskGroup();
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+
+  void Run(std::function<void()> task);
+
+  void Wait();
+
+ private:
+  ThreadPool* pool_;
+  size_t pending_;
+  std::mutex m_;
+  std::condition_variable cv_;
+};
+
+}  // namespace base
+
+#endif  // CXX_BASE_THREAD_POOL_H_
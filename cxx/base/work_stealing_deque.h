@@ -0,0 +1,130 @@
+#ifndef CXX_BASE_WORK_STEALING_DEQUE_H_
+#define CXX_BASE_WORK_STEALING_DEQUE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace base {
+
+// Chase-Lev work stealing deque, using the memory orderings from
+// https://fzn.fr/readings/ppopp13.pdf
+// Push and Pop may only be called by the owning thread, Steal may be called
+// from any thread. Items are borrowed pointers; the deque never owns them.
+template <typename T>
+class WorkStealingDeque {
+ public:
+  explicit WorkStealingDeque(int64_t initial_capacity = 256)
+      : top_(0), bottom_(0) {
+    int64_t capacity = 1;
+    while (capacity < initial_capacity)
+      capacity <<= 1;
+    arrays_.push_back(std::make_unique<Array>(capacity));
+    array_.store(arrays_.back().get(), std::memory_order_relaxed);
+  }
+  ~WorkStealingDeque() = default;
+  WorkStealingDeque(const WorkStealingDeque&) = delete;
+  WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+  void Push(T* item) {
+    int64_t b = bottom_.load(std::memory_order_relaxed);
+    int64_t t = top_.load(std::memory_order_acquire);
+    Array* a = array_.load(std::memory_order_relaxed);
+    if (b - t > a->capacity - 1) {
+      a = Grow(a, t, b);
+    }
+    a->Put(b, item);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(b + 1, std::memory_order_relaxed);
+  }
+
+  // Takes the most recently pushed item, or nullptr if the deque is empty.
+  T* Pop() {
+    int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    Array* a = array_.load(std::memory_order_relaxed);
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top_.load(std::memory_order_relaxed);
+    if (t > b) {
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    T* item = a->Get(b);
+    if (t == b) {
+      // Last item, race against thieves for it.
+      if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                        std::memory_order_relaxed)) {
+        item = nullptr;
+      }
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+  }
+
+  // Takes the oldest item, or nullptr if the deque is empty or another thread
+  // won the race for it.
+  T* Steal() {
+    int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom_.load(std::memory_order_acquire);
+    if (t >= b) {
+      return nullptr;
+    }
+    Array* a = array_.load(std::memory_order_acquire);
+    T* item = a->Get(t);
+    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return item;
+  }
+
+  bool Empty() const {
+    int64_t b = bottom_.load(std::memory_order_relaxed);
+    int64_t t = top_.load(std::memory_order_relaxed);
+    return b <= t;
+  }
+
+ private:
+  struct Array {
+    explicit Array(int64_t c)
+        : capacity(c), mask(c - 1), slots(new std::atomic<T*>[c]) {}
+
+    T* Get(int64_t i) const {
+      return slots[i & mask].load(std::memory_order_relaxed);
+    }
+
+    void Put(int64_t i, T* item) {
+      slots[i & mask].store(item, std::memory_order_relaxed);
+    }
+
+    int64_t capacity;
+    int64_t mask;
+    std::unique_ptr<std::atomic<T*>[]> slots;
+  };
+
+  Array* Grow(Array* old_array, int64_t t, int64_t b) {
+    auto grown = std::make_unique<Array>(old_array->capacity * 2);
+    for (int64_t i = t; i < b; i++) {
+      grown->Put(i, old_array->Get(i));
+    }
+    // Thieves may still be reading from the old array, so it is retired rather
+    // than freed until the deque itself goes away.
+    arrays_.push_back(std::move(grown));
+    Array* a = arrays_.back().get();
+    array_.store(a, std::memory_order_release);
+    return a;
+  }
+
+  // Kept on separate cache lines so thieves bumping top_ don't contend with
+  // the owner moving bottom_.
+  alignas(64) std::atomic<int64_t> top_;
+  alignas(64) std::atomic<int64_t> bottom_;
+  std::atomic<Array*> array_;
+  std::vector<std::unique_ptr<Array>> arrays_;
+};
+
+}  // namespace base
+
+#endif  // CXX_BASE_WORK_STEALING_DEQUE_H_
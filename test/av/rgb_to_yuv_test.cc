@@ -0,0 +1,188 @@
+#include <av/rgb_to_yuv.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <base/thread_pool.h>
+#include <gtest/gtest.h>
+
+extern "C" {
+#include <libswscale/swscale.h>
+}
+
+namespace {
+
+struct Yuv420p {
+  Yuv420p(int width, int height)
+      : width(width),
+        height(height),
+        chroma_width((width + 1) / 2),
+        chroma_height((height + 1) / 2) {
+    planes[0].resize(width * height);
+    planes[1].resize(chroma_width * chroma_height);
+    planes[2].resize(chroma_width * chroma_height);
+  }
+
+  void Convert(const std::vector<uint8_t>& rgb,
+               av::YuvMatrix matrix,
+               av::YuvRange range,
+               base::ThreadPool* pool = nullptr) {
+    uint8_t* data[3] = {planes[0].data(), planes[1].data(), planes[2].data()};
+    int stride[3] = {width, chroma_width, chroma_width};
+    av::RgbToYuv420p(rgb.data(), width * 3, width, height, data, stride, matrix,
+                     range, pool);
+  }
+
+  int width;
+  int height;
+  int chroma_width;
+  int chroma_height;
+  std::vector<uint8_t> planes[3];
+};
+
+std::vector<uint8_t> MakeNoise(int width, int height) {
+  std::mt19937 rng(5);
+  std::vector<uint8_t> rgb(width * height * 3);
+  for (auto& b : rgb) {
+    b = static_cast<uint8_t>(rng());
+  }
+  return rgb;
+}
+
+// Smooth gradients and a slow ripple, closer to camera frames than noise.
+std::vector<uint8_t> MakeImage(int width, int height) {
+  std::vector<uint8_t> rgb(width * height * 3);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      uint8_t* p = &rgb[(y * width + x) * 3];
+      double ripple = 40 * std::sin(x * 0.05) * std::cos(y * 0.07);
+      p[0] = static_cast<uint8_t>(std::clamp(255.0 * x / width + ripple, 0.0,
+                                             255.0));
+      p[1] = static_cast<uint8_t>(std::clamp(255.0 * y / height - ripple, 0.0,
+                                             255.0));
+      p[2] = static_cast<uint8_t>(
+          std::clamp(128 + 100 * std::sin((x + y) * 0.02), 0.0, 255.0));
+    }
+  }
+  return rgb;
+}
+
+double Psnr(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+  double squared = 0;
+  for (size_t i = 0; i < a.size(); i++) {
+    double d = static_cast<double>(a[i]) - b[i];
+    squared += d * d;
+  }
+  if (squared == 0) {
+    return 100;
+  }
+  return 10 * std::log10(255.0 * 255.0 * a.size() / squared);
+}
+
+const av::YuvMatrix kMatrices[] = {av::YuvMatrix::kBt601,
+                                   av::YuvMatrix::kBt709};
+const av::YuvRange kRanges[] = {av::YuvRange::kLimited, av::YuvRange::kFull};
+
+}  // namespace
+
+TEST(RgbToYuvTest, MatchesReference) {
+  // Odd sizes cover the vector loops and the scalar tail and edges.
+  const int width = 83;
+  const int height = 37;
+  std::vector<uint8_t> rgb = MakeNoise(width, height);
+  for (av::YuvMatrix matrix : kMatrices) {
+    for (av::YuvRange range : kRanges) {
+      Yuv420p yuv(width, height);
+      yuv.Convert(rgb, matrix, range);
+
+      double kr = matrix == av::YuvMatrix::kBt709 ? 0.2126 : 0.299;
+      double kb = matrix == av::YuvMatrix::kBt709 ? 0.0722 : 0.114;
+      bool full = range == av::YuvRange::kFull;
+      double y_scale = full ? 1.0 : 219.0 / 255.0;
+      double c_scale = full ? 1.0 : 224.0 / 255.0;
+      double y_offset = full ? 0 : 16;
+      auto luma = [&](const uint8_t* p) {
+        return kr * p[0] + (1 - kr - kb) * p[1] + kb * p[2];
+      };
+      for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+          double expected =
+              y_offset + y_scale * luma(&rgb[(y * width + x) * 3]);
+          ASSERT_NEAR(yuv.planes[0][y * width + x], expected, 1.0)
+              << x << "," << y;
+        }
+      }
+      for (int cy = 0; cy < yuv.chroma_height; cy++) {
+        for (int cx = 0; cx < yuv.chroma_width; cx++) {
+          double u = 0;
+          double v = 0;
+          for (int dy = 0; dy < 2; dy++) {
+            for (int dx = 0; dx < 2; dx++) {
+              int x = std::min(cx * 2 + dx, width - 1);
+              int y = std::min(cy * 2 + dy, height - 1);
+              const uint8_t* p = &rgb[(y * width + x) * 3];
+              u += (p[2] - luma(p)) / (2 * (1 - kb)) / 4;
+              v += (p[0] - luma(p)) / (2 * (1 - kr)) / 4;
+            }
+          }
+          int i = cy * yuv.chroma_width + cx;
+          ASSERT_NEAR(yuv.planes[1][i], 128 + c_scale * u, 1.0);
+          ASSERT_NEAR(yuv.planes[2][i], 128 + c_scale * v, 1.0);
+        }
+      }
+    }
+  }
+}
+
+TEST(RgbToYuvTest, BandsMatchSingleThread) {
+  const int width = 1920;
+  const int height = 1081;
+  std::vector<uint8_t> rgb = MakeNoise(width, height);
+  base::ThreadPool pool(4);
+  Yuv420p single(width, height);
+  single.Convert(rgb, av::YuvMatrix::kBt709, av::YuvRange::kLimited);
+  Yuv420p banded(width, height);
+  banded.Convert(rgb, av::YuvMatrix::kBt709, av::YuvRange::kLimited, &pool);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(single.planes[i], banded.planes[i]);
+  }
+}
+
+TEST(RgbToYuvTest, CloseToSwscale) {
+  const int width = 640;
+  const int height = 480;
+  std::vector<uint8_t> rgb = MakeImage(width, height);
+  for (av::YuvMatrix matrix : kMatrices) {
+    for (av::YuvRange range : kRanges) {
+      Yuv420p yuv(width, height);
+      yuv.Convert(rgb, matrix, range);
+
+      // What VideoEncoder did before it had its own converter.
+      SwsContext* sws = sws_getContext(
+          width, height, AV_PIX_FMT_RGB24, width, height, AV_PIX_FMT_YUV420P,
+          SWS_LANCZOS | SWS_ACCURATE_RND, NULL, NULL, NULL);
+      ASSERT_NE(sws, nullptr);
+      const int* table = sws_getCoefficients(
+          matrix == av::YuvMatrix::kBt709 ? SWS_CS_ITU709 : SWS_CS_ITU601);
+      sws_setColorspaceDetails(sws, table, 1, table,
+                               range == av::YuvRange::kFull ? 1 : 0, 0,
+                               1 << 16, 1 << 16);
+      Yuv420p expected(width, height);
+      const uint8_t* src[] = {rgb.data()};
+      int src_stride[] = {width * 3};
+      uint8_t* dst[] = {expected.planes[0].data(), expected.planes[1].data(),
+                        expected.planes[2].data()};
+      int dst_stride[] = {width, expected.chroma_width,
+                          expected.chroma_width};
+      sws_scale(sws, src, src_stride, 0, height, dst, dst_stride);
+      sws_freeContext(sws);
+
+      EXPECT_GT(Psnr(yuv.planes[0], expected.planes[0]), 45);
+      EXPECT_GT(Psnr(yuv.planes[1], expected.planes[1]), 38);
+      EXPECT_GT(Psnr(yuv.planes[2], expected.planes[2]), 38);
+    }
+  }
+}
@@ -0,0 +1,201 @@
+#include <av/video_encoder.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <base/storage/file_writer.h>
+#include <base/storage/writer.h>
+#include <gtest/gtest.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+namespace {
+
+class CountingWriter : public base::storage::Writer {
+ public:
+  void Write(const uint8_t* data, size_t size) override { bytes_ += size; }
+
+  void MarkSyncPoint() override { sync_points_++; }
+
+  void Close() override { closed_ = true; }
+
+  size_t bytes_ = 0;
+  int sync_points_ = 0;
+  bool closed_ = false;
+};
+
+const int kWidth = 320;
+const int kHeight = 240;
+const int kFps = 30;
+
+// RGB24 gradient that moves with |index| so that every frame has to be coded.
+std::vector<uint8_t> MakeFrame(int index) {
+  std::vector<uint8_t> frame(kWidth * kHeight * 3);
+  for (int y = 0; y < kHeight; y++) {
+    for (int x = 0; x < kWidth; x++) {
+      uint8_t* pixel = &frame[(y * kWidth + x) * 3];
+      pixel[0] = static_cast<uint8_t>(x + index);
+      pixel[1] = static_cast<uint8_t>(y + index * 2);
+      pixel[2] = static_cast<uint8_t>(x + y);
+    }
+  }
+  return frame;
+}
+
+// Depth like 16 bit values using the whole range, so that a lossy or 8 bit
+// path would show.
+std::vector<uint8_t> MakeDepthFrame(int index) {
+  std::vector<uint8_t> frame(kWidth * kHeight * 2);
+  for (int y = 0; y < kHeight; y++) {
+    for (int x = 0; x < kWidth; x++) {
+      uint16_t depth = static_cast<uint16_t>(x * 211 + y * 97 + index * 1009);
+      std::memcpy(&frame[(y * kWidth + x) * 2], &depth, 2);
+    }
+  }
+  return frame;
+}
+
+// Decodes every frame of the only stream in |path| as packed rows.
+std::vector<std::vector<uint8_t>> DecodeFrames(const std::string& path,
+                                               int row_size) {
+  std::vector<std::vector<uint8_t>> frames;
+  AVFormatContext* input = NULL;
+  if (avformat_open_input(&input, path.c_str(), NULL, NULL) < 0) {
+    return frames;
+  }
+  avformat_find_stream_info(input, NULL);
+  AVCodecParameters* parameters = input->streams[0]->codecpar;
+  const AVCodec* codec = avcodec_find_decoder(parameters->codec_id);
+  AVCodecContext* decoder = avcodec_alloc_context3(codec);
+  avcodec_parameters_to_context(decoder, parameters);
+  avcodec_open2(decoder, codec, NULL);
+  AVPacket* packet = av_packet_alloc();
+  AVFrame* frame = av_frame_alloc();
+  auto receive = [&] {
+    while (avcodec_receive_frame(decoder, frame) >= 0) {
+      std::vector<uint8_t> rows(row_size * frame->height);
+      for (int y = 0; y < frame->height; y++) {
+        std::memcpy(&rows[y * row_size],
+                    frame->data[0] + y * frame->linesize[0], row_size);
+      }
+      frames.push_back(std::move(rows));
+    }
+  };
+  while (av_read_frame(input, packet) >= 0) {
+    avcodec_send_packet(decoder, packet);
+    av_packet_unref(packet);
+    receive();
+  }
+  avcodec_send_packet(decoder, NULL);
+  receive();
+  av_frame_free(&frame);
+  av_packet_free(&packet);
+  avcodec_free_context(&decoder);
+  avformat_close_input(&input);
+  return frames;
+}
+
+}  // namespace
+
+TEST(VideoEncoderTest, EncodesFrames) {
+  auto writer = std::make_unique<CountingWriter>();
+  CountingWriter* counter = writer.get();
+  av::VideoEncoder encoder(std::move(writer), kFps, kWidth, kHeight, 1000000);
+  ASSERT_TRUE(encoder.Init());
+  for (int i = 0; i < 30; i++) {
+    ASSERT_TRUE(encoder.AddFrame(MakeFrame(i)));
+  }
+  encoder.Stop();
+  EXPECT_GT(counter->bytes_, 0u);
+  EXPECT_GT(counter->sync_points_, 0);
+  EXPECT_TRUE(counter->closed_);
+}
+
+TEST(VideoEncoderTest, ReusesFrameBuffers) {
+  av::VideoEncoder encoder(std::make_unique<CountingWriter>(), kFps, kWidth,
+                           kHeight, 1000000);
+  ASSERT_TRUE(encoder.Init());
+  std::vector<std::vector<uint8_t>> frames;
+  for (int i = 0; i < 8; i++) {
+    frames.push_back(MakeFrame(i));
+  }
+  // Let the encoder fill its pipeline before counting.
+  for (int i = 0; i < 30; i++) {
+    ASSERT_TRUE(encoder.AddFrame(frames[i % frames.size()]));
+  }
+  int64_t allocations = encoder.FrameBufferAllocations();
+  EXPECT_GT(allocations, 0);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_TRUE(encoder.AddFrame(frames[i % frames.size()]));
+  }
+  EXPECT_EQ(encoder.FrameBufferAllocations(), allocations);
+  encoder.Stop();
+}
+
+TEST(VideoEncoderTest, EncodesWithBuiltInCodecs) {
+  // Codecs FFmpeg always has, so that this doesn't depend on GPL builds.
+  for (av::VideoCodec codec : {av::VideoCodec::kMpeg4, av::VideoCodec::kFfv1}) {
+    av::VideoEncoderOptions options;
+    options.codec = codec;
+    options.gop_size = 5;
+    options.max_b_frames = 0;
+    options.thread_count = 2;
+    options.threading = av::CodecThreading::kSlice;
+    // Only libx264 and libx265 understand these, others ignore them.
+    options.preset = "ultrafast";
+    options.crf = 20;
+    auto writer = std::make_unique<CountingWriter>();
+    CountingWriter* counter = writer.get();
+    av::VideoEncoder encoder(std::move(writer), kFps, kWidth, kHeight, 1000000,
+                             options);
+    ASSERT_TRUE(encoder.Init());
+    for (int i = 0; i < 20; i++) {
+      ASSERT_TRUE(encoder.AddFrame(MakeFrame(i)));
+    }
+    encoder.Stop();
+    EXPECT_GT(counter->bytes_, 0u);
+    // A keyframe at least every gop_size frames.
+    EXPECT_GE(counter->sync_points_, 4);
+  }
+}
+
+TEST(VideoEncoderTest, Gray16IsLosslessWithFfv1) {
+  std::string path = testing::TempDir() + "video_encoder_gray16.asf";
+  av::VideoEncoderOptions options;
+  options.codec = av::VideoCodec::kFfv1;
+  options.input_format = av::InputFormat::kGray16;
+  std::vector<std::vector<uint8_t>> frames;
+  {
+    av::VideoEncoder encoder(
+        std::make_unique<base::storage::FileWriter>(path.c_str()), kFps,
+        kWidth, kHeight, 0, options);
+    ASSERT_TRUE(encoder.Init());
+    for (int i = 0; i < 10; i++) {
+      frames.push_back(MakeDepthFrame(i));
+      ASSERT_TRUE(encoder.AddFrame(frames.back()));
+    }
+    encoder.Stop();
+  }
+  std::vector<std::vector<uint8_t>> decoded = DecodeFrames(path, kWidth * 2);
+  ASSERT_EQ(decoded.size(), frames.size());
+  for (size_t i = 0; i < frames.size(); i++) {
+    EXPECT_EQ(decoded[i], frames[i]) << "frame " << i;
+  }
+  std::remove(path.c_str());
+}
+
+TEST(VideoEncoderTest, Gray16NeedsCapableCodec) {
+  av::VideoEncoderOptions options;
+  options.codec = av::VideoCodec::kMpeg4;
+  options.input_format = av::InputFormat::kGray16;
+  av::VideoEncoder encoder(std::make_unique<CountingWriter>(), kFps, kWidth,
+                           kHeight, 1000000, options);
+  EXPECT_FALSE(encoder.Init());
+}
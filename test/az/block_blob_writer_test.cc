@@ -0,0 +1,92 @@
+#include <az/block_blob_writer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <loopback_blob_server.h>
+
+namespace {
+
+const char kContainer[] = "test";
+
+std::vector<uint8_t> MakeStream(size_t size) {
+  std::mt19937 rng(11);
+  std::vector<uint8_t> stream(size);
+  for (auto& b : stream) {
+    b = static_cast<uint8_t>(rng());
+  }
+  return stream;
+}
+
+// Small blocks and quick retries, with a third of stages and commits
+// failing, half of those after the request has landed.
+az::BlockBlobWriterOptions FaultyOptions() {
+  az::BlockBlobWriterOptions options;
+  options.block_size = 16 * 1024;
+  options.max_blocks_in_flight = 4;
+  options.commit_interval = std::chrono::seconds(0);
+  options.max_attempts = 100;
+  options.initial_backoff = std::chrono::milliseconds(1);
+  options.max_backoff = std::chrono::milliseconds(5);
+  options.fault_rate = 0.3;
+  return options;
+}
+
+// Writes |data| in pieces of varying size, so that blocks are cut in
+// different places from the writes.
+void WriteInPieces(base::storage::Writer* writer,
+                   const uint8_t* data,
+                   size_t size) {
+  size_t piece = 1;
+  while (size > 0) {
+    size_t n = std::min(size, piece);
+    writer->Write(data, n);
+    data += n;
+    size -= n;
+    piece = piece * 3 % 10007 + 1;
+  }
+}
+
+}  // namespace
+
+TEST(BlockBlobWriterTest, RetriesWithoutLosingOrReorderingBlocks) {
+  LoopbackBlobServer server(true);
+  ASSERT_TRUE(server.Start());
+  std::vector<uint8_t> stream = MakeStream(1024 * 1024);
+  az::BlockBlobWriter writer(server.ConnectionString(), kContainer,
+                             "retries.bin", FaultyOptions());
+  WriteInPieces(&writer, stream.data(), stream.size());
+  writer.Close();
+
+  EXPECT_FALSE(writer.Failed());
+  EXPECT_EQ(writer.CommittedBytes(), stream.size());
+  EXPECT_EQ(server.BlobContents(kContainer, "retries.bin"), stream);
+}
+
+// A periodic commit discards staged blocks it leaves out, so any staged
+// while it was being made would go missing from the blob.
+TEST(BlockBlobWriterTest, PeriodicCommitsKeepEveryBlock) {
+  LoopbackBlobServer server(true);
+  ASSERT_TRUE(server.Start());
+  std::vector<uint8_t> stream = MakeStream(1024 * 1024);
+  az::BlockBlobWriterOptions options = FaultyOptions();
+  options.commit_interval = std::chrono::seconds(1);
+  az::BlockBlobWriter writer(server.ConnectionString(), kContainer,
+                             "periodic.bin", options);
+  size_t half = stream.size() / 2;
+  WriteInPieces(&writer, stream.data(), half);
+  std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+  WriteInPieces(&writer, stream.data() + half, stream.size() - half);
+  EXPECT_GT(writer.CommittedBytes().value_or(0), 0u);
+  EXPECT_GT(server.BlobSize(kContainer, "periodic.bin"), 0u);
+  writer.Close();
+
+  EXPECT_FALSE(writer.Failed());
+  EXPECT_EQ(writer.CommittedBytes(), stream.size());
+  EXPECT_EQ(server.BlobContents(kContainer, "periodic.bin"), stream);
+}
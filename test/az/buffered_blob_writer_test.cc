@@ -0,0 +1,183 @@
+#include <az/buffered_blob_writer.h>
+
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <base/storage/spilling_writer.h>
+#include <gtest/gtest.h>
+#include <loopback_blob_server.h>
+
+#if !defined(_WIN32)
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char kContainer[] = "test";
+
+std::vector<uint8_t> MakeStream(size_t size) {
+  std::mt19937 rng(7);
+  std::vector<uint8_t> stream(size);
+  for (auto& b : stream) {
+    b = static_cast<uint8_t>(rng());
+  }
+  return stream;
+}
+
+// Small chunks and quick retries, with a third of appends failing, half of
+// those after the append has landed.
+az::BufferedBlobWriterOptions FaultyOptions() {
+  az::BufferedBlobWriterOptions options;
+  options.max_chunk_size_bytes = 16 * 1024;
+  options.buffer_count = 3;
+  options.max_attempts = 100;
+  options.initial_backoff = std::chrono::milliseconds(1);
+  options.max_backoff = std::chrono::milliseconds(5);
+  options.fault_rate = 0.3;
+  return options;
+}
+
+// Writes |data| in pieces of varying size, so that chunks are cut in
+// different places from the writes.
+void WriteInPieces(base::storage::Writer* writer,
+                   const uint8_t* data,
+                   size_t size) {
+  size_t piece = 1;
+  while (size > 0) {
+    size_t n = std::min(size, piece);
+    writer->Write(data, n);
+    data += n;
+    size -= n;
+    piece = piece * 3 % 10007 + 1;
+  }
+}
+
+}  // namespace
+
+TEST(BufferedBlobWriterTest, RetriesWithoutLosingOrRepeatingChunks) {
+  LoopbackBlobServer server(true);
+  ASSERT_TRUE(server.Start());
+  std::vector<uint8_t> stream = MakeStream(1024 * 1024);
+  az::BufferedBlobWriter writer(server.ConnectionString(), kContainer,
+                                "retries.bin", FaultyOptions());
+  WriteInPieces(&writer, stream.data(), stream.size());
+  writer.Close();
+
+  EXPECT_FALSE(writer.Failed());
+  EXPECT_EQ(writer.GetMetrics().uploaded_bytes, stream.size());
+  EXPECT_EQ(server.BlobContents(kContainer, "retries.bin"), stream);
+}
+
+// Chunks grow while appends are quick and shrink once they slow down, but
+// never past the limits.
+TEST(BufferedBlobWriterTest, AdaptsChunkSizeToLatency) {
+  LoopbackBlobServer server(true);
+  ASSERT_TRUE(server.Start());
+  az::BufferedBlobWriterOptions options;
+  options.adaptive_chunk_size = true;
+  options.min_chunk_size_bytes = 16 * 1024;
+  options.max_chunk_size_bytes = 256 * 1024;
+  options.target_chunk_latency = std::chrono::milliseconds(20);
+  az::BufferedBlobWriter writer(server.ConnectionString(), kContainer,
+                                "adaptive.bin", options);
+  std::vector<uint8_t> stream = MakeStream(8 * 1024);
+  std::vector<uint8_t> written;
+  std::vector<size_t> chunk_sizes;
+  // Writes until |done| holds of the chunk size, or gives up after a while.
+  auto write_until = [&](auto done) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(20);
+    while (std::chrono::steady_clock::now() < deadline) {
+      writer.Write(stream.data(), stream.size());
+      written.insert(written.end(), stream.begin(), stream.end());
+      chunk_sizes.push_back(writer.GetMetrics().chunk_size_bytes);
+      if (done(chunk_sizes.back())) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  EXPECT_EQ(writer.GetMetrics().chunk_size_bytes, options.min_chunk_size_bytes);
+  server.SetLatency(std::chrono::milliseconds(2));
+  EXPECT_TRUE(write_until(
+      [&](size_t size) { return size == options.max_chunk_size_bytes; }));
+  server.SetLatency(std::chrono::milliseconds(100));
+  EXPECT_TRUE(write_until(
+      [&](size_t size) { return size < options.max_chunk_size_bytes; }));
+  writer.Close();
+
+  for (size_t size : chunk_sizes) {
+    EXPECT_GE(size, options.min_chunk_size_bytes);
+    EXPECT_LE(size, options.max_chunk_size_bytes);
+  }
+  az::BlobUploadMetrics metrics = writer.GetMetrics();
+  EXPECT_GT(metrics.upload_bytes_per_second, 0);
+  EXPECT_GT(metrics.input_bytes_per_second, 0);
+  EXPECT_GE(metrics.last_append_latency.count(), 0.1);
+  EXPECT_EQ(metrics.uploaded_bytes, written.size());
+  EXPECT_EQ(metrics.backlog_bytes, 0u);
+  EXPECT_FALSE(writer.Failed());
+  EXPECT_EQ(server.BlobContents(kContainer, "adaptive.bin"), written);
+}
+
+#if !defined(_WIN32)
+
+TEST(BufferedBlobWriterTest, RecoversBlobAfterWriterIsKilled) {
+  LoopbackBlobServer server(true);
+  ASSERT_TRUE(server.Start());
+  std::vector<uint8_t> stream = MakeStream(2 * 1024 * 1024);
+  size_t written = stream.size() * 3 / 4;
+  std::string journal = testing::TempDir() + "buffered_blob_killed.journal";
+  std::filesystem::remove_all(journal);
+  base::storage::SpillingWriterOptions options;
+  options.journal_path = journal;
+
+  // The child dies once part of the stream is in the blob, with the rest
+  // still in the spilling writer's memory, in the ring and in flight, as a
+  // capture that crashes would.
+  pid_t child = fork();
+  ASSERT_NE(child, -1);
+  if (child == 0) {
+    base::storage::SpillingWriter writer(
+        std::make_unique<az::BufferedBlobWriter>(
+            server.ConnectionString(), kContainer, "killed.bin",
+            FaultyOptions()),
+        options);
+    WriteInPieces(&writer, stream.data(), written);
+    while (writer.GetStats().committed_bytes < written / 3) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    kill(getpid(), SIGKILL);
+  }
+  int status = 0;
+  ASSERT_EQ(waitpid(child, &status, 0), child);
+  ASSERT_TRUE(WIFSIGNALED(status));
+
+  uint64_t position = 0;
+  ASSERT_TRUE(base::storage::ReadJournalResumePosition(journal, &position));
+  EXPECT_LE(position, server.BlobContents(kContainer, "killed.bin").size());
+  az::BufferedBlobWriterOptions resume_options = FaultyOptions();
+  resume_options.resume_offset = position;
+  {
+    base::storage::SpillingWriter writer(
+        std::make_unique<az::BufferedBlobWriter>(
+            server.ConnectionString(), kContainer, "killed.bin",
+            resume_options),
+        options);
+    EXPECT_EQ(writer.GetStats().recovered_bytes, written - position);
+    WriteInPieces(&writer, stream.data() + written, stream.size() - written);
+    writer.Close();
+  }
+
+  EXPECT_EQ(server.BlobContents(kContainer, "killed.bin"), stream);
+  EXPECT_FALSE(std::filesystem::exists(journal));
+}
+
+#endif  // !defined(_WIN32)
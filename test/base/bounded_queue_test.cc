@@ -0,0 +1,42 @@
+#include <base/bounded_queue.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+TEST(BoundedQueueTest, DropPolicies) {
+  base::BoundedQueue<int> drop_newest(2, base::OverflowPolicy::kDropNewest);
+  EXPECT_TRUE(drop_newest.Push(1));
+  EXPECT_TRUE(drop_newest.Push(2));
+  EXPECT_FALSE(drop_newest.Push(3));
+  EXPECT_EQ(drop_newest.Dropped(), 1u);
+  EXPECT_EQ(*drop_newest.Pop(), 1);
+
+  base::BoundedQueue<int> drop_oldest(2, base::OverflowPolicy::kDropOldest);
+  drop_oldest.Push(1);
+  drop_oldest.Push(2);
+  EXPECT_TRUE(drop_oldest.Push(3));
+  EXPECT_EQ(drop_oldest.Dropped(), 1u);
+  EXPECT_EQ(*drop_oldest.Pop(), 2);
+  EXPECT_EQ(*drop_oldest.Pop(), 3);
+  drop_oldest.Close();
+  EXPECT_FALSE(drop_oldest.Pop().has_value());
+}
+
+TEST(BoundedQueueTest, BlockingPushWaitsForSpace) {
+  base::BoundedQueue<int> q(1, base::OverflowPolicy::kBlock);
+  q.Push(1);
+  std::atomic<bool> pushed = false;
+  std::thread producer([&] {
+    q.Push(2);
+    pushed = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_FALSE(pushed);
+  EXPECT_EQ(*q.Pop(), 1);
+  producer.join();
+  EXPECT_TRUE(pushed);
+  EXPECT_EQ(*q.Pop(), 2);
+}
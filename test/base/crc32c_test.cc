@@ -0,0 +1,63 @@
+#include <base/crc32c.h>
+#include <base/thread_pool.h>
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+const uint8_t* Bytes(const char* s) {
+  return reinterpret_cast<const uint8_t*>(s);
+}
+
+std::vector<uint8_t> RandomBytes(size_t size) {
+  std::mt19937 rng(99);
+  std::vector<uint8_t> data(size);
+  for (auto& b : data) {
+    b = static_cast<uint8_t>(rng());
+  }
+  return data;
+}
+
+}  // namespace
+
+TEST(Crc32cTest, KnownValues) {
+  EXPECT_EQ(base::Crc32c(nullptr, 0), 0u);
+  EXPECT_EQ(base::Crc32c(Bytes("123456789"), 9), 0xE3069283u);
+  // From RFC 3720, 32 bytes of zeros and of ones.
+  std::vector<uint8_t> zeros(32, 0);
+  std::vector<uint8_t> ones(32, 0xff);
+  EXPECT_EQ(base::Crc32c(zeros.data(), zeros.size()), 0x8A9136AAu);
+  EXPECT_EQ(base::Crc32c(ones.data(), ones.size()), 0x62A8AB43u);
+}
+
+TEST(Crc32cTest, ExtendMatchesWhole) {
+  std::vector<uint8_t> data = RandomBytes(1000);
+  uint32_t whole = base::Crc32c(data.data(), data.size());
+  for (size_t split : {0, 1, 7, 8, 9, 500, 999, 1000}) {
+    uint32_t crc = base::Crc32c(data.data(), split);
+    EXPECT_EQ(base::Crc32cExtend(crc, data.data() + split, data.size() - split),
+              whole)
+        << split;
+  }
+}
+
+TEST(Crc32cTest, CombineMatchesWhole) {
+  std::vector<uint8_t> data = RandomBytes(5000);
+  uint32_t whole = base::Crc32c(data.data(), data.size());
+  for (size_t split : {0, 1, 13, 2048, 4999, 5000}) {
+    uint32_t a = base::Crc32c(data.data(), split);
+    uint32_t b = base::Crc32c(data.data() + split, data.size() - split);
+    EXPECT_EQ(base::Crc32cCombine(a, b, data.size() - split), whole) << split;
+  }
+}
+
+TEST(Crc32cTest, ParallelMatchesSerial) {
+  base::ThreadPool pool(4);
+  std::vector<uint8_t> data = RandomBytes(5 * 1024 * 1024 + 123);
+  EXPECT_EQ(base::Crc32cParallel(data.data(), data.size(), &pool),
+            base::Crc32c(data.data(), data.size()));
+}
@@ -0,0 +1,77 @@
+#include <base/storage/async_file_writer.h>
+
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+std::vector<uint8_t> ReadFile(const std::string& path) {
+  std::ifstream f(path, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(f), {});
+}
+
+std::vector<uint8_t> MakeData(size_t size) {
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i < size; i++)
+    data[i] = static_cast<uint8_t>((i * 31) ^ (i >> 8));
+  return data;
+}
+
+class AsyncFileWriterTest : public testing::TestWithParam<bool> {};
+
+}  // namespace
+
+TEST_P(AsyncFileWriterTest, WritesMixedSizes) {
+  std::string path = testing::TempDir() + "async_file_writer_test.bin";
+  base::storage::AsyncFileWriterOptions options;
+  options.chunk_size = 64 * 1024;
+  options.chunk_count = 3;
+  options.use_io_uring = GetParam();
+  options.preallocate_bytes = 4 * 1024 * 1024;
+
+  std::vector<uint8_t> data = MakeData(1024 * 1024 + 123);
+  base::storage::AsyncFileWriter writer(path.c_str(), options);
+  ASSERT_FALSE(writer.Failed());
+  size_t offset = 0;
+  size_t sizes[] = {17, 500 * 1024, 3, 64 * 1024, 4096, 100000};
+  for (size_t i = 0; offset < data.size(); i++) {
+    size_t size = std::min(sizes[i % 6], data.size() - offset);
+    writer.Write(data.data() + offset, size);
+    offset += size;
+    if (i == 2)
+      writer.Flush();
+  }
+  writer.Close();
+  EXPECT_FALSE(writer.Failed());
+  EXPECT_EQ(ReadFile(path), data);
+  std::remove(path.c_str());
+}
+
+TEST_P(AsyncFileWriterTest, DirectIoKeepsUnalignedTail) {
+  std::string path = testing::TempDir() + "async_file_writer_direct.bin";
+  base::storage::AsyncFileWriterOptions options;
+  options.chunk_size = 16 * 1024;
+  options.direct_io = true;
+  options.use_io_uring = GetParam();
+
+  std::vector<uint8_t> data = MakeData(100 * 1024 + 7);
+  {
+    base::storage::AsyncFileWriter writer(path.c_str(), options);
+    writer.Write(data.data(), 5000);
+    writer.Flush();
+    writer.Write(data.data() + 5000, data.size() - 5000);
+  }
+  EXPECT_EQ(ReadFile(path), data);
+  std::remove(path.c_str());
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends,
+                         AsyncFileWriterTest,
+                         testing::Values(true, false));
@@ -0,0 +1,176 @@
+#include <base/storage/broadcast_writer.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// Collects everything written to it, optionally taking a while over each
+// write. Owned by the BroadcastWriter, so the test keeps a pointer to the
+// shared state instead.
+struct Recording {
+  std::mutex m;
+  std::vector<uint8_t> bytes;
+  int flushes = 0;
+  // Byte positions of the sync points seen.
+  std::vector<size_t> sync_points;
+  bool closed = false;
+};
+
+class RecordingWriter : public base::storage::Writer {
+ public:
+  RecordingWriter(Recording* recording, std::chrono::milliseconds delay)
+      : recording_(recording), delay_(delay) {}
+
+  void Write(const uint8_t* data, size_t size) override {
+    std::this_thread::sleep_for(delay_);
+    std::unique_lock<std::mutex> lock(recording_->m);
+    recording_->bytes.insert(recording_->bytes.end(), data, data + size);
+  }
+
+  void Flush() override {
+    std::unique_lock<std::mutex> lock(recording_->m);
+    recording_->flushes++;
+  }
+
+  void MarkSyncPoint() override {
+    std::unique_lock<std::mutex> lock(recording_->m);
+    recording_->sync_points.push_back(recording_->bytes.size());
+  }
+
+  void Close() override {
+    std::unique_lock<std::mutex> lock(recording_->m);
+    recording_->closed = true;
+  }
+
+ private:
+  Recording* recording_;
+  std::chrono::milliseconds delay_;
+};
+
+std::unique_ptr<base::storage::BroadcastWriter> MakeWriter(
+    Recording* fast,
+    Recording* slow,
+    base::storage::LaggingSinkPolicy policy) {
+  std::vector<std::unique_ptr<base::storage::Writer>> writers;
+  writers.push_back(
+      std::make_unique<RecordingWriter>(fast, std::chrono::milliseconds(0)));
+  writers.push_back(
+      std::make_unique<RecordingWriter>(slow, std::chrono::milliseconds(2)));
+  base::storage::BroadcastOptions options;
+  options.asynchronous = true;
+  options.max_queued_chunks = 4;
+  options.lagging_sink_policy = policy;
+  options.spill_directory = testing::TempDir();
+  return std::make_unique<base::storage::BroadcastWriter>(std::move(writers),
+                                                          options);
+}
+
+std::vector<uint8_t> WriteSequence(
+    base::storage::Writer* writer,
+    std::chrono::milliseconds interval = std::chrono::milliseconds(0)) {
+  std::vector<uint8_t> expected;
+  for (int i = 0; i < 50; i++) {
+    std::vector<uint8_t> data(100 + i, static_cast<uint8_t>(i));
+    writer->Write(data.data(), data.size());
+    std::this_thread::sleep_for(interval);
+    expected.insert(expected.end(), data.begin(), data.end());
+  }
+  return expected;
+}
+
+}  // namespace
+
+TEST(BroadcastWriterTest, BlockDeliversEverything) {
+  Recording fast, slow;
+  auto writer =
+      MakeWriter(&fast, &slow, base::storage::LaggingSinkPolicy::kBlock);
+  auto expected = WriteSequence(writer.get());
+  writer->Flush();
+  writer->Close();
+  EXPECT_EQ(fast.bytes, expected);
+  EXPECT_EQ(slow.bytes, expected);
+  EXPECT_TRUE(fast.closed);
+  EXPECT_TRUE(slow.closed);
+  EXPECT_EQ(fast.flushes, 1);
+  auto stats = writer->GetSinkStats();
+  ASSERT_EQ(stats.size(), 2u);
+  EXPECT_EQ(stats[1].bytes_written, expected.size());
+  EXPECT_EQ(stats[1].lag_bytes, 0u);
+  EXPECT_GT(stats[1].max_lag_bytes, 0u);
+}
+
+TEST(BroadcastWriterTest, DropSinkKeepsOthersWhole) {
+  Recording fast, slow;
+  auto writer =
+      MakeWriter(&fast, &slow, base::storage::LaggingSinkPolicy::kDropSink);
+  // Paced so that only the slow sink falls behind.
+  auto expected = WriteSequence(writer.get(), std::chrono::milliseconds(1));
+  writer->Close();
+  EXPECT_EQ(fast.bytes, expected);
+  EXPECT_LT(slow.bytes.size(), expected.size());
+  EXPECT_TRUE(slow.closed);
+  auto stats = writer->GetSinkStats();
+  EXPECT_FALSE(stats[0].dropped);
+  EXPECT_TRUE(stats[1].dropped);
+}
+
+TEST(BroadcastWriterTest, SpillToDiskKeepsOrder) {
+  Recording fast, slow;
+  auto writer =
+      MakeWriter(&fast, &slow, base::storage::LaggingSinkPolicy::kSpillToDisk);
+  auto expected = WriteSequence(writer.get());
+  writer->Close();
+  EXPECT_EQ(fast.bytes, expected);
+  EXPECT_EQ(slow.bytes, expected);
+  auto stats = writer->GetSinkStats();
+  EXPECT_GT(stats[1].spilled_bytes, 0u);
+  EXPECT_EQ(stats[1].bytes_written, expected.size());
+}
+
+TEST(BroadcastWriterTest, SyncPointsStayInOrder) {
+  Recording fast, slow;
+  auto writer =
+      MakeWriter(&fast, &slow, base::storage::LaggingSinkPolicy::kBlock);
+  std::vector<size_t> expected;
+  size_t written = 0;
+  for (int i = 0; i < 20; i++) {
+    if (i % 5 == 0) {
+      writer->MarkSyncPoint();
+      expected.push_back(written);
+    }
+    std::vector<uint8_t> data(10, static_cast<uint8_t>(i));
+    writer->Write(data.data(), data.size());
+    written += data.size();
+  }
+  writer->Close();
+  EXPECT_EQ(fast.sync_points, expected);
+  EXPECT_EQ(slow.sync_points, expected);
+}
+
+TEST(BroadcastWriterTest, SyncPointsFollowSpilledData) {
+  Recording fast, slow;
+  auto writer =
+      MakeWriter(&fast, &slow, base::storage::LaggingSinkPolicy::kSpillToDisk);
+  std::vector<size_t> expected;
+  size_t written = 0;
+  for (int i = 0; i < 50; i++) {
+    if (i % 5 == 0) {
+      writer->MarkSyncPoint();
+      expected.push_back(written);
+    }
+    std::vector<uint8_t> data(100 + i, static_cast<uint8_t>(i));
+    writer->Write(data.data(), data.size());
+    written += data.size();
+  }
+  writer->Close();
+  EXPECT_EQ(fast.sync_points, expected);
+  EXPECT_EQ(slow.sync_points, expected);
+  EXPECT_EQ(slow.bytes.size(), written);
+  EXPECT_GT(writer->GetSinkStats()[1].spilled_bytes, 0u);
+}
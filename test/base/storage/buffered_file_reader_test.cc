@@ -0,0 +1,89 @@
+#include <base/storage/buffered_file_reader.h>
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+std::vector<uint8_t> WriteTestFile(const std::string& path, size_t size) {
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i < size; i++) {
+    data[i] = static_cast<uint8_t>(i * 31 + i / 256);
+  }
+  std::ofstream f(path, std::ios::binary);
+  f.write(reinterpret_cast<const char*>(data.data()), data.size());
+  return data;
+}
+
+base::storage::BufferedFileReaderOptions SmallBuffers() {
+  base::storage::BufferedFileReaderOptions options;
+  options.buffer_size = 4096;
+  options.buffer_count = 3;
+  return options;
+}
+
+}  // namespace
+
+TEST(BufferedFileReaderTest, ReadsSequentially) {
+  std::string path = testing::TempDir() + "buffered_file_reader_seq.bin";
+  std::vector<uint8_t> expected = WriteTestFile(path, 100003);
+  {
+    base::storage::BufferedFileReader reader(path.c_str(), SmallBuffers());
+    ASSERT_FALSE(reader.Failed());
+    EXPECT_EQ(reader.Size(), expected.size());
+    std::vector<uint8_t> actual;
+    std::vector<uint8_t> chunk(1000);
+    while (true) {
+      // Alternate between copying and viewing.
+      size_t n = reader.Read(chunk.data(), chunk.size());
+      actual.insert(actual.end(), chunk.begin(), chunk.begin() + n);
+      auto next = reader.Next(3000);
+      actual.insert(actual.end(), next.begin(), next.end());
+      if (n == 0 && next.empty()) {
+        break;
+      }
+    }
+    EXPECT_EQ(actual, expected);
+    EXPECT_EQ(reader.Position(), expected.size());
+    EXPECT_FALSE(reader.Failed());
+  }
+  std::remove(path.c_str());
+}
+
+TEST(BufferedFileReaderTest, SeeksAnywhere) {
+  std::string path = testing::TempDir() + "buffered_file_reader_seek.bin";
+  std::vector<uint8_t> expected = WriteTestFile(path, 50000);
+  {
+    base::storage::BufferedFileReader reader(path.c_str(), SmallBuffers());
+    std::mt19937 rng(7);
+    std::vector<uint8_t> actual(3000);
+    for (int i = 0; i < 200; i++) {
+      // Mostly short hops forward, which stay inside the read-ahead.
+      uint64_t offset =
+          i % 4 ? std::min<uint64_t>(reader.Position() + rng() % 5000,
+                                     expected.size())
+                : rng() % expected.size();
+      ASSERT_TRUE(reader.Seek(offset));
+      size_t requested = rng() % actual.size();
+      size_t n = reader.Read(actual.data(), requested);
+      ASSERT_EQ(n, std::min<size_t>(requested, expected.size() - offset));
+      EXPECT_TRUE(std::equal(actual.begin(), actual.begin() + n,
+                             expected.begin() + offset))
+          << offset;
+    }
+    EXPECT_FALSE(reader.Seek(expected.size() + 1));
+  }
+  std::remove(path.c_str());
+}
+
+TEST(BufferedFileReaderTest, FailsOnMissingFile) {
+  base::storage::BufferedFileReader reader(
+      (testing::TempDir() + "buffered_file_reader_missing.bin").c_str());
+  EXPECT_TRUE(reader.Failed());
+  EXPECT_TRUE(reader.Next(10).empty());
+}
@@ -0,0 +1,96 @@
+#include <base/storage/checksumming_writer.h>
+
+#include <base/crc32c.h>
+#include <base/storage/file_writer.h>
+#include <base/thread_pool.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+std::vector<uint8_t> ReadFile(const std::string& path) {
+  std::ifstream f(path, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(f), {});
+}
+
+std::vector<uint8_t> WriteStream(const std::string& path,
+                                 const std::string& sidecar_path,
+                                 size_t size) {
+  std::mt19937 rng(3);
+  std::vector<uint8_t> data(size);
+  for (auto& b : data) {
+    b = static_cast<uint8_t>(rng());
+  }
+  base::storage::ChecksumOptions options;
+  options.chunk_size = 1000;
+  base::storage::ChecksummingWriter writer(
+      std::make_unique<base::storage::FileWriter>(path.c_str()),
+      std::make_unique<base::storage::FileWriter>(sidecar_path.c_str()),
+      options);
+  for (size_t pos = 0; pos < size; pos += 333) {
+    writer.Write(data.data() + pos, std::min<size_t>(333, size - pos));
+  }
+  EXPECT_EQ(writer.StreamCrc(), base::Crc32c(data.data(), data.size()));
+  writer.Close();
+  return data;
+}
+
+}  // namespace
+
+TEST(ChecksummingWriterTest, DetectsCorruptChunks) {
+  std::string path = testing::TempDir() + "checksumming_writer_test.bin";
+  std::string sidecar_path = path + ".crc";
+  std::vector<uint8_t> expected = WriteStream(path, sidecar_path, 10500);
+  std::vector<uint8_t> actual = ReadFile(path);
+  EXPECT_EQ(actual, expected);
+
+  base::storage::ChecksumSidecar sidecar;
+  ASSERT_TRUE(base::storage::ReadChecksumSidecar(sidecar_path, &sidecar));
+  EXPECT_TRUE(sidecar.complete);
+  EXPECT_EQ(sidecar.chunk_size, 1000u);
+  EXPECT_EQ(sidecar.chunk_crcs.size(), 11u);
+  EXPECT_EQ(sidecar.total_size, expected.size());
+  EXPECT_EQ(sidecar.stream_crc, base::Crc32c(expected.data(), expected.size()));
+
+  base::ThreadPool pool(3);
+  EXPECT_TRUE(base::storage::FindCorruptChunks(actual.data(), actual.size(),
+                                               sidecar, &pool)
+                  .empty());
+  actual[2500] ^= 1;
+  actual[10499] ^= 0x80;
+  EXPECT_EQ(base::storage::FindCorruptChunks(actual.data(), actual.size(),
+                                             sidecar, &pool),
+            (std::vector<size_t>{2, 10}));
+  // A truncated stream fails the chunks it no longer has.
+  EXPECT_EQ(base::storage::FindCorruptChunks(expected.data(), 9000, sidecar),
+            (std::vector<size_t>{9, 10}));
+  std::remove(path.c_str());
+  std::remove(sidecar_path.c_str());
+}
+
+TEST(ChecksummingWriterTest, ReadsUnfinishedSidecar) {
+  std::string path = testing::TempDir() + "checksumming_writer_unfinished.bin";
+  std::string sidecar_path = path + ".crc";
+  std::vector<uint8_t> expected = WriteStream(path, sidecar_path, 10500);
+  // Cut the sidecar back to what it held before Close, as after a crash.
+  std::filesystem::resize_file(
+      sidecar_path, std::filesystem::file_size(sidecar_path) - 16 - 4);
+
+  base::storage::ChecksumSidecar sidecar;
+  ASSERT_TRUE(base::storage::ReadChecksumSidecar(sidecar_path, &sidecar));
+  EXPECT_FALSE(sidecar.complete);
+  EXPECT_EQ(sidecar.chunk_crcs.size(), 10u);
+  EXPECT_TRUE(base::storage::FindCorruptChunks(expected.data(),
+                                               expected.size(), sidecar)
+                  .empty());
+  std::remove(path.c_str());
+  std::remove(sidecar_path.c_str());
+}
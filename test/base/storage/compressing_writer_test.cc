@@ -0,0 +1,151 @@
+#include <base/storage/compressed_reader.h>
+#include <base/storage/compressing_writer.h>
+#include <base/storage/file_writer.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// Alternates runs of repeated bytes, which compress well, with noise, which
+// doesn't, so both stored and compressed blocks turn up.
+std::vector<uint8_t> MakeData(size_t size) {
+  std::mt19937 rng(1234);
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i < size; i++) {
+    data[i] = (i / 5000) % 2 ? static_cast<uint8_t>(rng())
+                             : static_cast<uint8_t>(i / 100);
+  }
+  return data;
+}
+
+class CompressingWriterTest
+    : public testing::TestWithParam<base::storage::CompressionCodec> {
+ protected:
+  std::string Path() const {
+    return testing::TempDir() + "compressing_writer_test_" +
+           std::to_string(static_cast<int>(GetParam())) + ".mcz";
+  }
+
+  std::vector<uint8_t> WriteFile(const std::string& path, size_t size) {
+    std::vector<uint8_t> data = MakeData(size);
+    base::storage::CompressionOptions options;
+    options.codec = GetParam();
+    options.block_size = 4096;
+    options.pool = &pool_;
+    base::storage::CompressingWriter writer(
+        std::make_unique<base::storage::FileWriter>(path.c_str()), options);
+    for (size_t pos = 0; pos < data.size(); pos += 1000) {
+      size_t n = std::min<size_t>(1000, data.size() - pos);
+      writer.Write(data.data() + pos, n);
+      if (pos == 10000) {
+        // Leaves a short block in the middle.
+        writer.Flush();
+      }
+    }
+    writer.Close();
+    EXPECT_EQ(writer.RawBytes(), data.size());
+    EXPECT_EQ(writer.CompressedBytes(), std::filesystem::file_size(path));
+    if (GetParam() != base::storage::CompressionCodec::kNone) {
+      EXPECT_LT(writer.CompressedBytes(), data.size() * 3 / 4);
+    }
+    return data;
+  }
+
+  base::ThreadPool pool_{4};
+};
+
+}  // namespace
+
+TEST_P(CompressingWriterTest, RoundTrips) {
+  std::string path = Path();
+  std::vector<uint8_t> expected = WriteFile(path, 100000);
+
+  base::storage::CompressedReader reader(path.c_str());
+  ASSERT_FALSE(reader.Failed());
+  EXPECT_EQ(reader.Codec(), GetParam());
+  EXPECT_EQ(reader.Size(), expected.size());
+  EXPECT_EQ(reader.NumBlocks(), 25u);
+  std::vector<uint8_t> actual;
+  ASSERT_TRUE(reader.ReadAll(&actual, &pool_));
+  EXPECT_EQ(actual, expected);
+  std::remove(path.c_str());
+}
+
+TEST_P(CompressingWriterTest, ReadsAtAnyOffset) {
+  std::string path = Path();
+  std::vector<uint8_t> expected = WriteFile(path, 50000);
+
+  base::storage::CompressedReader reader(path.c_str());
+  std::mt19937 rng(5);
+  for (int i = 0; i < 50; i++) {
+    uint64_t offset = rng() % expected.size();
+    std::vector<uint8_t> actual(rng() % 10000);
+    size_t n = reader.ReadAt(offset, actual.data(), actual.size());
+    ASSERT_EQ(n, std::min<size_t>(actual.size(), expected.size() - offset));
+    EXPECT_TRUE(std::equal(actual.begin(), actual.begin() + n,
+                           expected.begin() + offset));
+  }
+  std::remove(path.c_str());
+}
+
+TEST_P(CompressingWriterTest, RecoversUnfinishedFile) {
+  std::string path = Path();
+  WriteFile(path, 30000);
+  base::storage::CompressedReader whole(path.c_str());
+  std::vector<uint8_t> blocks;
+  for (size_t i = 0; i + 1 < whole.NumBlocks(); i++) {
+    std::vector<uint8_t> block;
+    ASSERT_TRUE(whole.ReadBlock(i, &block));
+    blocks.insert(blocks.end(), block.begin(), block.end());
+  }
+  // Cut the file part way into the last block, losing the index with it.
+  uint64_t trailer = 12 + 16 * whole.NumBlocks() + 16;
+  std::filesystem::resize_file(path,
+                               std::filesystem::file_size(path) - trailer - 10);
+
+  base::storage::CompressedReader reader(path.c_str());
+  ASSERT_FALSE(reader.Failed());
+  EXPECT_EQ(reader.NumBlocks(), whole.NumBlocks() - 1);
+  std::vector<uint8_t> actual;
+  ASSERT_TRUE(reader.ReadAll(&actual, &pool_));
+  EXPECT_EQ(actual, blocks);
+  std::remove(path.c_str());
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Codecs,
+    CompressingWriterTest,
+    testing::Values(base::storage::CompressionCodec::kNone,
+                    base::storage::CompressionCodec::kLz4,
+                    base::storage::CompressionCodec::kZstd),
+    [](const testing::TestParamInfo<base::storage::CompressionCodec>& info) {
+      switch (info.param) {
+        case base::storage::CompressionCodec::kNone:
+          return "None";
+        case base::storage::CompressionCodec::kLz4:
+          return "Lz4";
+        case base::storage::CompressionCodec::kZstd:
+          return "Zstd";
+      }
+      return "Unknown";
+    });
+
+TEST(CompressedReaderTest, RejectsOtherFiles) {
+  std::string path = testing::TempDir() + "compressed_reader_not_mcz.bin";
+  {
+    base::storage::FileWriter writer(path.c_str());
+    uint8_t bytes[32] = {};
+    writer.Write(bytes, sizeof(bytes));
+    writer.Close();
+  }
+  EXPECT_TRUE(base::storage::CompressedReader(path.c_str()).Failed());
+  EXPECT_TRUE(
+      base::storage::CompressedReader((path + ".missing").c_str()).Failed());
+  std::remove(path.c_str());
+}
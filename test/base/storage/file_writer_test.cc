@@ -0,0 +1,70 @@
+#include <base/storage/file_writer.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <base/storage/broadcast_writer.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+std::vector<uint8_t> ReadFile(const std::string& path) {
+  std::ifstream f(path, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(f), {});
+}
+
+}  // namespace
+
+TEST(FileWriterTest, WriteAndWriteV) {
+  std::string path = testing::TempDir() + "file_writer_test.bin";
+  std::vector<uint8_t> expected;
+  std::vector<uint8_t> header = {1, 2, 3};
+  // More fragments than fit in a single writev call.
+  std::vector<std::vector<uint8_t>> fragments;
+  for (int i = 0; i < 3000; i++)
+    fragments.push_back(std::vector<uint8_t>(i % 7, static_cast<uint8_t>(i)));
+  {
+    base::storage::FileWriter writer(path.c_str());
+    writer.Write(header.data(), header.size());
+    expected.insert(expected.end(), header.begin(), header.end());
+
+    std::vector<base::storage::WriteBuffer> buffers;
+    for (const auto& f : fragments) {
+      buffers.push_back({f.data(), f.size()});
+      expected.insert(expected.end(), f.begin(), f.end());
+    }
+    writer.WriteV(buffers);
+    writer.Flush();
+    writer.Close();
+  }
+  EXPECT_EQ(ReadFile(path), expected);
+  std::remove(path.c_str());
+}
+
+TEST(FileWriterTest, BroadcastForwardsFragments) {
+  std::string path_a = testing::TempDir() + "broadcast_a.bin";
+  std::string path_b = testing::TempDir() + "broadcast_b.bin";
+  std::vector<std::unique_ptr<base::storage::Writer>> writers;
+  writers.push_back(
+      std::make_unique<base::storage::FileWriter>(path_a.c_str()));
+  writers.push_back(
+      std::make_unique<base::storage::FileWriter>(path_b.c_str()));
+  base::storage::BroadcastWriter writer(std::move(writers));
+
+  const uint8_t header[] = {'h', 'd', 'r'};
+  const uint8_t payload[] = {'p', 'a', 'y', 'l', 'o', 'a', 'd'};
+  base::storage::WriteBuffer buffers[] = {{header, sizeof(header)},
+                                          {payload, sizeof(payload)}};
+  writer.WriteV(buffers);
+  writer.Close();
+
+  std::vector<uint8_t> expected = {'h', 'd', 'r', 'p', 'a',
+                                   'y', 'l', 'o', 'a', 'd'};
+  EXPECT_EQ(ReadFile(path_a), expected);
+  EXPECT_EQ(ReadFile(path_b), expected);
+  std::remove(path_a.c_str());
+  std::remove(path_b.c_str());
+}
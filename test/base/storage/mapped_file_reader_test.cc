@@ -0,0 +1,65 @@
+#include <base/storage/mapped_file_reader.h>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+std::vector<uint8_t> WriteTestFile(const std::string& path, size_t size) {
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i < size; i++) {
+    data[i] = static_cast<uint8_t>(i * 31 + i / 256);
+  }
+  std::ofstream f(path, std::ios::binary);
+  f.write(reinterpret_cast<const char*>(data.data()), data.size());
+  return data;
+}
+
+}  // namespace
+
+TEST(MappedFileReaderTest, ReadsWithoutCopying) {
+  std::string path = testing::TempDir() + "mapped_file_reader_test.bin";
+  std::vector<uint8_t> expected = WriteTestFile(path, 100000);
+  {
+    base::storage::MappedFileReader reader(path.c_str());
+    ASSERT_FALSE(reader.Failed());
+    EXPECT_EQ(reader.Size(), expected.size());
+    auto data = reader.Data();
+    EXPECT_TRUE(std::equal(data.begin(), data.end(), expected.begin(),
+                           expected.end()));
+    reader.WillNeed(50000, 20000);
+
+    auto first = reader.Next(1000);
+    EXPECT_EQ(first.data(), data.data());
+    EXPECT_EQ(first.size(), 1000u);
+    std::vector<uint8_t> copied(500);
+    EXPECT_EQ(reader.Read(copied.data(), copied.size()), 500u);
+    EXPECT_TRUE(std::equal(copied.begin(), copied.end(),
+                           expected.begin() + 1000));
+    EXPECT_EQ(reader.Position(), 1500u);
+
+    ASSERT_TRUE(reader.Seek(99900));
+    EXPECT_EQ(reader.Next(1000).size(), 100u);
+    EXPECT_TRUE(reader.Next(1000).empty());
+    EXPECT_FALSE(reader.Seek(100001));
+    reader.Close();
+  }
+  std::remove(path.c_str());
+}
+
+TEST(MappedFileReaderTest, HandlesEmptyAndMissingFiles) {
+  std::string path = testing::TempDir() + "mapped_file_reader_empty.bin";
+  WriteTestFile(path, 0);
+  {
+    base::storage::MappedFileReader reader(path.c_str());
+    EXPECT_FALSE(reader.Failed());
+    EXPECT_EQ(reader.Size(), 0u);
+    EXPECT_TRUE(reader.Next(10).empty());
+  }
+  std::remove(path.c_str());
+  EXPECT_TRUE(base::storage::MappedFileReader(path.c_str()).Failed());
+}
@@ -0,0 +1,38 @@
+#include <base/storage/mapped_file_writer.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+TEST(MappedFileWriterTest, SlidesWindowAndTrims) {
+  std::string path = testing::TempDir() + "mapped_file_writer_test.bin";
+  base::storage::MappedFileWriterOptions options;
+  options.window_size = 8 * 1024;
+  options.extent_size = 32 * 1024;
+  options.expected_size = 64 * 1024;
+
+  std::vector<uint8_t> expected;
+  {
+    base::storage::MappedFileWriter writer(path.c_str(), options);
+    ASSERT_FALSE(writer.Failed());
+    for (int i = 0; i < 200; i++) {
+      std::vector<uint8_t> data(i * 7 % 3000 + 1, static_cast<uint8_t>(i));
+      writer.Write(data.data(), data.size());
+      expected.insert(expected.end(), data.begin(), data.end());
+      if (i == 50)
+        writer.Flush();
+    }
+    writer.Close();
+    EXPECT_FALSE(writer.Failed());
+  }
+  EXPECT_EQ(std::filesystem::file_size(path), expected.size());
+  std::ifstream f(path, std::ios::binary);
+  std::vector<uint8_t> actual(std::istreambuf_iterator<char>(f), {});
+  EXPECT_EQ(actual, expected);
+  std::remove(path.c_str());
+}
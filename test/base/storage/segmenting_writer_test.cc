@@ -0,0 +1,179 @@
+#include <base/storage/file_writer.h>
+#include <base/storage/segmenting_writer.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+std::vector<uint8_t> ReadFile(const std::string& path) {
+  std::ifstream f(path, std::ios::binary);
+  return std::vector<uint8_t>(std::istreambuf_iterator<char>(f), {});
+}
+
+std::string SegmentPath(const std::string& prefix, uint32_t segment) {
+  char number[16];
+  std::snprintf(number, sizeof(number), "_%05u", segment);
+  return prefix + number + ".bin";
+}
+
+}  // namespace
+
+TEST(SegmentingWriterTest, RollsOnSizeAndWritesIndex) {
+  std::string prefix = testing::TempDir() + "segmenting_size";
+  std::string index_path = prefix + ".idx";
+  base::storage::SegmentingOptions options;
+  options.max_segment_bytes = 1000;
+
+  std::vector<uint8_t> expected;
+  {
+    base::storage::SegmentingWriter writer(
+        base::storage::FileSegmentFactory(prefix, ".bin"),
+        std::make_unique<base::storage::FileWriter>(index_path.c_str()),
+        options);
+    for (int i = 0; i < 25; i++) {
+      std::vector<uint8_t> data(300, static_cast<uint8_t>(i));
+      writer.Write(data.data(), data.size());
+      expected.insert(expected.end(), data.begin(), data.end());
+    }
+    writer.Close();
+  }
+
+  std::vector<base::storage::SegmentInfo> segments;
+  ASSERT_TRUE(base::storage::ReadSegmentIndex(index_path, &segments));
+  ASSERT_EQ(segments.size(), 7u);
+  std::vector<uint8_t> joined;
+  uint64_t offset = 0;
+  for (size_t i = 0; i < segments.size(); i++) {
+    EXPECT_EQ(segments[i].segment, i);
+    EXPECT_EQ(segments[i].offset, offset);
+    EXPECT_EQ(segments[i].size, i + 1 < segments.size() ? 1200u : 300u);
+    std::string path = SegmentPath(prefix, segments[i].segment);
+    std::vector<uint8_t> bytes = ReadFile(path);
+    EXPECT_EQ(bytes.size(), segments[i].size);
+    joined.insert(joined.end(), bytes.begin(), bytes.end());
+    offset += segments[i].size;
+    std::remove(path.c_str());
+  }
+  EXPECT_EQ(joined, expected);
+  std::remove(index_path.c_str());
+}
+
+TEST(SegmentingWriterTest, AlignsRollsToSyncPoints) {
+  std::string prefix = testing::TempDir() + "segmenting_aligned";
+  base::storage::SegmentingOptions options;
+  options.max_segment_bytes = 1000;
+  options.align_to_sync_points = true;
+
+  base::storage::SegmentingWriter writer(
+      base::storage::FileSegmentFactory(prefix, ".bin"), nullptr, options);
+  std::vector<uint8_t> data(100, 1);
+  for (int i = 0; i < 40; i++) {
+    // A "keyframe" every 15 writes.
+    if (i % 15 == 0) {
+      writer.MarkSyncPoint();
+    }
+    writer.Write(data.data(), data.size());
+  }
+  // With no sync point the writer gives up waiting at twice the limit.
+  for (int i = 0; i < 30; i++) {
+    writer.Write(data.data(), data.size());
+  }
+  writer.Close();
+
+  const auto& segments = writer.Segments();
+  ASSERT_EQ(segments.size(), 4u);
+  EXPECT_TRUE(segments[0].starts_at_sync_point);
+  EXPECT_EQ(segments[0].size, 1500u);
+  EXPECT_TRUE(segments[1].starts_at_sync_point);
+  EXPECT_EQ(segments[1].size, 1500u);
+  EXPECT_TRUE(segments[2].starts_at_sync_point);
+  EXPECT_EQ(segments[2].size, 2000u);
+  EXPECT_FALSE(segments[3].starts_at_sync_point);
+  EXPECT_EQ(segments[3].size, 2000u);
+  for (const auto& s : segments) {
+    std::remove(SegmentPath(prefix, s.segment).c_str());
+  }
+}
+
+TEST(SegmentingWriterTest, RepeatsHeaderInEachSegment) {
+  std::string prefix = testing::TempDir() + "segmenting_header";
+  std::string index_path = prefix + ".idx";
+  base::storage::SegmentingOptions options;
+  options.max_segment_bytes = 1000;
+  options.align_to_sync_points = true;
+  options.repeat_header = true;
+
+  std::vector<uint8_t> header(64, 0xAA);
+  std::vector<uint8_t> expected = header;
+  {
+    base::storage::SegmentingWriter writer(
+        base::storage::FileSegmentFactory(prefix, ".bin"),
+        std::make_unique<base::storage::FileWriter>(index_path.c_str()),
+        options);
+    writer.Write(header.data(), header.size());
+    for (int i = 0; i < 40; i++) {
+      if (i % 10 == 0) {
+        writer.MarkSyncPoint();
+      }
+      std::vector<uint8_t> data(100, static_cast<uint8_t>(i));
+      writer.Write(data.data(), data.size());
+      expected.insert(expected.end(), data.begin(), data.end());
+    }
+    writer.Close();
+  }
+
+  std::vector<base::storage::SegmentInfo> segments;
+  ASSERT_TRUE(base::storage::ReadSegmentIndex(index_path, &segments));
+  ASSERT_EQ(segments.size(), 4u);
+  std::vector<uint8_t> joined;
+  for (const auto& segment : segments) {
+    std::string path = SegmentPath(prefix, segment.segment);
+    std::vector<uint8_t> bytes = ReadFile(path);
+    ASSERT_EQ(bytes.size(), segment.header_size + segment.size);
+    // Every segment starts with the header, though only the later ones
+    // have it as an extra.
+    EXPECT_TRUE(std::equal(header.begin(), header.end(), bytes.begin()));
+    EXPECT_EQ(segment.header_size, segment.segment == 0 ? 0u : header.size());
+    joined.insert(joined.end(), bytes.begin() + segment.header_size,
+                  bytes.end());
+    std::remove(path.c_str());
+  }
+  EXPECT_EQ(joined, expected);
+  std::remove(index_path.c_str());
+}
+
+TEST(SegmentingWriterTest, RollLeavesNoEmptySegment) {
+  std::string prefix = testing::TempDir() + "segmenting_roll";
+  base::storage::SegmentingWriter writer(
+      base::storage::FileSegmentFactory(prefix, ".bin"), nullptr);
+  uint8_t byte = 7;
+  writer.Write(&byte, 1);
+  writer.Roll();
+  writer.Roll();
+  writer.Write(&byte, 1);
+  writer.Close();
+  ASSERT_EQ(writer.Segments().size(), 2u);
+  EXPECT_EQ(writer.Segments()[1].offset, 1u);
+  for (const auto& s : writer.Segments()) {
+    std::remove(SegmentPath(prefix, s.segment).c_str());
+  }
+}
+
+TEST(SegmentingWriterTest, RejectsOtherFiles) {
+  std::string path = testing::TempDir() + "segmenting_not_index.idx";
+  {
+    std::ofstream f(path, std::ios::binary);
+    f << "not an index";
+  }
+  std::vector<base::storage::SegmentInfo> segments;
+  EXPECT_FALSE(base::storage::ReadSegmentIndex(path, &segments));
+  EXPECT_FALSE(base::storage::ReadSegmentIndex(path + ".missing", &segments));
+  std::remove(path.c_str());
+}
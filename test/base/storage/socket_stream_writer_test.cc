@@ -0,0 +1,180 @@
+#include <base/storage/socket_stream_writer.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+void SetReceiveTimeout(int fd) {
+  timeval timeout = {5, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+int ConnectTcp(int port, int receive_buffer = 0) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (receive_buffer > 0) {
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receive_buffer,
+               sizeof(receive_buffer));
+  }
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(static_cast<uint16_t>(port));
+  EXPECT_EQ(
+      connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+  SetReceiveTimeout(fd);
+  return fd;
+}
+
+int ConnectUnix(const std::string& path) {
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  EXPECT_EQ(
+      connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)), 0);
+  SetReceiveTimeout(fd);
+  return fd;
+}
+
+std::string ReadExactly(int fd, size_t size) {
+  std::string bytes(size, '\0');
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = recv(fd, bytes.data() + done, size - done, 0);
+    if (n <= 0) {
+      break;
+    }
+    done += static_cast<size_t>(n);
+  }
+  bytes.resize(done);
+  return bytes;
+}
+
+void WaitForSubscribers(const base::storage::SocketStreamWriter& writer,
+                        size_t count) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (writer.GetStats().accepted < count &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_EQ(writer.GetStats().accepted, count);
+}
+
+void Write(base::storage::Writer* writer, const std::string& s) {
+  writer->Write(reinterpret_cast<const uint8_t*>(s.data()), s.size());
+}
+
+}  // namespace
+
+TEST(SocketStreamWriterTest, StreamsToEverySubscriber) {
+  base::storage::SocketStreamWriter writer;
+  ASSERT_FALSE(writer.Failed());
+  ASSERT_GT(writer.Port(), 0);
+  int a = ConnectTcp(writer.Port());
+  int b = ConnectTcp(writer.Port());
+  WaitForSubscribers(writer, 2);
+
+  Write(&writer, "header");
+  writer.MarkSyncPoint();
+  Write(&writer, "frame one");
+  Write(&writer, "frame two");
+  EXPECT_EQ(ReadExactly(a, 24), "headerframe oneframe two");
+  EXPECT_EQ(ReadExactly(b, 24), "headerframe oneframe two");
+  EXPECT_EQ(writer.GetStats().subscribers, 2u);
+
+  writer.Close();
+  // Closed connections read as end of stream.
+  EXPECT_EQ(ReadExactly(a, 1), "");
+  close(a);
+  close(b);
+}
+
+TEST(SocketStreamWriterTest, LateJoinerStartsAtLastSyncPoint) {
+  base::storage::SocketStreamOptions options;
+  options.unix_socket_path = testing::TempDir() + "socket_stream_late.sock";
+  base::storage::SocketStreamWriter writer(options);
+  ASSERT_FALSE(writer.Failed());
+
+  Write(&writer, "HDR");
+  writer.MarkSyncPoint();
+  Write(&writer, "key1");
+  Write(&writer, "delta1");
+  writer.MarkSyncPoint();
+  Write(&writer, "key2");
+  Write(&writer, "delta2");
+
+  int fd = ConnectUnix(options.unix_socket_path);
+  WaitForSubscribers(writer, 1);
+  Write(&writer, "delta3");
+  EXPECT_EQ(ReadExactly(fd, 19), "HDRkey2delta2delta3");
+  close(fd);
+}
+
+TEST(SocketStreamWriterTest, LateJoinerWaitsWhenSyncCacheOverflows) {
+  base::storage::SocketStreamOptions options;
+  options.max_sync_cache_size = 8;
+  base::storage::SocketStreamWriter writer(options);
+  ASSERT_FALSE(writer.Failed());
+
+  Write(&writer, "HDR");
+  writer.MarkSyncPoint();
+  Write(&writer, "a long key frame");
+  int fd = ConnectTcp(writer.Port());
+  WaitForSubscribers(writer, 1);
+  Write(&writer, "skipped");
+  writer.MarkSyncPoint();
+  Write(&writer, "key2");
+  EXPECT_EQ(ReadExactly(fd, 7), "HDRkey2");
+  close(fd);
+}
+
+TEST(SocketStreamWriterTest, EvictsSlowSubscriber) {
+  base::storage::SocketStreamOptions options;
+  options.subscriber_buffer_size = 4 * 1024 * 1024;
+  base::storage::SocketStreamWriter writer(options);
+  ASSERT_FALSE(writer.Failed());
+  int slow = ConnectTcp(writer.Port(), 4096);
+  int fast = ConnectTcp(writer.Port());
+  WaitForSubscribers(writer, 2);
+
+  constexpr size_t kChunk = 64 * 1024;
+  constexpr size_t kChunks = 512;
+  size_t received = 0;
+  std::thread reader([&] {
+    std::vector<char> buffer(kChunk);
+    while (received < kChunk * kChunks) {
+      ssize_t n = recv(fast, buffer.data(), buffer.size(), 0);
+      if (n <= 0) {
+        break;
+      }
+      received += static_cast<size_t>(n);
+    }
+  });
+  std::vector<uint8_t> chunk(kChunk, 7);
+  for (size_t i = 0; i < kChunks; i++) {
+    writer.Write(chunk.data(), chunk.size());
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+  reader.join();
+
+  EXPECT_EQ(received, kChunk * kChunks);
+  auto stats = writer.GetStats();
+  EXPECT_EQ(stats.evicted, 1u);
+  EXPECT_EQ(stats.subscribers, 1u);
+  writer.Close();
+  close(slow);
+  close(fast);
+}
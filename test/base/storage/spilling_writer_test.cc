@@ -0,0 +1,168 @@
+#include <base/storage/spilling_writer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+struct Recording {
+  std::mutex m;
+  std::vector<uint8_t> bytes;
+  int flushes = 0;
+  bool closed = false;
+};
+
+class SlowWriter : public base::storage::Writer {
+ public:
+  SlowWriter(Recording* recording, std::chrono::milliseconds delay)
+      : recording_(recording), delay_(delay) {}
+
+  void Write(const uint8_t* data, size_t size) override {
+    std::this_thread::sleep_for(delay_);
+    std::unique_lock<std::mutex> lock(recording_->m);
+    recording_->bytes.insert(recording_->bytes.end(), data, data + size);
+  }
+
+  void Flush() override {
+    std::unique_lock<std::mutex> lock(recording_->m);
+    recording_->flushes++;
+  }
+
+  void Close() override {
+    std::unique_lock<std::mutex> lock(recording_->m);
+    recording_->closed = true;
+  }
+
+ private:
+  Recording* recording_;
+  std::chrono::milliseconds delay_;
+};
+
+// Commits no more than |limit| bytes, like an upload that stopped partway.
+class StalledWriter : public SlowWriter {
+ public:
+  StalledWriter(Recording* recording, uint64_t limit)
+      : SlowWriter(recording, std::chrono::milliseconds(0)),
+        recording_(recording),
+        limit_(limit) {}
+
+  std::optional<uint64_t> CommittedBytes() const override {
+    std::unique_lock<std::mutex> lock(recording_->m);
+    return std::min<uint64_t>(recording_->bytes.size(), limit_);
+  }
+
+ private:
+  Recording* recording_;
+  uint64_t limit_;
+};
+
+size_t CountSegments(const std::string& journal) {
+  size_t count = 0;
+  for (const auto& entry : std::filesystem::directory_iterator(journal)) {
+    count += entry.path().extension() == ".seg";
+  }
+  return count;
+}
+
+}  // namespace
+
+TEST(SpillingWriterTest, SpillsOverflowAndKeepsOrder) {
+  std::string journal = testing::TempDir() + "spilling_writer_order.journal";
+  Recording recording;
+  base::storage::SpillingWriterOptions options;
+  options.journal_path = journal;
+  options.memory_limit = 1000;
+  options.journal_read_size = 700;
+  base::storage::SpillingWriter writer(
+      std::make_unique<SlowWriter>(&recording, std::chrono::milliseconds(2)),
+      options);
+
+  std::vector<uint8_t> expected;
+  for (int i = 0; i < 100; i++) {
+    std::vector<uint8_t> data(100 + i, static_cast<uint8_t>(i));
+    writer.Write(data.data(), data.size());
+    expected.insert(expected.end(), data.begin(), data.end());
+    EXPECT_LE(writer.GetStats().memory_bytes, options.memory_limit);
+  }
+  writer.Flush();
+  writer.Close();
+
+  EXPECT_EQ(recording.bytes, expected);
+  EXPECT_EQ(recording.flushes, 1);
+  EXPECT_TRUE(recording.closed);
+  auto stats = writer.GetStats();
+  EXPECT_GT(stats.spilled_bytes, 0u);
+  EXPECT_EQ(stats.delivered_bytes, expected.size());
+  EXPECT_EQ(stats.journal_bytes, 0u);
+  EXPECT_FALSE(std::filesystem::exists(journal));
+}
+
+TEST(SpillingWriterTest, KeepsUncommittedJournalForNextRun) {
+  std::string journal = testing::TempDir() + "spilling_writer_resume.journal";
+  std::filesystem::remove_all(journal);
+  base::storage::SpillingWriterOptions options;
+  options.journal_path = journal;
+  options.journal_segment_size = 3;
+  {
+    // Everything is delivered, but only the first 3 bytes are committed.
+    Recording recording;
+    base::storage::SpillingWriter writer(
+        std::make_unique<StalledWriter>(&recording, 3), options);
+    for (uint8_t i = 1; i <= 8; i++) {
+      writer.Write(&i, 1);
+    }
+    writer.Close();
+    EXPECT_EQ(recording.bytes.size(), 8u);
+    EXPECT_EQ(writer.GetStats().journal_bytes, 5u);
+  }
+  uint64_t position = 0;
+  ASSERT_TRUE(base::storage::ReadJournalResumePosition(journal, &position));
+  EXPECT_EQ(position, 3u);
+
+  Recording recording;
+  base::storage::SpillingWriter writer(
+      std::make_unique<SlowWriter>(&recording, std::chrono::milliseconds(0)),
+      options);
+  EXPECT_EQ(writer.GetStats().recovered_bytes, 5u);
+  std::vector<uint8_t> data = {9, 10};
+  writer.Write(data.data(), data.size());
+  writer.Close();
+
+  EXPECT_EQ(recording.bytes, (std::vector<uint8_t>{4, 5, 6, 7, 8, 9, 10}));
+  EXPECT_FALSE(std::filesystem::exists(journal));
+  EXPECT_FALSE(base::storage::ReadJournalResumePosition(journal, &position));
+}
+
+TEST(SpillingWriterTest, RemovesCommittedSegments) {
+  std::string journal = testing::TempDir() + "spilling_writer_trim.journal";
+  Recording recording;
+  base::storage::SpillingWriterOptions options;
+  options.journal_path = journal;
+  options.journal_segment_size = 10;
+  options.commit_poll_interval = std::chrono::milliseconds(1);
+  base::storage::SpillingWriter writer(
+      std::make_unique<SlowWriter>(&recording, std::chrono::milliseconds(0)),
+      options);
+  std::vector<uint8_t> data(10, 7);
+  for (int i = 0; i < 10; i++) {
+    writer.Write(data.data(), data.size());
+  }
+  // Only the segment being written is left once everything is committed.
+  for (int i = 0; i < 1000 && (CountSegments(journal) > 1 ||
+                                writer.GetStats().committed_bytes < 100);
+       i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(CountSegments(journal), 1u);
+  EXPECT_EQ(writer.GetStats().committed_bytes, 100u);
+  writer.Close();
+  EXPECT_FALSE(std::filesystem::exists(journal));
+}
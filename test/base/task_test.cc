@@ -0,0 +1,93 @@
+#include <base/task.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <base/storage/async_writer.h>
+#include <gtest/gtest.h>
+
+namespace {
+
+base::Task<int> Add(int a, int b) {
+  co_return a + b;
+}
+
+base::Task<int> AddThree(int a, int b, int c) {
+  int ab = co_await Add(a, b);
+  co_return co_await Add(ab, c);
+}
+
+class CountingWriter : public base::storage::Writer {
+ public:
+  void Write(const uint8_t* data, size_t size) override { bytes_ += size; }
+
+  void Flush() override { flushes_++; }
+
+  void Close() override { closed_ = true; }
+
+  std::atomic<size_t> bytes_ = 0;
+  std::atomic<int> flushes_ = 0;
+  std::atomic<bool> closed_ = false;
+};
+
+}  // namespace
+
+TEST(TaskTest, AwaitChain) {
+  EXPECT_EQ(base::SyncWait(AddThree(1, 2, 3)), 6);
+}
+
+TEST(TaskTest, ScheduleMovesToPool) {
+  base::ThreadPool pool(1);
+  auto caller = std::this_thread::get_id();
+  auto task = [](base::ThreadPool* pool) -> base::Task<std::thread::id> {
+    co_await base::Schedule(pool);
+    co_return std::this_thread::get_id();
+  }(&pool);
+  EXPECT_NE(base::SyncWait(std::move(task)), caller);
+}
+
+TEST(TaskTest, ManyConsumersOnSmallPool) {
+  // More suspended consumers than pool threads, which would deadlock if
+  // PopAsync blocked its thread.
+  base::ThreadPool pool(2);
+  base::BoundedQueue<int> q(4, base::OverflowPolicy::kBlock);
+  std::atomic<int> sum = 0;
+  std::atomic<int> finished = 0;
+  const int consumer_count = 16;
+  for (int i = 0; i < consumer_count; i++) {
+    base::Spawn(&pool, [](base::BoundedQueue<int>* q, base::ThreadPool* pool,
+                          std::atomic<int>* sum,
+                          std::atomic<int>* finished) -> base::Task<void> {
+      while (std::optional<int> item = co_await base::PopAsync(q, pool)) {
+        *sum += *item;
+        q->TaskDone();
+      }
+      (*finished)++;
+    }(&q, &pool, &sum, &finished));
+  }
+  for (int i = 1; i <= 1000; i++)
+    q.Push(std::move(i));
+  q.WaitIdle();
+  EXPECT_EQ(sum, 500500);
+  q.Close();
+  while (finished < consumer_count)
+    std::this_thread::yield();
+}
+
+TEST(TaskTest, WriterAdapters) {
+  base::ThreadPool io_pool(1);
+  CountingWriter writer;
+  std::vector<uint8_t> data(100);
+  base::SyncWait([](CountingWriter* writer, base::ThreadPool* io_pool,
+                    std::vector<uint8_t>* data) -> base::Task<void> {
+    co_await base::storage::WriteAsync(writer, io_pool, data->data(),
+                                       data->size());
+    co_await base::storage::WriteAsync(writer, io_pool, data->data(), 10);
+    co_await base::storage::FlushAsync(writer, io_pool);
+    co_await base::storage::CloseAsync(writer, io_pool);
+  }(&writer, &io_pool, &data));
+  EXPECT_EQ(writer.bytes_, 110u);
+  EXPECT_EQ(writer.flushes_, 1);
+  EXPECT_TRUE(writer.closed_);
+}
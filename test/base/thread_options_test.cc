@@ -0,0 +1,46 @@
+#include <base/thread_options.h>
+
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+
+TEST(ThreadOptionsTest, NameAndAffinity) {
+  std::thread t([] {
+    base::ThreadOptions options;
+    options.name = "a_long_thread_name_for_linux";
+    options.cpu_affinity = {0};
+    EXPECT_TRUE(base::ApplyThreadOptions(options));
+
+    char name[16] = {0};
+    pthread_getname_np(pthread_self(), name, sizeof(name));
+    EXPECT_STREQ(name, "a_long_thread_n");
+
+    cpu_set_t cpus;
+    pthread_getaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    EXPECT_EQ(CPU_COUNT(&cpus), 1);
+    EXPECT_TRUE(CPU_ISSET(0, &cpus));
+  });
+  t.join();
+}
+
+TEST(ThreadOptionsTest, EmptyAffinityUndoesInheritedPinning) {
+  cpu_set_t all;
+  sched_getaffinity(0, sizeof(all), &all);
+  std::thread t([&all] {
+    EXPECT_TRUE(base::ApplyThreadOptions({"pinned", {0}}));
+    // Started from a pinned thread, so pinned as well until told otherwise.
+    std::thread child([&all] {
+      EXPECT_TRUE(base::ApplyThreadOptions({"unpinned"}));
+      cpu_set_t cpus;
+      pthread_getaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+      EXPECT_TRUE(CPU_EQUAL(&cpus, &all));
+    });
+    child.join();
+  });
+  t.join();
+}
+#endif
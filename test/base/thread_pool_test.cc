@@ -0,0 +1,97 @@
+#include <base/thread_pool.h>
+
+#include <atomic>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include <base/work_stealing_deque.h>
+#include <gtest/gtest.h>
+
+TEST(WorkStealingDequeTest, PopIsLifoStealIsFifo) {
+  base::WorkStealingDeque<int> deque(2);
+  std::vector<int> values = {0, 1, 2, 3, 4};
+  for (auto& v : values)
+    deque.Push(&v);
+  EXPECT_EQ(*deque.Pop(), 4);
+  EXPECT_EQ(*deque.Steal(), 0);
+  EXPECT_EQ(*deque.Pop(), 3);
+  EXPECT_EQ(*deque.Steal(), 1);
+  EXPECT_EQ(*deque.Pop(), 2);
+  EXPECT_EQ(deque.Pop(), nullptr);
+  EXPECT_EQ(deque.Steal(), nullptr);
+  EXPECT_TRUE(deque.Empty());
+}
+
+TEST(WorkStealingDequeTest, ConcurrentStealsTakeEachItemOnce) {
+  const int item_count = 100000;
+  base::WorkStealingDeque<int> deque;
+  std::vector<int> values(item_count);
+  std::vector<std::atomic<int>> taken(item_count);
+  std::atomic<bool> done = false;
+  std::vector<std::thread> thieves;
+  for (int i = 0; i < 3; i++) {
+    thieves.emplace_back([&] {
+      while (!done || !deque.Empty()) {
+        int* v = deque.Steal();
+        if (v)
+          taken[v - values.data()]++;
+      }
+    });
+  }
+  for (int i = 0; i < item_count; i++) {
+    deque.Push(&values[i]);
+    if (i % 3 == 0) {
+      int* v = deque.Pop();
+      if (v)
+        taken[v - values.data()]++;
+    }
+  }
+  done = true;
+  for (auto& t : thieves)
+    t.join();
+  while (int* v = deque.Pop())
+    taken[v - values.data()]++;
+  for (int i = 0; i < item_count; i++) {
+    EXPECT_EQ(taken[i], 1) << "item " << i;
+  }
+}
+
+TEST(ThreadPoolTest, ParallelForCoversRangeOnce) {
+  base::ThreadPool pool(4);
+  std::vector<std::atomic<int>> visits(10007);
+  pool.ParallelFor(0, visits.size(), 64, [&](size_t begin, size_t end) {
+    EXPECT_LE(end - begin, 64u);
+    for (size_t i = begin; i < end; i++)
+      visits[i]++;
+  });
+  for (size_t i = 0; i < visits.size(); i++) {
+    EXPECT_EQ(visits[i], 1) << "index " << i;
+  }
+}
+
+TEST(ThreadPoolTest, NestedTaskGroups) {
+  base::ThreadPool pool(2);
+  std::atomic<int> sum = 0;
+  base::TaskGroup outer(&pool);
+  for (int i = 0; i < 8; i++) {
+    outer.Run([&pool, &sum] {
+      base::TaskGroup inner(&pool);
+      for (int j = 0; j < 100; j++)
+        inner.Run([&sum] { sum++; });
+      inner.Wait();
+    });
+  }
+  outer.Wait();
+  EXPECT_EQ(sum, 800);
+}
+
+TEST(ThreadPoolTest, SubmitRunsBeforeDestruction) {
+  std::atomic<int> count = 0;
+  {
+    base::ThreadPool pool(3);
+    for (int i = 0; i < 1000; i++)
+      pool.Submit([&count] { count++; });
+  }
+  EXPECT_EQ(count, 1000);
+}
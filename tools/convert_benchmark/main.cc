@@ -0,0 +1,171 @@
+#include <cxxopts.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "av/rgb_to_yuv.h"
+#include "base/thread_pool.h"
+
+extern "C" {
+#include <libswscale/swscale.h>
+}
+
+namespace {
+
+struct Frame {
+  Frame(int width, int height)
+      : chroma_width((width + 1) / 2), chroma_height((height + 1) / 2) {
+    planes[0].resize(static_cast<size_t>(width) * height);
+    planes[1].resize(static_cast<size_t>(chroma_width) * chroma_height);
+    planes[2].resize(static_cast<size_t>(chroma_width) * chroma_height);
+    stride[0] = width;
+    stride[1] = chroma_width;
+    stride[2] = chroma_width;
+    for (int i = 0; i < 3; i++) {
+      data[i] = planes[i].data();
+    }
+  }
+
+  int chroma_width;
+  int chroma_height;
+  std::vector<uint8_t> planes[3];
+  uint8_t* data[3];
+  int stride[3];
+};
+
+// Gradients with some noise on top, roughly like a camera frame.
+std::vector<uint8_t> MakeImage(int width, int height) {
+  std::mt19937 rng(3);
+  std::vector<uint8_t> rgb(static_cast<size_t>(width) * height * 3);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      uint8_t* p = &rgb[(static_cast<size_t>(y) * width + x) * 3];
+      int noise = static_cast<int>(rng() % 16);
+      p[0] = static_cast<uint8_t>((x * 255 / width + noise) & 0xff);
+      p[1] = static_cast<uint8_t>((y * 255 / height + noise) & 0xff);
+      p[2] = static_cast<uint8_t>(((x + y) / 4 + noise) & 0xff);
+    }
+  }
+  return rgb;
+}
+
+double Psnr(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+  double squared = 0;
+  for (size_t i = 0; i < a.size(); i++) {
+    double d = static_cast<double>(a[i]) - b[i];
+    squared += d * d;
+  }
+  if (squared == 0) {
+    return INFINITY;
+  }
+  return 10 * std::log10(255.0 * 255.0 * a.size() / squared);
+}
+
+// Milliseconds per frame over |frames| conversions.
+double Time(int frames, const std::function<void()>& convert) {
+  convert();
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < frames; i++) {
+    convert();
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count() /
+         frames;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  cxxopts::Options options("convert_benchmark",
+                           "Compares RGB24 to YUV420P conversion with "
+                           "av::RgbToYuv420p and swscale.");
+  options.add_options()
+      ("w,width", "Frame width",
+       cxxopts::value<int>()->default_value("1920"))
+      ("h,height", "Frame height",
+       cxxopts::value<int>()->default_value("1080"))
+      ("f,frames", "Frames to convert with each converter",
+       cxxopts::value<int>()->default_value("200"))
+      ("t,threads", "Threads for the banded conversion, 0 for one per core",
+       cxxopts::value<size_t>()->default_value("0"))
+      ("matrix", "601 or 709",
+       cxxopts::value<std::string>()->default_value("601"))
+      ("full_range", "Full rather than limited range",
+       cxxopts::value<bool>()->default_value("false"))
+      ("help", "Print usage");
+  auto args = options.parse(argc, argv);
+  if (args.count("help")) {
+    std::cout << options.help() << std::endl;
+    return 0;
+  }
+
+  int width = args["width"].as<int>();
+  int height = args["height"].as<int>();
+  int frames = args["frames"].as<int>();
+  av::YuvMatrix matrix = args["matrix"].as<std::string>() == "709"
+                             ? av::YuvMatrix::kBt709
+                             : av::YuvMatrix::kBt601;
+  av::YuvRange range = args["full_range"].as<bool>() ? av::YuvRange::kFull
+                                                     : av::YuvRange::kLimited;
+  std::vector<uint8_t> rgb = MakeImage(width, height);
+  int rgb_stride = width * 3;
+
+  // The context VideoEncoder used before it had its own converter.
+  SwsContext* sws = sws_getContext(width, height, AV_PIX_FMT_RGB24, width,
+                                   height, AV_PIX_FMT_YUV420P,
+                                   SWS_LANCZOS | SWS_ACCURATE_RND, NULL, NULL,
+                                   NULL);
+  if (!sws) {
+    std::cout << "sws_getContext failed." << std::endl;
+    return 1;
+  }
+  const int* table = sws_getCoefficients(
+      matrix == av::YuvMatrix::kBt709 ? SWS_CS_ITU709 : SWS_CS_ITU601);
+  sws_setColorspaceDetails(sws, table, 1, table,
+                           range == av::YuvRange::kFull ? 1 : 0, 0, 1 << 16,
+                           1 << 16);
+
+  Frame reference(width, height);
+  const uint8_t* src[] = {rgb.data()};
+  double sws_ms = Time(frames, [&] {
+    sws_scale(sws, src, &rgb_stride, 0, height, reference.data,
+              reference.stride);
+  });
+  sws_freeContext(sws);
+
+  Frame converted(width, height);
+  double single_ms = Time(frames, [&] {
+    av::RgbToYuv420p(rgb.data(), rgb_stride, width, height, converted.data,
+                     converted.stride, matrix, range);
+  });
+
+  base::ThreadPool pool(args["threads"].as<size_t>());
+  Frame banded(width, height);
+  double banded_ms = Time(frames, [&] {
+    av::RgbToYuv420p(rgb.data(), rgb_stride, width, height, banded.data,
+                     banded.stride, matrix, range, &pool);
+  });
+
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << width << "x" << height << ", " << frames << " frames, "
+            << (av::RgbToYuvIsAccelerated() ? "vector" : "scalar")
+            << " converter\n";
+  std::cout << "  swscale     " << sws_ms << " ms/frame\n";
+  std::cout << "  builtin     " << single_ms << " ms/frame ("
+            << sws_ms / single_ms << "x)\n";
+  std::cout << "  banded      " << banded_ms << " ms/frame ("
+            << sws_ms / banded_ms << "x, " << pool.NumThreads()
+            << " threads)\n";
+  std::cout << "  psnr        Y " << Psnr(converted.planes[0],
+                                         reference.planes[0])
+            << " dB  U " << Psnr(converted.planes[1], reference.planes[1])
+            << " dB  V " << Psnr(converted.planes[2], reference.planes[2])
+            << " dB\n";
+  return 0;
+}
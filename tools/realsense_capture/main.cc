@@ -1,19 +1,31 @@
 
 #include <glog/logging.h>
 #include <json/json.h>
+#include <atomic>
+#include <cctype>
 #include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <ctime>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <librealsense2/rs.hpp>
+#include <mutex>
+#include <thread>
 #include <tuple>
 
 #include "av/frame_rate_tracker.h"
 #include "av/video_encoder.h"
 #include "av/video_encoding_queue.h"
+#include "az/block_blob_writer.h"
 #include "az/buffered_blob_writer.h"
 #include "base/storage/broadcast_writer.h"
+#include "base/storage/checksumming_writer.h"
 #include "base/storage/file_writer.h"
+#include "base/storage/segmenting_writer.h"
+#include "base/storage/spilling_writer.h"
+#include "base/thread_options.h"
 #include "ogl/constants.h"
 #include "ogl/full_screen_video.h"
 #include "ogl/text_overlay_renderer.h"
@@ -52,11 +64,68 @@ struct FerrySettings {
   std::string blob_root;
   bool write_to_file = false;
   bool write_to_service = false;
+  bool use_block_blobs = false;
   int depth_bitrate_bps = 0;
   int color_bitrate_bps = 0;
+  av::VideoEncoderOptions depth_encoder;
+  av::VideoEncoderOptions color_encoder;
+  bool lossless_depth = false;
+  std::vector<int> capture_cpus;
+  std::vector<int> encode_cpus;
+  std::vector<int> upload_cpus;
+  int encode_nice = 0;
+  int segment_minutes = 0;
+  std::string spool_directory;
   bool valid_settings = false;
 };
 
+std::vector<int> ReadCpuList(const Json::Value& value) {
+  std::vector<int> cpus = {};
+  if (value.isArray()) {
+    for (const auto& cpu : value) {
+      cpus.push_back(cpu.asInt());
+    }
+  }
+  return cpus;
+}
+
+// Missing fields keep the VideoEncoderOptions defaults.
+av::VideoEncoderOptions ReadEncoderOptions(const Json::Value& value) {
+  av::VideoEncoderOptions options;
+  if (!value.isObject()) {
+    return options;
+  }
+  std::string codec = value.get("codec", "h264").asString();
+  if (codec == "h265") {
+    options.codec = av::VideoCodec::kH265;
+  } else if (codec == "ffv1") {
+    options.codec = av::VideoCodec::kFfv1;
+  } else if (codec == "mpeg4") {
+    options.codec = av::VideoCodec::kMpeg4;
+  }
+  options.preset = value.get("preset", "").asString();
+  options.tune = value.get("tune", "").asString();
+  options.crf = value.get("crf", options.crf).asInt();
+  options.gop_size = value.get("gop_size", options.gop_size).asInt();
+  options.max_b_frames =
+      value.get("max_b_frames", options.max_b_frames).asInt();
+  options.thread_count = value.get("threads", options.thread_count).asInt();
+  std::string threading = value.get("threading", "").asString();
+  if (threading == "frame") {
+    options.threading = av::CodecThreading::kFrame;
+  } else if (threading == "slice") {
+    options.threading = av::CodecThreading::kSlice;
+  }
+  return options;
+}
+
+// Constant quality and lossless streams don't need a bitrate.
+bool HasRateControl(int bitrate_bps, const av::VideoEncoderOptions& options) {
+  bool crf = options.crf >= 0 && (options.codec == av::VideoCodec::kH264 ||
+                                  options.codec == av::VideoCodec::kH265);
+  return bitrate_bps > 0 || crf || options.codec == av::VideoCodec::kFfv1;
+}
+
 FerrySettings ReadSettings(const std::string& settings_path) {
   Json::Value root;
   std::ifstream ifs;
@@ -74,11 +143,33 @@ FerrySettings ReadSettings(const std::string& settings_path) {
   settings.blob_root = root["blob_root"].asString();
   settings.write_to_file = root["write_to_file"].asBool();
   settings.write_to_service = root["write_to_service"].asBool();
+  settings.use_block_blobs = root["use_block_blobs"].asBool();
   settings.depth_bitrate_bps = root["depth_bitrate_bps"].asInt();
   settings.color_bitrate_bps = root["color_birate_bps"].asInt();
+  settings.depth_encoder = ReadEncoderOptions(root["depth_encoder"]);
+  settings.color_encoder = ReadEncoderOptions(root["color_encoder"]);
+  // Raw 16 bit depth through FFV1, which keeps metric depth exact and skips
+  // colorizing. Overrides the codec of depth_encoder.
+  settings.lossless_depth = root["lossless_depth"].asBool();
+  if (settings.lossless_depth) {
+    settings.depth_encoder.codec = av::VideoCodec::kFfv1;
+    settings.depth_encoder.input_format = av::InputFormat::kGray16;
+  }
+  settings.capture_cpus = ReadCpuList(root["capture_cpus"]);
+  settings.encode_cpus = ReadCpuList(root["encode_cpus"]);
+  settings.upload_cpus = ReadCpuList(root["upload_cpus"]);
+  settings.encode_nice = root["encode_nice"].asInt();
+  settings.segment_minutes = root["segment_minutes"].asInt();
+  // Upload journals live here rather than in the working directory, so that
+  // the next run finds whatever this one didn't get to upload.
+  settings.spool_directory = root.get("spool_directory", "").asString();
+  if (settings.spool_directory.empty()) {
+    settings.spool_directory = "spool";
+  }
   settings.valid_settings = true;
 
-  if (settings.depth_bitrate_bps <= 0 || settings.color_bitrate_bps <= 0) {
+  if (!HasRateControl(settings.depth_bitrate_bps, settings.depth_encoder) ||
+      !HasRateControl(settings.color_bitrate_bps, settings.color_encoder)) {
     settings.valid_settings = false;
     return settings;
   }
@@ -93,6 +184,184 @@ FerrySettings ReadSettings(const std::string& settings_path) {
   return settings;
 };
 
+std::unique_ptr<base::storage::Writer> MakeFileWriter(
+    const std::string& prefix,
+    const FerrySettings& settings) {
+  if (settings.segment_minutes <= 0) {
+    return std::make_unique<base::storage::FileWriter>(
+        (prefix + ".asf").c_str());
+  }
+  base::storage::SegmentingOptions options;
+  options.max_segment_duration = std::chrono::minutes(settings.segment_minutes);
+  options.align_to_sync_points = true;
+  // Each segment gets the ASF header, so that it plays on its own.
+  options.repeat_header = true;
+  return std::make_unique<base::storage::SegmentingWriter>(
+      base::storage::FileSegmentFactory(prefix, ".asf"),
+      std::make_unique<base::storage::FileWriter>((prefix + ".idx").c_str()),
+      options);
+}
+
+// Blob names can hold '/' and other characters that file names can't, so
+// journal names carry them percent encoded.
+std::string EncodeBlobName(const std::string& blob_name) {
+  std::string encoded;
+  for (unsigned char c : blob_name) {
+    if (std::isalnum(c) || c == '.' || c == '-' || c == '_') {
+      encoded += static_cast<char>(c);
+    } else {
+      char escape[4];
+      std::snprintf(escape, sizeof(escape), "%%%02X", c);
+      encoded += escape;
+    }
+  }
+  return encoded;
+}
+
+std::string DecodeBlobName(const std::string& encoded) {
+  std::string blob_name;
+  for (size_t i = 0; i < encoded.size(); i++) {
+    if (encoded[i] == '%' && i + 2 < encoded.size()) {
+      blob_name += static_cast<char>(
+          std::stoi(encoded.substr(i + 1, 2), nullptr, 16));
+      i += 2;
+    } else {
+      blob_name += encoded[i];
+    }
+  }
+  return blob_name;
+}
+
+const char kAppendJournalPrefix[] = "append_";
+const char kBlockJournalPrefix[] = "block_";
+const char kJournalExtension[] = ".journal";
+
+// Named after the blob and the kind of upload, which is all that's needed to
+// finish the upload after a restart.
+std::string JournalPath(const std::string& blob_name,
+                        const FerrySettings& settings) {
+  std::string name =
+      (settings.use_block_blobs ? kBlockJournalPrefix : kAppendJournalPrefix) +
+      EncodeBlobName(blob_name) + kJournalExtension;
+  return (std::filesystem::path(settings.spool_directory) / name).string();
+}
+
+base::storage::SpillingWriterOptions SpillOptions(
+    const std::string& journal_path,
+    const FerrySettings& settings) {
+  base::storage::SpillingWriterOptions options;
+  options.journal_path = journal_path;
+  options.drain_thread_options = {"upload", settings.upload_cpus};
+  return options;
+}
+
+az::BufferedBlobWriterOptions AppendBlobOptions(const FerrySettings& settings) {
+  az::BufferedBlobWriterOptions options;
+  options.max_chunk_size_bytes = 4 * 1024 * 1024;
+  options.adaptive_chunk_size = true;
+  options.upload_thread_options = {"blob_upload", settings.upload_cpus};
+  return options;
+}
+
+az::BlockBlobWriterOptions BlockBlobOptions(const FerrySettings& settings) {
+  az::BlockBlobWriterOptions options;
+  options.upload_thread_options = {"blob_stage", settings.upload_cpus};
+  return options;
+}
+
+// Uploads alongside a blob of CRC-32C checksums, so that corruption on the
+// way can be found before playback. Everything is journaled in the spool
+// directory until the blob has committed it, so neither a slow uplink nor a
+// crash loses any of it. Block blobs
+// upload several blocks at once, which keeps a high latency uplink busy, but
+// only show up in the container as they are committed.
+std::unique_ptr<base::storage::Writer> MakeBlobWriter(
+    const std::string& blob_name,
+    const FerrySettings& settings) {
+  az::BufferedBlobWriterOptions sidecar_options = AppendBlobOptions(settings);
+  sidecar_options.max_chunk_size_bytes = 64 * 1024;
+  sidecar_options.adaptive_chunk_size = false;
+  std::unique_ptr<base::storage::Writer> data_writer;
+  if (settings.use_block_blobs) {
+    data_writer = std::make_unique<az::BlockBlobWriter>(
+        settings.connection_string, settings.container_name, blob_name,
+        BlockBlobOptions(settings));
+  } else {
+    data_writer = std::make_unique<az::BufferedBlobWriter>(
+        settings.connection_string, settings.container_name, blob_name,
+        AppendBlobOptions(settings));
+  }
+  return std::make_unique<base::storage::SpillingWriter>(
+      std::make_unique<base::storage::ChecksummingWriter>(
+          std::move(data_writer),
+          std::make_unique<az::BufferedBlobWriter>(
+              settings.connection_string, settings.container_name,
+              blob_name + ".crc32c", sidecar_options)),
+      SpillOptions(JournalPath(blob_name, settings), settings));
+}
+
+// Finishes the uploads an earlier run left journals for, each to the blob it
+// was recorded for, and waits for them. Append blobs carry on from the last
+// committed offset, skipping anything that landed after it. A block blob
+// can't be added to without committing its blocks again, so the rest of one,
+// from its last committed offset, goes to <blob>.continued instead. Checksum
+// sidecars of interrupted uploads stay incomplete, covering the chunks they
+// got to. A journal whose upload fails again is kept for the next start.
+void RecoverSpooledUploads(const FerrySettings& settings) {
+  // Listed up front, since recovering changes the directory.
+  std::vector<std::string> journals;
+  std::error_code ec;
+  for (const auto& entry :
+       std::filesystem::directory_iterator(settings.spool_directory, ec)) {
+    std::string name = entry.path().filename().string();
+    if (name.ends_with(kJournalExtension)) {
+      journals.push_back(name);
+    }
+  }
+  std::vector<std::unique_ptr<base::storage::SpillingWriter>> writers;
+  for (const auto& name : journals) {
+    std::string journal_path =
+        (std::filesystem::path(settings.spool_directory) / name).string();
+    uint64_t position = 0;
+    if (!base::storage::ReadJournalResumePosition(journal_path, &position)) {
+      std::filesystem::remove_all(journal_path, ec);
+      continue;
+    }
+    std::string stem =
+        name.substr(0, name.size() - std::strlen(kJournalExtension));
+    std::unique_ptr<base::storage::Writer> data_writer;
+    std::string blob_name;
+    if (stem.starts_with(kAppendJournalPrefix)) {
+      blob_name =
+          DecodeBlobName(stem.substr(std::strlen(kAppendJournalPrefix)));
+      az::BufferedBlobWriterOptions options = AppendBlobOptions(settings);
+      options.resume_offset = position;
+      data_writer = std::make_unique<az::BufferedBlobWriter>(
+          settings.connection_string, settings.container_name, blob_name,
+          options);
+    } else if (stem.starts_with(kBlockJournalPrefix)) {
+      blob_name =
+          DecodeBlobName(stem.substr(std::strlen(kBlockJournalPrefix))) +
+          ".continued";
+      data_writer = std::make_unique<az::BlockBlobWriter>(
+          settings.connection_string, settings.container_name, blob_name,
+          BlockBlobOptions(settings));
+    } else {
+      continue;
+    }
+    auto writer = std::make_unique<base::storage::SpillingWriter>(
+        std::move(data_writer), SpillOptions(journal_path, settings));
+    LOG(INFO) << "Recovering " << writer->GetStats().recovered_bytes
+              << " bytes of " << blob_name << " from " << journal_path;
+    writers.push_back(std::move(writer));
+  }
+  // Closing waits for everything recovered to be uploaded, and removes the
+  // journal if it all made it.
+  for (auto& writer : writers) {
+    writer->Close();
+  }
+}
+
 void AddFrameToQueue(av::VideoEncodingQueue& q, rs2::video_frame& vf) {
     if (vf.get_data_size() > 0) {
       const uint8_t* raw_color_data =
@@ -123,6 +392,14 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
+  // Finished before recording starts, so that new uploads don't queue up
+  // behind old ones.
+  if (settings.write_to_service) {
+    std::error_code ec;
+    std::filesystem::create_directories(settings.spool_directory, ec);
+    RecoverSpooledUploads(settings);
+  }
+
   ogl::Window app(1280, 720, "Ferry - Recording!", true);
 
   rs2::pipeline pipe;
@@ -136,78 +413,113 @@ int main(int argc, char* argv[]) {
   std::vector<std::unique_ptr<base::storage::Writer>> depth_writers = {};
   std::vector<std::unique_ptr<base::storage::Writer>> color_writers = {};
   if (settings.write_to_file) {
-    depth_writers.push_back(std::make_unique<base::storage::FileWriter>(
-        ("depth_" + timestamp + ".asf").c_str()));
-    color_writers.push_back(std::make_unique<base::storage::FileWriter>(
-        ("color_" + timestamp + ".asf").c_str()));
+    depth_writers.push_back(MakeFileWriter("depth_" + timestamp, settings));
+    color_writers.push_back(MakeFileWriter("color_" + timestamp, settings));
   }
   if (settings.write_to_service) {
     std::string depth_blob_name =
         settings.blob_root + "/" + timestamp + "/depth.asf";
     std::string color_blob_name =
         settings.blob_root + "/" + timestamp + "/color.asf";
-    depth_writers.push_back(std::make_unique<az::BufferedBlobWriter>(
-        settings.connection_string, settings.container_name, depth_blob_name,
-        2 * 1024 * 1024));
-    color_writers.push_back(std::make_unique<az::BufferedBlobWriter>(
-        settings.connection_string, settings.container_name, color_blob_name,
-        2 * 1024 * 1024));
+    depth_writers.push_back(MakeBlobWriter(depth_blob_name, settings));
+    color_writers.push_back(MakeBlobWriter(color_blob_name, settings));
   }
 
+  // Each output is written on its own thread. The blob writers journal
+  // everything to disk as it arrives, so they keep up without spilling here
+  // as well, and a full queue only waits on the disk.
+  base::storage::BroadcastOptions broadcast_options;
+  broadcast_options.asynchronous = true;
   av::VideoEncodingQueue depth_queue(
       std::make_unique<base::storage::BroadcastWriter>(
-          std::move(depth_writers)),
-      30, 848, 480, settings.depth_bitrate_bps);
+          std::move(depth_writers), broadcast_options),
+      30, 848, 480, settings.depth_bitrate_bps, settings.depth_encoder);
   av::VideoEncodingQueue color_queue(
       std::make_unique<base::storage::BroadcastWriter>(
-          std::move(color_writers)),
-      30, 1280, 720, settings.color_bitrate_bps);
+          std::move(color_writers), broadcast_options),
+      30, 1280, 720, settings.color_bitrate_bps, settings.color_encoder);
 
+  depth_queue.SetThreadOptions(
+      {"encode_depth", settings.encode_cpus, settings.encode_nice});
+  color_queue.SetThreadOptions(
+      {"encode_color", settings.encode_cpus, settings.encode_nice});
   depth_queue.Start();
   color_queue.Start();
 
-  bool show_video = true;
-  bool* show_video_ptr = &show_video;
-
-  app.AddKeyReleasedCallback(
-      [&show_video_ptr](ogl::Window* window, int32_t key) {
-        switch (key) {
-          case OGL_KEY_ESCAPE:
-            window->SetShouldClose(true);
-            break;
-          case OGL_KEY_D:
-            *show_video_ptr = !(*show_video_ptr);
-            break;
-        }
-      });
-
-  rs2::colorizer colourizer;
+  std::atomic<bool> show_video = true;
+
+  app.AddKeyReleasedCallback([&show_video](ogl::Window* window, int32_t key) {
+    switch (key) {
+      case OGL_KEY_ESCAPE:
+        window->SetShouldClose(true);
+        break;
+      case OGL_KEY_D:
+        show_video = !show_video;
+        break;
+    }
+  });
+
+  // Frames are captured and queued on a thread of their own, pinned to
+  // capture_cpus, so that the window's thread keeps its affinity and drawing
+  // never holds up the camera. The latest frame to show is handed over.
+  std::atomic<bool> capturing = true;
+  std::atomic<int32_t> capture_fps = 0;
+  std::mutex preview_m;
+  rs2::video_frame preview{rs2::frame()};
+  std::thread capture_thread([&] {
+    if (!base::ApplyThreadOptions({"capture", settings.capture_cpus})) {
+      LOG(WARNING) << "Failed to apply capture thread options.";
+    }
+    rs2::colorizer colourizer;
+    av::FrameRateTracker frame_rate_tracker(200);
+    while (capturing) {
+      rs2::frameset frames;
+      if (!pipe.try_wait_for_frames(&frames, 100)) {
+        continue;
+      }
+      frame_rate_tracker.notify_frame_start();
+      rs2::depth_frame df = frames.get_depth_frame();
+      rs2::video_frame vf = frames.get_color_frame();
+
+      // Only colorize depth when it is shown or can't be stored as is.
+      bool show = show_video;
+      rs2::video_frame colorized_frame = df;
+      if (!show || !settings.lossless_depth) {
+        colorized_frame = df.apply_filter(colourizer).as<rs2::video_frame>();
+      }
+
+      if (settings.lossless_depth) {
+        AddFrameToQueue(depth_queue, df);
+      } else {
+        AddFrameToQueue(depth_queue, colorized_frame);
+      }
+      AddFrameToQueue(color_queue, vf);
+
+      capture_fps = frame_rate_tracker.get_fps();
+      std::unique_lock<std::mutex> lock(preview_m);
+      preview = show ? vf : colorized_frame;
+    }
+  });
+
   ogl::FullScreenVideo video(&app);
-  av::FrameRateTracker frame_rate_tracker(200);
   ogl::TextOverlayRenderer fps_overlay(&app, 0.02, 0.04, "");
   while (app.FrameStart()) {
-    frame_rate_tracker.notify_frame_start();
-    rs2::frameset frames = pipe.wait_for_frames();
-    rs2::depth_frame df = frames.get_depth_frame();
-    rs2::video_frame vf = frames.get_color_frame();
-
-    rs2::video_frame colorized_frame = df.apply_filter(colourizer).as<rs2::video_frame>();
-
-    if (show_video) {
-      video.RenderFrame(vf, ogl::FrameFormat::RGB_8);
-    } else {
-      video.RenderFrame(colorized_frame, ogl::FrameFormat::RGB_8);
+    rs2::video_frame frame{rs2::frame()};
+    {
+      std::unique_lock<std::mutex> lock(preview_m);
+      frame = preview;
+    }
+    if (frame) {
+      video.RenderFrame(frame, ogl::FrameFormat::RGB_8);
     }
 
-    AddFrameToQueue(depth_queue, colorized_frame);
-    AddFrameToQueue(color_queue, vf);
-
-    std::string fps_message =
-        std::to_string(frame_rate_tracker.get_fps()) + " fps";
+    std::string fps_message = std::to_string(capture_fps.load()) + " fps";
     fps_overlay.SetContent(fps_message);
     fps_overlay.Render();
   };
   app.SetTitle("Ferry - Saving recording . . .");
+  capturing = false;
+  capture_thread.join();
   depth_queue.Stop();
   color_queue.Stop();
 
@@ -5,14 +5,22 @@
 #include <iostream>
 #include <vector>
 #include "base/graph.h"
+#include "base/storage/mapped_file_reader.h"
 #include "selective_search/selective_search.h"
 
 int main(int argc, char** argv) {
-  int32_t width, height, channels;
-  uint8_t* data = stbi_load(
+  base::storage::MappedFileReader reader(
       "C:\\code\\anna-atkins\\raw_scan_segmentation\\cache\\data\\unprocessed_"
-      "1000px\\0aaf33267cb9174f7d8c28fcb0bac36d",
-      &width, &height, &channels, 0);
+      "1000px\\0aaf33267cb9174f7d8c28fcb0bac36d");
+  if (reader.Failed()) {
+    std::cout << "Failed to open the image." << std::endl;
+    return 1;
+  }
+  int32_t width, height, channels;
+  uint8_t* data = stbi_load_from_memory(
+      reader.Data().data(), static_cast<int>(reader.Data().size()), &width,
+      &height, &channels, 0);
+  reader.Close();
 
   int32_t new_width = width / 3;
   int32_t new_height = height / 3;
@@ -0,0 +1,386 @@
+#include "loopback_blob_server.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#if defined(_WIN32)
+using Socket = SOCKET;
+constexpr Socket kInvalidSocket = INVALID_SOCKET;
+constexpr int kSendFlags = 0;
+
+void CloseSocket(Socket s) {
+  closesocket(s);
+}
+#else
+using Socket = int;
+constexpr Socket kInvalidSocket = -1;
+constexpr int kSendFlags = MSG_NOSIGNAL;
+
+void CloseSocket(Socket s) {
+  close(s);
+}
+#endif
+
+// The well known Azurite / storage emulator account.
+constexpr char kAccountName[] = "devstoreaccount1";
+constexpr char kAccountKey[] =
+    "Eby8vdM02xNOcqFlqUwJPLlmEtlCDXJ1OUzFT50uSRZ6IFsuFq2UVErCz4I6tq/"
+    "K1SZFPTOtr/KBHBeksoGMGw==";
+
+// Value of the header called |name|, given in lower case, or empty.
+std::string Header(const std::string& headers, const std::string& name) {
+  std::string lower = headers;
+  std::transform(lower.begin(), lower.end(), lower.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  size_t pos = lower.find("\r\n" + name + ":");
+  if (pos == std::string::npos) {
+    return "";
+  }
+  size_t begin = headers.find_first_not_of(' ', pos + name.size() + 3);
+  size_t end = headers.find("\r\n", begin);
+  return headers.substr(begin, end - begin);
+}
+
+// Value of the query parameter called |name|, still percent-encoded, or
+// empty.
+std::string QueryParameter(const std::string& query, const std::string& name) {
+  size_t pos = 0;
+  while ((pos = query.find(name + "=", pos)) != std::string::npos) {
+    if (pos > 0 && (query[pos - 1] == '?' || query[pos - 1] == '&')) {
+      size_t begin = pos + name.size() + 1;
+      return query.substr(begin, query.find('&', begin) - begin);
+    }
+    pos += name.size();
+  }
+  return "";
+}
+
+std::string PercentDecode(const std::string& s) {
+  std::string decoded;
+  for (size_t i = 0; i < s.size(); i++) {
+    if (s[i] == '%' && i + 2 < s.size()) {
+      decoded += static_cast<char>(std::stoi(s.substr(i + 1, 2), nullptr, 16));
+      i += 2;
+    } else {
+      decoded += s[i];
+    }
+  }
+  return decoded;
+}
+
+// The entries of a Put Block List body in order, as pairs of element name,
+// such as Latest, and block id.
+std::vector<std::pair<std::string, std::string>> BlockListEntries(
+    const std::string& xml) {
+  std::vector<std::pair<std::string, std::string>> entries;
+  size_t pos = 0;
+  while ((pos = xml.find('<', pos)) != std::string::npos) {
+    size_t name_end = xml.find('>', pos);
+    if (name_end == std::string::npos) {
+      break;
+    }
+    std::string name = xml.substr(pos + 1, name_end - pos - 1);
+    pos = name_end + 1;
+    if (name == "Latest" || name == "Committed" || name == "Uncommitted") {
+      size_t value_end = xml.find('<', pos);
+      entries.emplace_back(name, xml.substr(pos, value_end - pos));
+      pos = value_end;
+    }
+  }
+  return entries;
+}
+
+size_t ContentLength(const std::string& headers) {
+  return std::strtoull(Header(headers, "content-length").c_str(), nullptr, 10);
+}
+
+std::string Response(const std::string& status,
+                     const std::string& extra_headers) {
+  return "HTTP/1.1 " + status +
+         "\r\n"
+         "Date: Sat, 01 Jan 2022 00:00:00 GMT\r\n"
+         "Last-Modified: Sat, 01 Jan 2022 00:00:00 GMT\r\n"
+         "ETag: \"0x8D9CC0000000000\"\r\n"
+         "x-ms-request-id: 00000000-0000-0000-0000-000000000000\r\n"
+         "x-ms-version: 2020-08-04\r\n" +
+         extra_headers + "\r\n";
+}
+
+}  // namespace
+
+LoopbackBlobServer::LoopbackBlobServer(bool keep_contents)
+    : keep_contents_(keep_contents) {
+#if defined(_WIN32)
+  WSADATA wsa_data;
+  WSAStartup(MAKEWORD(2, 2), &wsa_data);
+#endif
+}
+
+LoopbackBlobServer::~LoopbackBlobServer() {
+  Stop();
+#if defined(_WIN32)
+  WSACleanup();
+#endif
+}
+
+bool LoopbackBlobServer::Start() {
+  Socket s = socket(AF_INET, SOCK_STREAM, 0);
+  if (s == kInvalidSocket) {
+    return false;
+  }
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = 0;
+  socklen_t length = sizeof(address);
+  if (bind(s, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(s, 16) != 0 ||
+      getsockname(s, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+    CloseSocket(s);
+    return false;
+  }
+  listen_socket_ = static_cast<intptr_t>(s);
+  port_ = ntohs(address.sin_port);
+  accept_thread_ = std::thread([this] { AcceptThread(); });
+  return true;
+}
+
+void LoopbackBlobServer::Stop() {
+  if (stopping_.exchange(true) || listen_socket_ == -1) {
+    return;
+  }
+  // Shutting the sockets down wakes up the threads blocked on them.
+  shutdown(static_cast<Socket>(listen_socket_), 2);
+  CloseSocket(static_cast<Socket>(listen_socket_));
+  accept_thread_.join();
+  {
+    std::unique_lock<std::mutex> lock(m_);
+    for (intptr_t c : connections_) {
+      shutdown(static_cast<Socket>(c), 2);
+    }
+  }
+  for (auto& t : threads_) {
+    t.join();
+  }
+}
+
+std::string LoopbackBlobServer::ConnectionString() const {
+  return std::string("DefaultEndpointsProtocol=http;AccountName=") +
+         kAccountName + ";AccountKey=" + kAccountKey +
+         ";BlobEndpoint=http://127.0.0.1:" + std::to_string(port_) + "/" +
+         kAccountName + ";";
+}
+
+uint64_t LoopbackBlobServer::BlobSize(const std::string& container,
+                                      const std::string& blob) {
+  std::unique_lock<std::mutex> lock(m_);
+  auto it = blob_sizes_.find(std::string("/") + kAccountName + "/" +
+                             container + "/" + blob);
+  return it == blob_sizes_.end() ? 0 : it->second;
+}
+
+std::vector<uint8_t> LoopbackBlobServer::BlobContents(
+    const std::string& container,
+    const std::string& blob) {
+  std::unique_lock<std::mutex> lock(m_);
+  auto it = blob_contents_.find(std::string("/") + kAccountName + "/" +
+                                container + "/" + blob);
+  return it == blob_contents_.end() ? std::vector<uint8_t>() : it->second;
+}
+
+size_t LoopbackBlobServer::Connections() {
+  std::unique_lock<std::mutex> lock(m_);
+  return connections_.size();
+}
+
+void LoopbackBlobServer::AcceptThread() {
+  while (!stopping_) {
+    Socket c = accept(static_cast<Socket>(listen_socket_), nullptr, nullptr);
+    if (c == kInvalidSocket) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(m_);
+    connections_.push_back(static_cast<intptr_t>(c));
+    threads_.emplace_back(
+        [this, c] { ServeConnection(static_cast<intptr_t>(c)); });
+  }
+}
+
+void LoopbackBlobServer::ServeConnection(intptr_t socket) {
+  Socket s = static_cast<Socket>(socket);
+  std::string pending;
+  std::vector<char> buffer(256 * 1024);
+  std::vector<uint8_t> content;
+  while (true) {
+    size_t header_end;
+    while ((header_end = pending.find("\r\n\r\n")) == std::string::npos) {
+      int n = recv(s, buffer.data(), static_cast<int>(buffer.size()), 0);
+      if (n <= 0) {
+        CloseSocket(s);
+        return;
+      }
+      pending.append(buffer.data(), n);
+    }
+    std::string headers = pending.substr(0, header_end + 2);
+    size_t body = ContentLength(headers);
+    pending.erase(0, header_end + 4);
+    std::string method = headers.substr(0, headers.find(' '));
+    size_t path_begin = method.size() + 1;
+    std::string target =
+        headers.substr(path_begin, headers.find(' ', path_begin) - path_begin);
+    size_t query_begin = std::min(target.find('?'), target.size());
+    std::string path = target.substr(0, query_begin);
+    std::string query = target.substr(query_begin);
+    std::string comp = QueryParameter(query, "comp");
+    // Skip the body without keeping it around, unless asked to. A block list
+    // is always kept, since it says what the blob is made of.
+    bool keep = keep_contents_ || comp == "blocklist";
+    content.clear();
+    size_t skipped = std::min(body, pending.size());
+    if (keep) {
+      content.insert(content.end(), pending.begin(), pending.begin() + skipped);
+    }
+    pending.erase(0, skipped);
+    while (skipped < body) {
+      int n = recv(s, buffer.data(),
+                   static_cast<int>(std::min(buffer.size(), body - skipped)),
+                   0);
+      if (n <= 0) {
+        CloseSocket(s);
+        return;
+      }
+      if (keep) {
+        content.insert(content.end(), buffer.data(), buffer.data() + n);
+      }
+      skipped += n;
+    }
+    bytes_received_ += body;
+    requests_++;
+
+    std::string response;
+    {
+      std::unique_lock<std::mutex> lock(m_);
+      auto blob = blob_sizes_.find(path);
+      if (method == "HEAD") {
+        response =
+            blob == blob_sizes_.end()
+                ? Response("404 Not Found",
+                           "Content-Length: 0\r\n"
+                           "x-ms-error-code: BlobNotFound\r\n")
+                : Response("200 OK",
+                           "Content-Length: " + std::to_string(blob->second) +
+                               "\r\n"
+                               "x-ms-blob-type: " +
+                               (committed_blocks_.count(path) ? "BlockBlob"
+                                                              : "AppendBlob") +
+                               "\r\n"
+                               "x-ms-creation-time: Sat, 01 Jan 2022 "
+                               "00:00:00 GMT\r\n");
+      } else if (query.find("comp=appendblock") != std::string::npos) {
+        std::string position =
+            Header(headers, "x-ms-blob-condition-appendpos");
+        uint64_t size = blob == blob_sizes_.end() ? 0 : blob->second;
+        if (!position.empty() && std::stoull(position) != size) {
+          response = Response("412 The append position condition specified "
+                              "was not met.",
+                              "Content-Length: 0\r\n"
+                              "x-ms-error-code: "
+                              "AppendPositionConditionNotMet\r\n");
+        } else {
+          blob_sizes_[path] = size + body;
+          if (keep_contents_) {
+            auto& stored = blob_contents_[path];
+            stored.insert(stored.end(), content.begin(), content.end());
+          }
+          response = Response(
+              "201 Created",
+              "Content-Length: 0\r\n"
+              "x-ms-request-server-encrypted: true\r\n"
+              "x-ms-blob-append-offset: " + std::to_string(size) +
+                  "\r\n"
+                  "x-ms-blob-committed-block-count: 1\r\n");
+        }
+      } else if (method == "PUT" && comp == "block") {
+        std::string id = PercentDecode(QueryParameter(query, "blockid"));
+        Block& block = staged_blocks_[path][id];
+        block.size = body;
+        block.data = content;
+        response = Response("201 Created",
+                            "Content-Length: 0\r\n"
+                            "x-ms-request-server-encrypted: true\r\n");
+      } else if (method == "PUT" && comp == "blocklist") {
+        response = CommitBlockList(path, content);
+      } else if (method == "PUT" && query.find("comp=") == std::string::npos &&
+                 Header(headers, "x-ms-blob-type") == "AppendBlob" &&
+                 blob != blob_sizes_.end() &&
+                 Header(headers, "if-none-match") == "*") {
+        response = Response("409 The specified blob already exists.",
+                            "Content-Length: 0\r\n"
+                            "x-ms-error-code: BlobAlreadyExists\r\n");
+      } else {
+        if (method == "PUT" &&
+            Header(headers, "x-ms-blob-type") == "AppendBlob") {
+          blob_sizes_[path] = 0;
+          blob_contents_[path].clear();
+          committed_blocks_.erase(path);
+        }
+        response = Response("201 Created",
+                            "Content-Length: 0\r\n"
+                            "x-ms-request-server-encrypted: true\r\n");
+      }
+    }
+    if (latency_ms_ > 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(latency_ms_));
+    }
+    send(s, response.data(), static_cast<int>(response.size()), kSendFlags);
+  }
+}
+
+std::string LoopbackBlobServer::CommitBlockList(
+    const std::string& path,
+    const std::vector<uint8_t>& body) {
+  auto& staged = staged_blocks_[path];
+  auto& committed = committed_blocks_[path];
+  std::map<std::string, Block> blocks;
+  uint64_t size = 0;
+  std::vector<uint8_t> contents;
+  for (const auto& [kind, id] :
+       BlockListEntries(std::string(body.begin(), body.end()))) {
+    const Block* block = nullptr;
+    if (kind != "Committed" && staged.count(id)) {
+      block = &staged[id];
+    } else if (kind != "Uncommitted" && committed.count(id)) {
+      block = &committed[id];
+    }
+    if (!block) {
+      return Response("400 The specified block list is invalid.",
+                      "Content-Length: 0\r\n"
+                      "x-ms-error-code: InvalidBlockList\r\n");
+    }
+    size += block->size;
+    contents.insert(contents.end(), block->data.begin(), block->data.end());
+    blocks[id] = *block;
+  }
+  committed = std::move(blocks);
+  staged.clear();
+  blob_sizes_[path] = size;
+  blob_contents_[path] = std::move(contents);
+  return Response("201 Created",
+                  "Content-Length: 0\r\n"
+                  "x-ms-request-server-encrypted: true\r\n");
+}
@@ -0,0 +1,94 @@
+#ifndef TOOLS_WRITER_BENCHMARK_LOOPBACK_BLOB_SERVER_H_
+#define TOOLS_WRITER_BENCHMARK_LOOPBACK_BLOB_SERVER_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Minimal stand-in for the blob service on 127.0.0.1. It accepts any request,
+// throws the body away and answers with the headers the storage SDK expects
+// from a successful append blob create or append, so that BufferedBlobWriter
+// can be measured without the network or Azurite. It costs the HTTP and
+// socket work, but nothing a real service does with the data. It does keep
+// the length of each blob, so that conditional creates and appends and
+// property reads behave, and so that retries can be checked for duplicates.
+// Block blobs are handled too: staged blocks are held by id until a block
+// list commits them, which discards any the list leaves out, as the service
+// does. With |keep_contents| it keeps the appended or committed bytes as
+// well, for tests that compare the blob with what was written.
+class LoopbackBlobServer {
+ public:
+  explicit LoopbackBlobServer(bool keep_contents = false);
+  ~LoopbackBlobServer();
+  LoopbackBlobServer(const LoopbackBlobServer&) = delete;
+  LoopbackBlobServer& operator=(const LoopbackBlobServer&) = delete;
+
+  // False if the listening socket couldn't be set up.
+  bool Start();
+
+  void Stop();
+
+  // Connection string pointing the SDK at this server, using the public
+  // development storage account.
+  std::string ConnectionString() const;
+
+  // Delay before each response, as a link with that round trip time would
+  // add. Takes effect from the next request.
+  void SetLatency(std::chrono::milliseconds latency) {
+    latency_ms_ = latency.count();
+  }
+
+  uint64_t BytesReceived() const { return bytes_received_; }
+
+  uint64_t Requests() const { return requests_; }
+
+  // Bytes appended to the blob so far.
+  uint64_t BlobSize(const std::string& container, const std::string& blob);
+
+  // Bytes appended to the blob so far, empty unless contents are kept.
+  std::vector<uint8_t> BlobContents(const std::string& container,
+                                    const std::string& blob);
+
+  // Connections accepted so far, which shows whether the client reuses them.
+  size_t Connections();
+
+ private:
+  void AcceptThread();
+
+  void ServeConnection(intptr_t socket);
+
+  struct Block {
+    uint64_t size = 0;
+    // Empty unless contents are kept.
+    std::vector<uint8_t> data;
+  };
+
+  // Answers Put Block List, which names each block and whether to look for
+  // it among the staged or the committed blocks. Called with m_ held.
+  std::string CommitBlockList(const std::string& path,
+                              const std::vector<uint8_t>& body);
+
+  bool keep_contents_;
+  intptr_t listen_socket_ = -1;
+  int port_ = 0;
+  std::atomic<bool> stopping_ = false;
+  std::atomic<uint64_t> bytes_received_ = 0;
+  std::atomic<uint64_t> requests_ = 0;
+  std::atomic<int64_t> latency_ms_ = 0;
+  std::mutex m_;
+  std::vector<intptr_t> connections_;
+  std::map<std::string, uint64_t> blob_sizes_;
+  std::map<std::string, std::vector<uint8_t>> blob_contents_;
+  // Blocks by blob path and then by block id.
+  std::map<std::string, std::map<std::string, Block>> staged_blocks_;
+  std::map<std::string, std::map<std::string, Block>> committed_blocks_;
+  std::vector<std::thread> threads_;
+  std::thread accept_thread_;
+};
+
+#endif  // TOOLS_WRITER_BENCHMARK_LOOPBACK_BLOB_SERVER_H_
@@ -0,0 +1,325 @@
+#include <cxxopts.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "az/block_blob_writer.h"
+#include "az/buffered_blob_writer.h"
+#include "base/storage/broadcast_writer.h"
+#include "base/storage/checksumming_writer.h"
+#include "base/storage/compressing_writer.h"
+#include "base/storage/file_writer.h"
+#include "base/storage/segmenting_writer.h"
+#include "base/storage/spilling_writer.h"
+#include "loopback_blob_server.h"
+#if !defined(_WIN32)
+#include "base/storage/async_file_writer.h"
+#include "base/storage/mapped_file_writer.h"
+#endif
+
+namespace {
+
+// Size of the AVIO buffer VideoEncoder hands to its writer.
+constexpr size_t kAvioWriteSize = 500 * 1024;
+
+constexpr char kBlobName[] = "writer_benchmark.bin";
+
+class NullWriter : public base::storage::Writer {
+ public:
+  void Write(const uint8_t* data, size_t size) override {}
+
+  void Close() override {}
+};
+
+// User plus system CPU time of the whole process, in seconds.
+double CpuSeconds() {
+#if defined(_WIN32)
+  FILETIME creation, exit, kernel, user;
+  GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+  auto seconds = [](const FILETIME& t) {
+    ULARGE_INTEGER v;
+    v.LowPart = t.dwLowDateTime;
+    v.HighPart = t.dwHighDateTime;
+    return v.QuadPart / 1e7;
+  };
+  return seconds(kernel) + seconds(user);
+#else
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#endif
+}
+
+// Write sizes adding up to |total|. "avio" is what VideoEncoder produces,
+// "small" is a stream of header sized writes, and "mixed" is an ASF like
+// stream of full buffers with the odd small write in between.
+std::vector<size_t> WriteSizes(const std::string& pattern, uint64_t total) {
+  std::mt19937 rng(42);
+  std::vector<size_t> sizes;
+  uint64_t sum = 0;
+  while (sum < total) {
+    size_t size = kAvioWriteSize;
+    if (pattern == "small") {
+      size = 16 + rng() % 497;
+    } else if (pattern == "mixed") {
+      size = sizes.empty() ? 5000
+             : rng() % 100 == 0 ? 16 + rng() % 2000
+                                : kAvioWriteSize;
+    }
+    size = static_cast<size_t>(std::min<uint64_t>(size, total - sum));
+    sizes.push_back(size);
+    sum += size;
+  }
+  return sizes;
+}
+
+// Half noise, half runs, so that compression has something to do without
+// the data being trivial.
+std::vector<uint8_t> MakeData(size_t size) {
+  std::mt19937 rng(7);
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i < size; i++) {
+    data[i] = (i / 4096) % 2 ? static_cast<uint8_t>(rng())
+                             : static_cast<uint8_t>(i / 64);
+  }
+  return data;
+}
+
+std::unique_ptr<base::storage::Writer> MakeFileWriter(
+    const std::filesystem::path& path) {
+  return std::make_unique<base::storage::FileWriter>(path.string().c_str());
+}
+
+std::unique_ptr<base::storage::Writer> MakeWriter(
+    const std::string& name,
+    const std::filesystem::path& dir,
+    const std::string& connection_string,
+    const std::string& container,
+    int blob_chunk_size,
+    bool blob_adaptive,
+    double blob_fault_rate) {
+  if (name == "null") {
+    return std::make_unique<NullWriter>();
+  }
+  if (name == "file") {
+    return MakeFileWriter(dir / "file.bin");
+  }
+#if !defined(_WIN32)
+  if (name == "async_file") {
+    return std::make_unique<base::storage::AsyncFileWriter>(
+        (dir / "async_file.bin").string().c_str());
+  }
+  if (name == "mapped_file") {
+    return std::make_unique<base::storage::MappedFileWriter>(
+        (dir / "mapped_file.bin").string().c_str());
+  }
+#endif
+  if (name == "broadcast" || name == "broadcast_async") {
+    std::vector<std::unique_ptr<base::storage::Writer>> writers;
+    writers.push_back(MakeFileWriter(dir / "broadcast_0.bin"));
+    writers.push_back(MakeFileWriter(dir / "broadcast_1.bin"));
+    base::storage::BroadcastOptions options;
+    options.asynchronous = name == "broadcast_async";
+    options.spill_directory = dir.string();
+    return std::make_unique<base::storage::BroadcastWriter>(std::move(writers),
+                                                            options);
+  }
+  if (name == "compressing") {
+    return std::make_unique<base::storage::CompressingWriter>(
+        MakeFileWriter(dir / "compressing.mcz"));
+  }
+  if (name == "checksumming") {
+    return std::make_unique<base::storage::ChecksummingWriter>(
+        MakeFileWriter(dir / "checksumming.bin"),
+        MakeFileWriter(dir / "checksumming.crc32c"));
+  }
+  if (name == "segmenting") {
+    base::storage::SegmentingOptions options;
+    options.max_segment_bytes = 64 * 1024 * 1024;
+    return std::make_unique<base::storage::SegmentingWriter>(
+        base::storage::FileSegmentFactory((dir / "segment").string(), ".bin"),
+        MakeFileWriter(dir / "segment.idx"), options);
+  }
+  if (name == "spilling") {
+    base::storage::SpillingWriterOptions options;
+    options.journal_path = (dir / "spilling.journal").string();
+    return std::make_unique<base::storage::SpillingWriter>(
+        MakeFileWriter(dir / "spilling.bin"), options);
+  }
+  if (name == "blob") {
+    az::BufferedBlobWriterOptions options;
+    options.max_chunk_size_bytes = blob_chunk_size;
+    options.adaptive_chunk_size = blob_adaptive;
+    options.fault_rate = blob_fault_rate;
+    options.initial_backoff = std::chrono::milliseconds(10);
+    return std::make_unique<az::BufferedBlobWriter>(
+        connection_string, container, kBlobName, options);
+  }
+  if (name == "block_blob") {
+    az::BlockBlobWriterOptions options;
+    options.block_size = blob_chunk_size;
+    return std::make_unique<az::BlockBlobWriter>(
+        connection_string, container, "writer_benchmark_block.bin", options);
+  }
+  return nullptr;
+}
+
+double Percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t i = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+  return sorted[std::min(i, sorted.size() - 1)];
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  cxxopts::Options options("writer_benchmark",
+                           "Measures base::storage::Writer throughput, "
+                           "per-call latency and CPU time.");
+  options.add_options()
+      ("w,writer",
+       "null, file, async_file, mapped_file, broadcast, broadcast_async, "
+       "compressing, checksumming, segmenting, spilling, blob or block_blob",
+       cxxopts::value<std::string>()->default_value("file"))
+      ("p,pattern", "Write sizes: avio, small or mixed",
+       cxxopts::value<std::string>()->default_value("avio"))
+      ("s,size_mb", "MiB to write",
+       cxxopts::value<uint64_t>()->default_value("256"))
+      ("d,dir", "Directory for the files written, removed afterwards",
+       cxxopts::value<std::string>()->default_value("writer_benchmark_tmp"))
+      ("connection_string",
+       "Blob storage for the blob writer, e.g. UseDevelopmentStorage=true for "
+       "Azurite. Empty uses a loopback stand-in for the service.",
+       cxxopts::value<std::string>()->default_value(""))
+      ("container", "Blob container, which must exist",
+       cxxopts::value<std::string>()->default_value("benchmark"))
+      ("blob_chunk_kb",
+       "KiB per append or staged block for the blob writers. Smaller chunks "
+       "make the cost of each round trip stand out.",
+       cxxopts::value<int>()->default_value("2048"))
+      ("blob_adaptive",
+       "Let the blob writer size its chunks from measured throughput, up to "
+       "blob_chunk_kb",
+       cxxopts::value<bool>()->default_value("false"))
+      ("blob_fault_rate",
+       "Fraction of appends the blob writer fails on purpose, to measure "
+       "the cost of recovering from them",
+       cxxopts::value<double>()->default_value("0"))
+      ("h,help", "Print usage");
+  auto args = options.parse(argc, argv);
+  if (args.count("help")) {
+    std::cout << options.help() << std::endl;
+    return 0;
+  }
+
+  std::string writer_name = args["writer"].as<std::string>();
+  std::string pattern = args["pattern"].as<std::string>();
+  uint64_t total = args["size_mb"].as<uint64_t>() * 1024 * 1024;
+  std::filesystem::path dir = args["dir"].as<std::string>();
+  std::filesystem::create_directories(dir);
+
+  LoopbackBlobServer server;
+  std::string connection_string = args["connection_string"].as<std::string>();
+  bool uses_blob = writer_name == "blob" || writer_name == "block_blob";
+  if (uses_blob && connection_string.empty()) {
+    if (!server.Start()) {
+      std::cout << "Failed to start the loopback blob server." << std::endl;
+      return 1;
+    }
+    connection_string = server.ConnectionString();
+  }
+
+  auto writer = MakeWriter(writer_name, dir, connection_string,
+                           args["container"].as<std::string>(),
+                           args["blob_chunk_kb"].as<int>() * 1024,
+                           args["blob_adaptive"].as<bool>(),
+                           args["blob_fault_rate"].as<double>());
+  if (!writer) {
+    std::cout << "Unknown writer " << writer_name << std::endl;
+    return 1;
+  }
+  std::vector<size_t> sizes = WriteSizes(pattern, total);
+  std::vector<uint8_t> data =
+      MakeData(*std::max_element(sizes.begin(), sizes.end()));
+  std::vector<double> latencies_us;
+  latencies_us.reserve(sizes.size());
+
+  double cpu_start = CpuSeconds();
+  auto start = std::chrono::steady_clock::now();
+  for (size_t size : sizes) {
+    auto call_start = std::chrono::steady_clock::now();
+    writer->Write(data.data(), size);
+    latencies_us.push_back(std::chrono::duration<double, std::micro>(
+                               std::chrono::steady_clock::now() - call_start)
+                               .count());
+  }
+  auto close_start = std::chrono::steady_clock::now();
+  writer->Close();
+  auto end = std::chrono::steady_clock::now();
+  double cpu = CpuSeconds() - cpu_start;
+  std::optional<az::BlobUploadMetrics> blob_metrics;
+  if (auto* blob = dynamic_cast<az::BufferedBlobWriter*>(writer.get())) {
+    blob_metrics = blob->GetMetrics();
+  }
+  writer.reset();
+  server.Stop();
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  double close_ms =
+      std::chrono::duration<double, std::milli>(end - close_start).count();
+  std::sort(latencies_us.begin(), latencies_us.end());
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "writer " << writer_name << ", pattern " << pattern << ", "
+            << sizes.size() << " writes, " << total / (1024.0 * 1024.0)
+            << " MiB\n";
+  std::cout << "  throughput  " << total / (1024.0 * 1024.0) / seconds
+            << " MiB/s (" << seconds * 1000 << " ms, close " << close_ms
+            << " ms)\n";
+  std::cout << "  write us    p50 " << Percentile(latencies_us, 0.5)
+            << "  p90 " << Percentile(latencies_us, 0.9) << "  p99 "
+            << Percentile(latencies_us, 0.99) << "  p99.9 "
+            << Percentile(latencies_us, 0.999) << "  max "
+            << latencies_us.back() << "\n";
+  std::cout << "  cpu         " << cpu * 1000 << " ms (" << 100 * cpu / seconds
+            << "% of one core)\n";
+  if (blob_metrics) {
+    std::cout << "  upload      chunk " << blob_metrics->chunk_size_bytes / 1024
+              << " KiB, "
+              << blob_metrics->upload_bytes_per_second / (1024.0 * 1024.0)
+              << " MiB/s, last append "
+              << blob_metrics->last_append_latency.count() * 1000 << " ms\n";
+  }
+  if (server.Requests() > 0) {
+    std::cout << "  loopback    " << server.Requests() << " requests over "
+              << server.Connections() << " connections, "
+              << server.BytesReceived() / (1024.0 * 1024.0) << " MiB\n";
+    if (writer_name == "blob") {
+      // Retries must neither lose nor repeat a chunk.
+      uint64_t blob_size =
+          server.BlobSize(args["container"].as<std::string>(), kBlobName);
+      std::cout << "  blob        " << blob_size << " of " << total
+                << " bytes\n";
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::remove_all(dir, ec);
+  return 0;
+}